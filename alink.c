@@ -11,6 +11,8 @@ PCHAR outname=0;
 BOOL defaultUse32=FALSE;
 
 BOOL gotstart=FALSE;
+BOOL partialLink=FALSE;
+BOOL zeroFillIsUninit=FALSE; /* loader clears space past the initialised data */
 RELOC startaddr;
 UINT frameAlign=1;
 BOOL dosSegOrdering=FALSE;
@@ -57,6 +59,7 @@ PPMERGEREC mergeList=NULL;
 UINT mergeCount=0;
 
 BOOL useOldMap=FALSE;
+static BOOL mergeData=FALSE;
 
 static BOOL NULLDetect(PFILE f,PCHAR name)
 {
@@ -79,11 +82,46 @@ CINPUTFMT inputFormats[]={
 	{NULL,NULL,NULL,NULL,NULL}
 };
 
+/* input format by name, NULL if there is none */
+PCINPUTFMT findInputFormat(PCHAR name)
+{
+	UINT i;
+
+	for(i=0;inputFormats[i].name;++i)
+	{
+		if(!strcmp(inputFormats[i].name,name)) return inputFormats+i;
+	}
+	return NULL;
+}
+
+/* leading bytes of each input format, so only likely formats run their detect routine */
+/* formats not listed here are always asked */
+static const struct formatmagic
+{
+	PDETECTFUNC detect;
+	UINT length;
+	UCHAR bytes[8];
+} formatMagic[]={
+	{OMFDetect,1,{THEADR}},
+	{OMFDetect,1,{LHEADR}},
+	{OMFLibDetect,1,{LIBHDR}},
+	{COFFDetect,2,{0x00,0x00}}, /* import object, or no machine */
+	{COFFDetect,2,{0x4c,0x01}}, /* i386 */
+	{COFFDetect,2,{0x4d,0x01}}, /* i860 */
+	{COFFDetect,2,{0x4e,0x01}}, /* i486 */
+	{COFFLibDetect,8,{'!','<','a','r','c','h','>','\n'}},
+	{Res32Detect,8,{0,0,0,0,0x20,0,0,0}},
+	{NULL,0,{0}}
+};
+
 COUTPUTFMT outputFormats[]={
 	{"pe",PEExtension,PEInitialise,PEFinalise,PESwitches,"MS Portable Executable format"},
 	{"exe",".exe",EXEInitialise,EXEFinalise,EXESwitches,"MSDOS EXE format"},
 	{"com",".com",COMInitialise,BINFinalise,NULL,"MSDOS COM format"},
 	{"bin",".bin",BINInitialise,BINFinalise,BINSwitches,"Binary format"},
+	{"coff",".obj",COFFObjInitialise,COFFObjFinalise,NULL,"Relocatable MS COFF object, partial link"},
+	{"omflib",".lib",OMFLibInitialise,OMFLibFinalise,NULL,"OMF library of the input objects"},
+	{"cofflib",".lib",COFFLibInitialise,COFFLibFinalise,NULL,"MS COFF archive of the input objects"},
 	{NULL,NULL,NULL,NULL,NULL,NULL}
 };
 
@@ -110,9 +148,20 @@ static CSWITCHENTRY systemSwitches[]={
 	{"f",1,"Select specified output format"}, /* output format */
 	{"nodeflib",0,"Don't use default libraries from object files"}, /* no default libraries */
 	{"iformat",2,"Select specified input format for specified file"},
-	{"mergesegs",2,"Merge two segments together"},
+	{"mergesegs",2,"Merge segments matching first name (* and ? allowed) into second"},
 	{"v",0,"Verbose diagnostics"},
 	{"oldmap",0,"Use ALINK v1.6 compatible map files"},
+	{"mergedata",0,"Merge identical read-only data and string tails"},
+	{"time-report",0,"Report time spent in each link phase"},
+	{"time-report-json",1,"Write time report in JSON format to specified file"},
+	{"trace",1,"Write Chrome trace events for link to specified file"},
+	{"alloc-stats",0,"Report memory allocation statistics by call site"},
+	{"incremental",0,"Patch changed object files into previous PE output where possible"},
+	{"libindex",0,"Keep library dictionaries in index files beside libraries"},
+	{"fingerprint",0,"Skip link if inputs are unchanged since last link"},
+	{"MF",1,"Write make dependency file listing inputs used"},
+	{"server",1,"Run link server on specified socket, must be first option"},
+	{"client",1,"Send link to server on specified socket, must be first option"},
 #if 0
 	{"nocase",0,"Disable case sensitivity"}, /* disable case sensitivity */
 	{"nosearch",1,"Don't search specified library"}, /* disable single library */
@@ -147,6 +196,25 @@ PMODULE createModule(PCHAR filename)
 	return m;
 }
 
+/* whether the start of a file could belong to a format with this detect routine */
+static BOOL magicMatches(PDETECTFUNC detect,PUCHAR head,UINT headLength)
+{
+	UINT i;
+	BOOL listed=FALSE;
+
+	for(i=0;formatMagic[i].detect;++i)
+	{
+		if(formatMagic[i].detect!=detect) continue;
+		listed=TRUE;
+		if((formatMagic[i].length<=headLength)
+		   && !memcmp(formatMagic[i].bytes,head,formatMagic[i].length))
+		{
+			return TRUE;
+		}
+	}
+	return !listed;
+}
+
 void loadFiles()
 {
 	UINT i,j;
@@ -156,6 +224,8 @@ void loadFiles()
 	FILE *afile;
 	PMODULE m;
 	PCINPUTFMT fmt;
+	UCHAR head[8];
+	UINT headLength;
 
 	for(i=0;i<fileCount;i++)
 	{
@@ -206,9 +276,10 @@ void loadFiles()
 		if(!m->fmt)
 		{
 			fmt=NULL;
+			/* read the start once, rather than for every format */
+			headLength=fread(head,1,sizeof(head),afile);
 			for(j=0;inputFormats[j].name;++j)
 			{
-				fseek(afile,0,SEEK_SET);
 				name=m->file;
 				if(!inputFormats[j].detect)
 				{
@@ -224,8 +295,12 @@ void loadFiles()
 				{
 					name+=k;
 				}
-				if(!strcmp(name,ext) &&
-				   inputFormats[j].detect(afile,m->file))
+				if(strcmp(name,ext) || !magicMatches(inputFormats[j].detect,head,headLength))
+				{
+					continue;
+				}
+				fseek(afile,0,SEEK_SET);
+				if(inputFormats[j].detect(afile,m->file))
 				{
 					if(fmt)
 					{
@@ -250,12 +325,14 @@ void loadFiles()
 
 		diagnostic(DIAG_VERBOSE,"Format %s\n",m->fmt->name);
 
+		traceBegin("file","%s",m->file);
 		fseek(afile,0,SEEK_SET);
 		if(!m->fmt->load(afile,m))
 		{
 			addError("Error loading file %s",m->file);
 		}
 		fclose(afile);
+		traceEnd();
 	}
 }
 
@@ -284,7 +361,6 @@ static void initialise(void)
 	BOOL isend;
 	PCOUTPUTFMT of;
 
-	atexit(listErrors);
 	for(i=0;systemSwitches[i].name;++i);
 
 	switchCount=i;
@@ -670,6 +746,47 @@ void initFormat(PSWITCHPARAM sp)
 			{
 				useOldMap=TRUE;
 			}
+			else if(!strcmp(sp[i].name,"mergedata"))
+			{
+				mergeData=TRUE;
+			}
+			else if(!strcmp(sp[i].name,"time-report"))
+			{
+				timeReport=TRUE;
+			}
+			else if(!strcmp(sp[i].name,"time-report-json"))
+			{
+				timeReport=TRUE;
+				timeReportFile=sp[i].params[0];
+			}
+			else if(!strcmp(sp[i].name,"trace"))
+			{
+				openTrace(sp[i].params[0]);
+			}
+			else if(!strcmp(sp[i].name,"alloc-stats"))
+			{
+				allocStats=TRUE;
+			}
+			else if(!strcmp(sp[i].name,"incremental"))
+			{
+				incremental=TRUE;
+			}
+			else if(!strcmp(sp[i].name,"fingerprint"))
+			{
+				fingerprint=TRUE;
+			}
+			else if(!strcmp(sp[i].name,"MF"))
+			{
+				depFileName=sp[i].params[0];
+			}
+			else if(!strcmp(sp[i].name,"libindex"))
+			{
+				libIndexFiles=TRUE;
+			}
+			else if(!strcmp(sp[i].name,"server") || !strcmp(sp[i].name,"client"))
+			{
+				addError("Switch \"%s\" must be the first option",sp[i].name);
+			}
 		}
 		if(!chosenFormat)
 		{
@@ -709,7 +826,7 @@ void initFormat(PSWITCHPARAM sp)
 }
 
 
-int main(int argc,char *argv[])
+int linkMain(int argc,char *argv[])
 {
 	UINT i;
 	PSEG a;
@@ -718,6 +835,7 @@ int main(int argc,char *argv[])
 	PCHAR str;
 
 	diagnosticLevel=DIAG_BASIC;
+	startTiming();
 
 	diagnostic(DIAG_VITAL,"ALINK v%i.%i (C) Copyright 1998-2004 Anthony A.J. Williams.\n",ALINK_MAJOR,ALINK_MINOR);
 	diagnostic(DIAG_VITAL,"All Rights Reserved\n\n");
@@ -781,6 +899,14 @@ int main(int argc,char *argv[])
 		addError("Empty output filename");
 		goto prog_end;
 	}
+	for(i=0;i<fileCount;++i)
+	{
+		if(!strcmp(fileNames[i]->file,outname))
+		{
+			addError("Output file %s would overwrite an input file",outname);
+			goto prog_end;
+		}
+	}
 
 	if(mapfile)
 	{
@@ -809,29 +935,90 @@ int main(int argc,char *argv[])
 		}
 	}
 
+	if(fingerprint && fingerprintCheck(sp,outname))
+	{
+		goto prog_end;
+	}
+
+	if(incremental)
+	{
+		if(strcmp(chosenFormat->name,"pe") || mapfile || mergeData || debugRequired)
+		{
+			diagnostic(DIAG_BASIC,"Warning: incremental linking needs PE output without map file, debug info or data merging\n");
+			incremental=FALSE;
+		}
+		else if(PEHashedTimeStamps())
+		{
+			/* a patched image would keep the hash of its old contents */
+			diagnostic(DIAG_BASIC,"Warning: incremental linking needs SOURCE_DATE_EPOCH with -reproducible\n");
+			incremental=FALSE;
+		}
+		else if(incrementalRelink(sp,outname))
+		{
+			goto prog_end;
+		}
+	}
+
+	depNoteFiles();
+	/* libraries take the input files as they are, without linking */
+	if(libraryOutput)
+	{
+		goto finalise;
+	}
+
 	diagnostic(DIAG_VERBOSE,"Loading files\n");
 
+	beginPhase("loadFiles");
 	loadFiles();
+	endPhase();
+	if(incremental)
+	{
+		incrementalNoteSegments();
+	}
 
 	/* resolve externs before checking for required modules, in case entry point forces a load */
 
+	beginPhase("resolveExterns");
 	resolveExterns();
+	endPhase();
 	if(!moduleCount)
 	{
 		addError("No required modules specified");
 		goto prog_end;
 	}
 
+	beginPhase("emitCommonSymbols");
 	emitCommonSymbols();
+	endPhase();
+	if(incremental)
+	{
+		incrementalNoteComdats();
+	}
 
+	beginPhase("combineSegments");
 	combineSegments();
+	endPhase();
+
+	beginPhase("loadDeferredData");
+	loadDeferredData();
+	endPhase();
 
+	if(mergeData)
+	{
+		beginPhase("mergeReadOnlyData");
+		mergeReadOnlyData();
+		endPhase();
+	}
+
+ finalise:
 	diagnostic(DIAG_VERBOSE,"Output format %s\n",chosenFormat->name);
 
 	if(chosenFormat->finalise)
 	{
 		diagnostic(DIAG_VERBOSE,"Finalising\n");
+		beginPhase("finalise");
 		chosenFormat->finalise(outname);
+		endPhase();
 	}
 	else
 	{
@@ -849,14 +1036,17 @@ int main(int argc,char *argv[])
 		spaceCount=1;
 		spaceList=checkMalloc(sizeof(PSEG));
 		spaceList[0]=a;
+		beginPhase("performFixups");
 		for(i=0;i<spaceCount;++i)
 		{
 			performFixups(spaceList[i]);
 		}
+		endPhase();
 	}
 
-	if(mapfile)
+	if(mapfile && !libraryOutput)
 	{
+		beginPhase("generateMap");
 		if(useOldMap)
 		{
 			generateOldMap(mapname);
@@ -865,6 +1055,7 @@ int main(int argc,char *argv[])
 		{
 			generateMap(mapname);
 		}
+		endPhase();
 	}
 	for(i=0;i<spaceCount;++i)
 	{
@@ -875,6 +1066,7 @@ int main(int argc,char *argv[])
 	{
 		diagnostic(DIAG_VERBOSE,"Writing %s\n",outname);
 
+		beginPhase("writeSeg");
 		ofile=fopen(outname,"w+b");
 
 		if(!ofile)
@@ -888,8 +1080,50 @@ int main(int argc,char *argv[])
 		}
 
 		fclose(ofile);
+		endPhase();
+		if(libraryOutput && libIndexFiles)
+		{
+			/* write the new library's index file straight away */
+			cacheLibrary(outname);
+		}
+		if(incremental)
+		{
+			incrementalSave(outname);
+		}
+		if(fingerprint)
+		{
+			fingerprintSave(outname);
+		}
+		if(depFileName)
+		{
+			writeDepFile(outname);
+		}
 	}
  prog_end:
+	reportTiming();
+	reportAllocStats();
 
 	return errorCount?1:0;
 }
+
+int main(int argc,char *argv[])
+{
+	PCHAR sockname;
+
+	atexit(listErrors);
+	if(argc>2)
+	{
+		if(!strcmp(argv[1],"-server"))
+		{
+			return runServer(argv[2]);
+		}
+		if(!strcmp(argv[1],"-client"))
+		{
+			sockname=argv[2];
+			/* drop the switch, leaving the program name in place */
+			argv[2]=argv[0];
+			return runClient(sockname,argc-2,argv+2);
+		}
+	}
+	return linkMain(argc,argv);
+}
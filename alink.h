@@ -88,7 +88,8 @@
 typedef FILE *PFILE;
 
 typedef struct symbol SYMBOL,*PSYMBOL,**PPSYMBOL;
-typedef struct datablock DATABLOCK,*PDATABLOCK;
+typedef struct datablock DATABLOCK,*PDATABLOCK,**PPDATABLOCK;
+typedef struct liblock LIBLOCK,*PLIBLOCK, **PPLIBLOCK;
 typedef struct segment SEG,*PSEG,**PPSEG;
 typedef struct content CONTENT,*PCONTENT;
 typedef struct linenum LINENUM,*PLINENUM;
@@ -110,17 +111,22 @@ typedef struct resource RESOURCE, *PRESOURCE;
 typedef struct libmod LIBMOD, *PLIBMOD;
 typedef struct exportrec EXPORTREC, *PEXPORTREC,**PPEXPORTREC;
 typedef struct scriptblock SCRIPTBLOCK, *PSCRIPTBLOCK;
+typedef struct libindex LIBINDEX, *PLIBINDEX, **PPLIBINDEX;
+typedef struct filestamp FILESTAMP, *PFILESTAMP;
 
 typedef int (*PCOMPAREFUNC)(const void *x1,const void *x2);
+typedef BOOL (*PDATAFUNC)(PUCHAR p,UINT len,void *ctx);
 
 typedef BOOL (DETECTFUNC)(PFILE f,PCHAR name);
 typedef BOOL (LOADFUNC)(PFILE f,PMODULE name);
 typedef BOOL (INITFUNC)(PSWITCHPARAM options);
 typedef BOOL (FINALFUNC)(PCHAR name);
+typedef PLIBINDEX (LIBREADFUNC)(PFILE f,PCHAR file);
 typedef DETECTFUNC *PDETECTFUNC;
 typedef LOADFUNC *PLOADFUNC;
 typedef INITFUNC *PINITFUNC;
 typedef FINALFUNC *PFINALFUNC;
+typedef LIBREADFUNC *PLIBREADFUNC;
 
 struct inputfmt
 {
@@ -181,7 +187,20 @@ struct datablock
 	UINT offset;
 	UINT length;
 	UINT align;
-	PUCHAR data;
+	PUCHAR data; /* NULL if all zero, iterated or not read yet */
+	PLIBLOCK iterated; /* repeat tree, expanded when written */
+	PCHAR deferFile; /* file still holding the data, at deferPos */
+	UINT deferPos;
+};
+
+/* iterated data, count repeats of either blocks sub-blocks or a leaf of bytes */
+struct liblock
+{
+	UINT count;
+	UINT blocks;
+	UINT dataofs; /* offset of block in record, for fixups */
+	UINT length; /* expanded length of one repeat */
+	void *data; /* sub-blocks, or length byte followed by leaf bytes */
 };
 
 struct content
@@ -228,6 +247,8 @@ struct segment
 	PRELOC relocs;
 	UINT scriptCount;
 	PSCRIPTBLOCK scriptList;
+	UINT initLength; /* cached by getInitLength */
+	BOOL initKnown;
 };
 
 struct symbol
@@ -322,6 +343,37 @@ struct libmod
 	UINT filepos;
 };
 
+/* FNV-1 offset basis */
+#define HASH_INIT 2166136261UL
+
+#define LIBINDEX_OMF 1
+#define LIBINDEX_COFF 2
+
+/* size and modification time, to tell when a file has been rewritten */
+struct filestamp
+{
+	UINT size;
+	UINT mtime;
+	UINT mtimeNsec; /* zero where only seconds are available */
+};
+
+/* library dictionary, as read from the file */
+struct libindex
+{
+	PCHAR file;
+	UINT type;
+	FILESTAMP stamp;
+	UINT flags;
+	UINT count;
+	PPCHAR names;
+	UINT *filepos;
+	PUCHAR longnames;
+	UINT longnamesLength;
+	PUCHAR image; /* index file contents, if loaded from one */
+	UINT imageLength;
+	BOOL mapped;
+};
+
 struct exportrec
 {
 	PCHAR int_name;
@@ -339,32 +391,58 @@ void SetNbit(PUCHAR mask,long i);
 char GetNbit(PUCHAR mask,long i);
 void Set16(PUCHAR buf,USHORT v);
 void Set32(PUCHAR buf,UINT v);
+BOOL isZeroData(PUCHAR buf,UINT len);
 int wstricmp(const char *s1,const char*s2);
 int wstrlen(const char *s);
 unsigned short wtoupper(unsigned short a);
 int getBitCount(UINT a);
 
-void *checkMalloc(size_t x);
-void *checkRealloc(void *p,size_t x);
-char *checkStrdup(const char *s);
-void checkFree(void *p);
+void *checkMallocAt(size_t x,PCHAR file,int line);
+void *checkReallocAt(void *p,size_t x,PCHAR file,int line);
+char *checkStrdupAt(const char *s,PCHAR file,int line);
+void checkFreeAt(void *p,PCHAR file,int line);
+void reportAllocStats(void);
+PCHAR getFullPath(PCHAR file);
+BOOL getFileStamp(PCHAR name,PFILESTAMP stamp);
+BOOL sameFileStamp(PFILESTAMP a,PFILESTAMP b);
+
+/* pass the call site through, for -alloc-stats */
+#define checkMalloc(x) checkMallocAt((x),__FILE__,__LINE__)
+#define checkRealloc(p,x) checkReallocAt((p),(x),__FILE__,__LINE__)
+#define checkStrdup(s) checkStrdupAt((s),__FILE__,__LINE__)
+#define checkFree(p) checkFreeAt((p),__FILE__,__LINE__)
 
 PDATABLOCK createDataBlock(PUCHAR p,UINT offset,UINT length,UINT align);
+PDATABLOCK createZeroDataBlock(UINT offset,UINT length,UINT align);
+PDATABLOCK createIteratedDataBlock(PLIBLOCK p,UINT offset,UINT align);
+PDATABLOCK createDeferredDataBlock(PCHAR file,UINT pos,UINT length,UINT align);
+BOOL isZeroBlock(PDATABLOCK d);
+void loadDeferredData(void);
+PUCHAR fillDataBlock(PDATABLOCK d);
+void copyDataBlock(PDATABLOCK d,PUCHAR buf);
+BOOL scanDataBlock(PDATABLOCK d,PDATAFUNC emit,void *ctx);
+void freeLiBlock(PLIBLOCK p);
 void freeDataBlock(PDATABLOCK d);
 PSEG createSection(PCHAR name,PCHAR class,PCHAR sortKey,PMODULE mod,UINT length, UINT align);
 PSEG createDuplicateSection(PSEG old);
 void freeSection(PSEG s);
 PSEG addSeg(PSEG s,PSEG c);
+PSEG addSegs(PSEG s,PPSEG list,UINT count);
 PSEG addCommonSeg(PSEG s,PSEG c);
 PSEG addData(PSEG s,PDATABLOCK c);
 PSEG addFixedData(PSEG s,PDATABLOCK c);
+PSEG extendFixedData(PSEG s,PDATABLOCK d,PUCHAR p,UINT length,UINT *space);
 PSEG removeContent(PSEG s,UINT i);
 UINT getInitLength(PSEG s);
+void invalidateInitLength(PSEG s);
 BOOL writeSeg(FILE *f,PSEG s);
 
 PMODULE createModule(PCHAR filename);
+void loadFiles(void);
+PCINPUTFMT findInputFormat(PCHAR name);
 PSWITCHPARAM processArgs(UINT argc,PCHAR *argv,UINT depth,PSWITCHENTRY switchList,UINT switchCount);
 BOOL combineSegments(void);
+BOOL mergeReadOnlyData(void);
 
 PSYMBOL findSymbol(PCHAR key);
 PSYMBOL createSymbol(PCHAR name,INT type,PMODULE mod,...);
@@ -387,6 +465,14 @@ INITFUNC COMInitialise;
 FINALFUNC BINFinalise;
 extern CSWITCHENTRY BINSwitches[];
 
+INITFUNC COFFObjInitialise;
+FINALFUNC COFFObjFinalise;
+
+INITFUNC OMFLibInitialise;
+FINALFUNC OMFLibFinalise;
+INITFUNC COFFLibInitialise;
+FINALFUNC COFFLibFinalise;
+
 DETECTFUNC OMFDetect;
 LOADFUNC loadOMFModule;
 DETECTFUNC COFFDetect;
@@ -399,6 +485,41 @@ LOADFUNC OMFLibLoad;
 DETECTFUNC COFFLibDetect;
 LOADFUNC MSCOFFLibLoad;
 LOADFUNC DJGPPLibLoad;
+LIBREADFUNC OMFLibReadIndex;
+LIBREADFUNC COFFLibReadIndex;
+
+PLIBINDEX createLibIndex(PCHAR file,UINT type);
+void addLibIndexSymbol(PLIBINDEX idx,PCHAR name,UINT filepos);
+void freeLibIndex(PLIBINDEX idx);
+BOOL useLibIndex(PLIBINDEX idx,PMODULE mod,PLOADFUNC modload);
+PLIBINDEX findLibIndex(PCHAR file);
+PLIBINDEX getLibIndex(PFILE f,PCHAR file,UINT type,PLIBREADFUNC readIndex,BOOL *cached);
+void releaseLibIndex(PLIBINDEX idx);
+PLIBINDEX openLibIndex(PCHAR file,BOOL *cached);
+BOOL cacheLibrary(PCHAR file);
+
+int runServer(PCHAR sockname);
+int runClient(PCHAR sockname,int argc,char *argv[]);
+void serverNoteLibrary(PCHAR file);
+int linkMain(int argc,char *argv[]);
+
+BOOL incrementalRelink(PSWITCHPARAM sp,PCHAR outname);
+void incrementalNoteSegments(void);
+void incrementalNoteComdats(void);
+void incrementalSave(PCHAR outname);
+
+UINT hashBytes(UINT h,PUCHAR p,UINT len);
+UINT hashString(UINT h,PCHAR s);
+UINT hashValue(UINT h,UINT v);
+UINT hashArgs(PSWITCHPARAM sp);
+BOOL fingerprintCheck(PSWITCHPARAM sp,PCHAR outname);
+void fingerprintNoteLibrary(PLIBINDEX idx,PMODULE mod);
+void fingerprintNoteMember(PMODULE mod,UINT filepos,UINT end);
+void fingerprintSave(PCHAR outname);
+
+void addDependency(PCHAR file);
+void depNoteFiles(void);
+BOOL writeDepFile(PCHAR outname);
 
 void generateMap(PCHAR mapname);
 void generateOldMap(PCHAR mapname);
@@ -406,12 +527,23 @@ void generateOldMap(PCHAR mapname);
 BOOL getStub(PCHAR stubName,PUCHAR *pstubData,UINT *pstubSize);
 
 void buildPEFile(void);
+BOOL PEHashedTimeStamps(void);
+UINT calcSegChecksum(PSEG s,UINT *pos);
 void buildNEFile(void);
 
 void diagnostic(int level,char *msg,...);
 void addError(char *msg,...);
 void listErrors(void);
 
+void startTiming(void);
+void beginPhase(PCHAR name);
+void endPhase(void);
+void reportTiming(void);
+BOOL openTrace(PCHAR name);
+void closeTrace(void);
+void traceBegin(PCHAR category,PCHAR fmt,...);
+void traceEnd(void);
+
 /* alias strdup for _strdup if one provided but not the other */
 #ifndef GOT_STRDUP
 #ifdef GOT__STRDUP
@@ -452,6 +584,9 @@ extern BOOL noDefaultLibs;
 extern BOOL defaultUse32;
 
 extern BOOL gotstart;
+extern BOOL partialLink;
+extern BOOL zeroFillIsUninit;
+extern BOOL libraryOutput;
 extern RELOC startaddr;
 
 extern UINT errcount;
@@ -492,6 +627,20 @@ extern UINT dllCount;
 
 extern PSEG absoluteSegment;
 
+extern BOOL timeReport;
+extern PCHAR timeReportFile;
+extern BOOL allocStats;
+extern BOOL libCacheEnabled;
+extern BOOL libIndexFiles;
+extern BOOL incremental;
+extern BOOL fingerprint;
+extern PCHAR depFileName;
+extern BOOL relocsRequired;
+extern BOOL debugRequired;
+extern UINT segmentsCreated;
+extern UINT dataBlocksCreated;
+extern UINT fixupsApplied;
+
 extern PPCHAR errorList;
 extern UINT errorCount;
 extern UINT diagnosticLevel;
@@ -31,6 +31,7 @@ PSWITCHPARAM processArgs(UINT argc,PCHAR *argv,UINT depth,PSWITCHENTRY switchLis
 				addError("Unable to open response file \"%s\"",argv[i]+1);
 				continue;
 			}
+			addDependency(argv[i]+1);
 			newargs=NULL;
 			newargc=0;
 			p=NULL;
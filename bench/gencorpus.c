@@ -0,0 +1,1188 @@
+/* synthetic input generator for benchmarking alink at scale */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "basetypes.h"
+
+/* OMF record types */
+#define THEADR 0x80
+#define EXTDEF 0x8c
+#define PUBDEF32 0x91
+#define LNAMES 0x96
+#define SEGDEF32 0x99
+#define FIXUPP32 0x9d
+#define LEDATA32 0xa1
+#define COMDAT32 0xc3
+#define MODEND32 0x8b
+#define LIBHDR 0xf0
+#define LIBEND 0xf1
+
+#define LIBF_CASESENSITIVE 1
+
+#define OMF_CHUNK 1024	/* LEDATA size */
+#define OMF_RECMAX 1000 /* soft limit for name records */
+#define OMF_DICBUCKETS 37
+
+/* COFF constants */
+#define COFF_I386 0x14c
+#define COFF_TEXT 0x60500020	/* code, exec, read, align 16 */
+#define COFF_DATA 0xc0300040	/* init data, read, write, align 4 */
+#define COFF_COMDAT 0x1000
+#define COFF_DIR32 6
+#define COFF_REL32 0x14
+#define COFF_EXTERNAL 2
+#define COFF_STATIC 3
+#define COFF_PICKANY 2
+#define COFF_MAXRELOCS 0xffff
+
+struct buffer
+{
+	PUCHAR data;
+	UINT length;
+	UINT size;
+};
+
+typedef struct buffer BUFFER,*PBUFFER;
+
+/* one synthetic module - publics are pubFormat(index,n), externs are pubFormat(extIndex,n) */
+struct module
+{
+	PCHAR pubFormat;
+	UINT index;
+	UINT publics;
+	UINT relocs;
+	UINT extIndex;
+	UINT extCount;
+	PCHAR libFormat;
+	UINT libFirst;
+	UINT libCount;
+	UINT libModules;
+	UINT comdats;
+	BOOL start;
+};
+
+typedef struct module MODULE,*PMODULE;
+
+struct member
+{
+	BUFFER data;
+	PPCHAR syms;
+	UINT symCount;
+};
+
+typedef struct member MEMBER,*PMEMBER;
+
+static UINT modules=100;
+static UINT symbols=100;
+static UINT relocs=1000;
+static UINT libModules=100;
+static UINT libSymbols=10;
+static UINT comdats=10;
+static UINT resources=100;
+static PCHAR outDir=".";
+
+static void *checkMalloc(size_t x)
+{
+	void *p;
+
+	p=malloc(x);
+	if(!p)
+	{
+		fprintf(stderr,"Error, Insufficient memory in call to malloc\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void *checkRealloc(void *p,size_t x)
+{
+	p=realloc(p,x);
+	if(!p)
+	{
+		fprintf(stderr,"Error, Insufficient memory in call to realloc\n");
+		exit(1);
+	}
+	return p;
+}
+
+static PCHAR makeName(PCHAR fmt,UINT a,UINT b)
+{
+	char buf[64];
+	PCHAR p;
+
+	sprintf(buf,fmt,a,b);
+	p=checkMalloc(strlen(buf)+1);
+	strcpy(p,buf);
+	return p;
+}
+
+static void reserve(PBUFFER b,UINT n)
+{
+	if(b->length+n<=b->size) return;
+	b->size=(b->size*2>b->length+n)?b->size*2:b->length+n+256;
+	b->data=checkRealloc(b->data,b->size);
+}
+
+static void put8(PBUFFER b,UINT v)
+{
+	reserve(b,1);
+	b->data[b->length++]=v&0xff;
+}
+
+static void put16(PBUFFER b,UINT v)
+{
+	put8(b,v);
+	put8(b,v>>8);
+}
+
+static void put32(PBUFFER b,UINT v)
+{
+	put16(b,v);
+	put16(b,v>>16);
+}
+
+static void put32BE(PBUFFER b,UINT v)
+{
+	put8(b,v>>24);
+	put8(b,v>>16);
+	put8(b,v>>8);
+	put8(b,v);
+}
+
+static void putBytes(PBUFFER b,const void *p,UINT n)
+{
+	reserve(b,n);
+	memcpy(b->data+b->length,p,n);
+	b->length+=n;
+}
+
+static void putFill(PBUFFER b,UINT c,UINT n)
+{
+	reserve(b,n);
+	memset(b->data+b->length,c,n);
+	b->length+=n;
+}
+
+static void set16(PBUFFER b,UINT ofs,UINT v)
+{
+	b->data[ofs]=v&0xff;
+	b->data[ofs+1]=(v>>8)&0xff;
+}
+
+static void set32(PBUFFER b,UINT ofs,UINT v)
+{
+	set16(b,ofs,v);
+	set16(b,ofs+2,v>>16);
+}
+
+static BOOL writeFile(PCHAR name,PBUFFER b)
+{
+	char path[1024];
+	FILE *f;
+
+	sprintf(path,"%s/%s",outDir,name);
+	f=fopen(path,"wb");
+	if(!f)
+	{
+		fprintf(stderr,"Unable to open %s for writing\n",path);
+		return FALSE;
+	}
+	if(fwrite(b->data,1,b->length,f)!=b->length)
+	{
+		fprintf(stderr,"Error writing to %s\n",path);
+		fclose(f);
+		return FALSE;
+	}
+	fclose(f);
+	return TRUE;
+}
+
+static UINT textLength(PMODULE m)
+{
+	UINT len;
+
+	len=16*m->publics;
+	if(len<4*m->relocs) len=4*m->relocs;
+	if(!len) len=16;
+	return (len+15)&~15UL;
+}
+
+static UINT dataLength(PMODULE m)
+{
+	return 16*(m->publics?m->publics:1);
+}
+
+/* fill byte for code, so output is not all zero */
+static UCHAR codeByte(PMODULE m,UINT ofs)
+{
+	return (UCHAR)(ofs*7+m->index);
+}
+
+/* what relocation k in a module refers to */
+enum { TGT_EXT, TGT_LIB, TGT_DATA, TGT_SELF };
+
+static UINT relocTarget(PMODULE m,UINT k,UINT *num)
+{
+	switch(k%4)
+	{
+	case 0:
+		if(!m->extCount) break;
+		*num=(k/4)%m->extCount;
+		return TGT_EXT;
+	case 1:
+		if(!m->libCount) break;
+		*num=(k/4)%m->libCount;
+		return TGT_LIB;
+	case 3:
+		if(!m->extCount) break;
+		*num=(k/4)%m->extCount;
+		return TGT_SELF;
+	}
+	*num=0;
+	return TGT_DATA;
+}
+
+static PCHAR libSymbolName(PMODULE m,UINT n)
+{
+	return makeName(m->libFormat,(m->libFirst+n)%m->libModules,0);
+}
+
+/****************************************************************************/
+/* OMF */
+
+static UINT beginRecord(PBUFFER b,UINT type)
+{
+	put8(b,type);
+	put16(b,0);
+	return b->length-3;
+}
+
+static void endRecord(PBUFFER b,UINT start)
+{
+	UINT i;
+	UCHAR sum=0;
+
+	set16(b,start+1,b->length-start-3+1);
+	for(i=start;i<b->length;++i)
+	{
+		sum+=b->data[i];
+	}
+	put8(b,(0x100-sum)&0xff);
+}
+
+static void putIndex(PBUFFER b,UINT i)
+{
+	if(i<0x80)
+	{
+		put8(b,i);
+	}
+	else
+	{
+		put8(b,0x80|(i>>8));
+		put8(b,i);
+	}
+}
+
+static void putName(PBUFFER b,PCHAR name)
+{
+	UINT len=strlen(name);
+
+	put8(b,len);
+	putBytes(b,name,len);
+}
+
+static void putOMFNames(PBUFFER b,UINT type,PPCHAR names,UINT count,BOOL typeIndex)
+{
+	UINT i,rec;
+
+	for(i=0;i<count;)
+	{
+		rec=beginRecord(b,type);
+		for(;(i<count) && (b->length-rec<OMF_RECMAX);++i)
+		{
+			putName(b,names[i]);
+			if(typeIndex) put8(b,0);
+		}
+		endRecord(b,rec);
+	}
+}
+
+static void writeOMFModule(PBUFFER b,PMODULE m)
+{
+	UINT i,j,k,n,rec,len,chunk;
+	UINT target;
+	PCHAR name;
+	PPCHAR names;
+	UINT count;
+
+	rec=beginRecord(b,THEADR);
+	name=makeName(m->pubFormat,m->index,0);
+	putName(b,name+1);
+	free(name);
+	endRecord(b,rec);
+
+	/* segment, class and COMDAT names */
+	count=4+m->comdats;
+	names=checkMalloc(count*sizeof(PCHAR));
+	names[0]="_TEXT";
+	names[1]="CODE";
+	names[2]="_DATA";
+	names[3]="DATA";
+	for(i=0;i<m->comdats;++i)
+	{
+		names[4+i]=makeName("_inl%lu",i,0);
+	}
+	rec=beginRecord(b,LNAMES);
+	put8(b,0); /* blank name, index 1 */
+	endRecord(b,rec);
+	putOMFNames(b,LNAMES,names,count,FALSE);
+	for(i=0;i<m->comdats;++i)
+	{
+		free(names[4+i]);
+	}
+	free(names);
+
+	/* _TEXT is segment 1, _DATA segment 2, both public para-aligned use32 */
+	rec=beginRecord(b,SEGDEF32);
+	put8(b,0x69);
+	put32(b,textLength(m));
+	putIndex(b,2);
+	putIndex(b,3);
+	putIndex(b,1);
+	endRecord(b,rec);
+	rec=beginRecord(b,SEGDEF32);
+	put8(b,0x69);
+	put32(b,dataLength(m));
+	putIndex(b,4);
+	putIndex(b,5);
+	putIndex(b,1);
+	endRecord(b,rec);
+
+	/* externs, next module's publics first then library symbols */
+	count=m->extCount+m->libCount;
+	if(count)
+	{
+		names=checkMalloc(count*sizeof(PCHAR));
+		for(i=0;i<m->extCount;++i)
+		{
+			names[i]=makeName(m->pubFormat,m->extIndex,i);
+		}
+		for(i=0;i<m->libCount;++i)
+		{
+			names[m->extCount+i]=libSymbolName(m,i);
+		}
+		putOMFNames(b,EXTDEF,names,count,TRUE);
+		for(i=0;i<count;++i)
+		{
+			free(names[i]);
+		}
+		free(names);
+	}
+
+	/* publics, 16 bytes apart in _TEXT */
+	for(i=0;i<m->publics;)
+	{
+		rec=beginRecord(b,PUBDEF32);
+		putIndex(b,0);
+		putIndex(b,1);
+		for(;(i<m->publics) && (b->length-rec<OMF_RECMAX);++i)
+		{
+			name=makeName(m->pubFormat,m->index,i);
+			putName(b,name);
+			free(name);
+			put32(b,16*i);
+			putIndex(b,0);
+		}
+		endRecord(b,rec);
+	}
+
+	/* code, in chunks, each followed by the fixups that land in it */
+	len=textLength(m);
+	for(i=0;i<len;i+=OMF_CHUNK)
+	{
+		chunk=(len-i<OMF_CHUNK)?len-i:OMF_CHUNK;
+		rec=beginRecord(b,LEDATA32);
+		putIndex(b,1);
+		put32(b,i);
+		for(j=0;j<chunk;++j)
+		{
+			k=(i+j)/4;
+			put8(b,(k<m->relocs)?0:codeByte(m,i+j));
+		}
+		endRecord(b,rec);
+
+		if(i/4>=m->relocs) continue;
+		rec=beginRecord(b,FIXUPP32);
+		for(k=i/4;(k<m->relocs) && (4*k<i+chunk);++k)
+		{
+			j=4*k-i;
+			target=relocTarget(m,k,&n);
+			/* locat: fixup, 32-bit offset, segment relative unless self-relative */
+			put8(b,0x80|((target==TGT_SELF)?0:0x40)|(9<<2)|(j>>8));
+			put8(b,j);
+			switch(target)
+			{
+			case TGT_EXT:
+			case TGT_SELF:
+				put8(b,0x56); /* frame=target, target=extern, no disp */
+				putIndex(b,n+1);
+				break;
+			case TGT_LIB:
+				put8(b,0x56);
+				putIndex(b,m->extCount+n+1);
+				break;
+			default:
+				put8(b,0x54); /* frame=target, target=segment, no disp */
+				putIndex(b,2);
+				break;
+			}
+		}
+		endRecord(b,rec);
+	}
+
+	/* data */
+	len=dataLength(m);
+	for(i=0;i<len;i+=OMF_CHUNK)
+	{
+		chunk=(len-i<OMF_CHUNK)?len-i:OMF_CHUNK;
+		rec=beginRecord(b,LEDATA32);
+		putIndex(b,2);
+		put32(b,i);
+		for(j=0;j<chunk;++j)
+		{
+			put8(b,i+j);
+		}
+		endRecord(b,rec);
+	}
+
+	/* COMDATs shared by every module, pick any, allocated in CODE32 */
+	for(i=0;i<m->comdats;++i)
+	{
+		rec=beginRecord(b,COMDAT32);
+		put8(b,0);
+		put8(b,0x13);
+		put8(b,0);
+		put32(b,0);
+		putIndex(b,0);
+		putIndex(b,6+i);
+		for(j=0;j<16;++j)
+		{
+			put8(b,0xc3);
+		}
+		endRecord(b,rec);
+	}
+
+	rec=beginRecord(b,MODEND32);
+	if(m->start)
+	{
+		/* main module with start address at _TEXT:0 */
+		put8(b,0xc1);
+		put8(b,0x04);
+		putIndex(b,1);
+		putIndex(b,1);
+	}
+	else
+	{
+		put8(b,0);
+	}
+	endRecord(b,rec);
+}
+
+/* library dictionary hash, as specified for OMF libraries */
+static void omfHash(PCHAR name,UINT blocks,UINT *blockIndex,UINT *blockDelta,UINT *bucketIndex,UINT *bucketDelta)
+{
+	UINT len=strlen(name);
+	PUCHAR pb=(PUCHAR)name-1,pe=(PUCHAR)name+len-1;
+	USHORT bx,bd,kx,kd,c;
+
+	bx=len|0x20;
+	kd=len|0x20;
+	bd=0;
+	kx=0;
+	while(TRUE)
+	{
+		c=*pe--|0x20;
+		kx=((kx>>2)|(kx<<14))^c;
+		bd=((bd<<2)|(bd>>14))^c;
+		if(!--len) break;
+		c=*++pb|0x20;
+		bx=((bx<<2)|(bx>>14))^c;
+		kd=((kd>>2)|(kd<<14))^c;
+	}
+	*blockIndex=bx%blocks;
+	*blockDelta=bd%blocks;
+	if(!*blockDelta) *blockDelta=1;
+	*bucketIndex=kx%OMF_DICBUCKETS;
+	*bucketDelta=kd%OMF_DICBUCKETS;
+	if(!*bucketDelta) *bucketDelta=1;
+}
+
+static BOOL isPrime(UINT n)
+{
+	UINT i;
+
+	if(n<2) return FALSE;
+	for(i=2;i*i<=n;++i)
+	{
+		if(!(n%i)) return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL dictionaryInsert(PUCHAR dic,UINT blocks,PCHAR name,UINT page)
+{
+	UINT bx,bd,kx,kd;
+	UINT i,j,k,len,size;
+	PUCHAR blk;
+
+	omfHash(name,blocks,&bx,&bd,&kx,&kd);
+	len=strlen(name);
+	size=(len+4)&~1UL;
+	for(i=0;i<blocks;++i,bx=(bx+bd)%blocks)
+	{
+		blk=dic+512*bx;
+		for(j=0,k=kx;j<OMF_DICBUCKETS;++j,k=(k+kd)%OMF_DICBUCKETS)
+		{
+			if(blk[k]) continue;
+			if((blk[OMF_DICBUCKETS]==0xff) || (2*blk[OMF_DICBUCKETS]+size>512))
+			{
+				blk[OMF_DICBUCKETS]=0xff; /* block full */
+				break;
+			}
+			blk[k]=blk[OMF_DICBUCKETS];
+			blk+=2*blk[k];
+			blk[0]=len;
+			memcpy(blk+1,name,len);
+			blk[len+1]=page&0xff;
+			blk[len+2]=(page>>8)&0xff;
+			dic[512*bx+OMF_DICBUCKETS]+=size/2;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static BOOL writeOMFLibrary(PCHAR name,PMEMBER members,UINT count)
+{
+	BUFFER b={NULL,0,0};
+	PUCHAR dic=NULL;
+	UINT pageSize,blocks,total,entries;
+	UINT i,j,rec;
+	UINT *pages;
+	BOOL ok;
+
+	/* pick a page size that keeps module numbers in 16 bits */
+	for(pageSize=16;pageSize<32768;pageSize*=2)
+	{
+		total=1;
+		for(i=0;i<count;++i)
+		{
+			total+=(members[i].data.length+pageSize-1)/pageSize;
+		}
+		if(total<0x10000) break;
+	}
+
+	rec=beginRecord(&b,LIBHDR);
+	put32(&b,0);	/* dictionary offset, filled in later */
+	put16(&b,0);	/* dictionary blocks */
+	put8(&b,LIBF_CASESENSITIVE);
+	putFill(&b,0,pageSize-b.length-1);
+	endRecord(&b,rec);
+
+	pages=checkMalloc((count+1)*sizeof(UINT));
+	entries=0;
+	for(i=0;i<count;++i)
+	{
+		pages[i]=b.length/pageSize;
+		putBytes(&b,members[i].data.data,members[i].data.length);
+		putFill(&b,0,(pageSize-b.length%pageSize)%pageSize);
+		for(j=0;j<members[i].symCount;++j)
+		{
+			entries+=(strlen(members[i].syms[j])+4)&~1UL;
+		}
+	}
+
+	/* end record pads to a dictionary block boundary */
+	rec=beginRecord(&b,LIBEND);
+	j=(512-(b.length+1)%512)%512;
+	putFill(&b,0,j);
+	endRecord(&b,rec);
+
+	/* size dictionary with some slack, growing it if hashing fails to place everything */
+	for(blocks=entries/(512-OMF_DICBUCKETS-1)*4/3+1;;++blocks)
+	{
+		if(!isPrime(blocks)) continue;
+		if(blocks>0xffff)
+		{
+			fprintf(stderr,"Too many symbols for OMF library dictionary\n");
+			return FALSE;
+		}
+		dic=checkRealloc(dic,512*blocks);
+		memset(dic,0,512*blocks);
+		for(i=0;i<blocks;++i)
+		{
+			dic[512*i+OMF_DICBUCKETS]=(OMF_DICBUCKETS+1)/2;
+		}
+		ok=TRUE;
+		for(i=0;ok && (i<count);++i)
+		{
+			for(j=0;ok && (j<members[i].symCount);++j)
+			{
+				ok=dictionaryInsert(dic,blocks,members[i].syms[j],pages[i]);
+			}
+		}
+		if(ok) break;
+	}
+
+	set32(&b,3,b.length);
+	set16(&b,7,blocks);
+	/* redo header checksum */
+	b.data[pageSize-1]=0;
+	for(i=0,j=0;i<pageSize-1;++i)
+	{
+		j+=b.data[i];
+	}
+	b.data[pageSize-1]=(0x100-j)&0xff;
+	putBytes(&b,dic,512*blocks);
+
+	ok=writeFile(name,&b);
+	free(dic);
+	free(pages);
+	free(b.data);
+	return ok;
+}
+
+/****************************************************************************/
+/* MS-COFF */
+
+struct coffsym
+{
+	PCHAR name;
+	UINT value;
+	INT section;
+	UINT class;
+	BOOL aux;
+	UINT auxLength;
+	UINT auxRelocs;
+	UINT auxNumber;
+	UINT auxSelect;
+};
+
+typedef struct coffsym COFFSYM,*PCOFFSYM;
+
+static void putCOFFName(PBUFFER b,PBUFFER strtab,PCHAR name)
+{
+	UINT len=strlen(name);
+
+	if(len<=8)
+	{
+		putBytes(b,name,len);
+		putFill(b,0,8-len);
+		return;
+	}
+	put32(b,0);
+	put32(b,strtab->length+4);
+	putBytes(strtab,name,len+1);
+}
+
+static void writeCOFFModule(PBUFFER b,PMODULE m)
+{
+	BUFFER strtab={NULL,0,0};
+	PCOFFSYM syms;
+	UINT symCount,sectCount,nrel,textLen,dataLen;
+	UINT i,j,k,n,target,pos,firstExt,firstLib;
+
+	textLen=textLength(m);
+	dataLen=dataLength(m);
+	nrel=(m->relocs<COFF_MAXRELOCS)?m->relocs:COFF_MAXRELOCS;
+	sectCount=2+m->comdats;
+
+	/* section symbols, COMDAT symbols, publics, then externs */
+	syms=checkMalloc((2+2*m->comdats+m->publics+m->extCount+m->libCount)*sizeof(COFFSYM));
+	symCount=0;
+	for(i=0;i<sectCount;++i)
+	{
+		memset(syms+symCount,0,sizeof(COFFSYM));
+		syms[symCount].name=(i==0)?".text":(i==1)?".data":".text$i";
+		syms[symCount].section=i+1;
+		syms[symCount].class=COFF_STATIC;
+		syms[symCount].aux=TRUE;
+		syms[symCount].auxLength=(i==0)?textLen:(i==1)?dataLen:16;
+		syms[symCount].auxRelocs=(i==0)?nrel:0;
+		syms[symCount].auxSelect=(i>=2)?COFF_PICKANY:0;
+		symCount++;
+		if(i<2) continue;
+		memset(syms+symCount,0,sizeof(COFFSYM));
+		syms[symCount].name=makeName("_inl%lu",i-2,0);
+		syms[symCount].section=i+1;
+		syms[symCount].class=COFF_EXTERNAL;
+		symCount++;
+	}
+	for(i=0;i<m->publics;++i,++symCount)
+	{
+		memset(syms+symCount,0,sizeof(COFFSYM));
+		syms[symCount].name=makeName(m->pubFormat,m->index,i);
+		syms[symCount].value=16*i;
+		syms[symCount].section=1;
+		syms[symCount].class=COFF_EXTERNAL;
+	}
+	firstExt=symCount;
+	for(i=0;i<m->extCount;++i,++symCount)
+	{
+		memset(syms+symCount,0,sizeof(COFFSYM));
+		syms[symCount].name=makeName(m->pubFormat,m->extIndex,i);
+		syms[symCount].class=COFF_EXTERNAL;
+	}
+	firstLib=symCount;
+	for(i=0;i<m->libCount;++i,++symCount)
+	{
+		memset(syms+symCount,0,sizeof(COFFSYM));
+		syms[symCount].name=libSymbolName(m,i);
+		syms[symCount].class=COFF_EXTERNAL;
+	}
+	/* table indices allow for the aux records of the section symbols */
+	firstExt+=sectCount;
+	firstLib+=sectCount;
+
+	/* file header, symbol pointer filled in later */
+	put16(b,COFF_I386);
+	put16(b,sectCount);
+	put32(b,0);
+	put32(b,0);
+	put32(b,0);
+	for(i=0,n=0;i<symCount;++i)
+	{
+		n+=syms[i].aux?2:1;
+	}
+	set32(b,12,n);
+	put16(b,0);
+	put16(b,0);
+
+	/* section headers, raw data follows straight after */
+	pos=20+40*sectCount;
+	for(i=0;i<sectCount;++i)
+	{
+		putCOFFName(b,&strtab,syms[(i<2)?i:2+2*(i-2)].name);
+		put32(b,0);
+		put32(b,0);
+		j=(i==0)?textLen:(i==1)?dataLen:16;
+		put32(b,j);
+		put32(b,pos);
+		pos+=j;
+		put32(b,(i==0)?pos:0);
+		put32(b,0);
+		put16(b,(i==0)?nrel:0);
+		put16(b,0);
+		put32(b,(i==1)?COFF_DATA:(i==0)?COFF_TEXT:(COFF_TEXT|COFF_COMDAT));
+		if(i==0) pos+=10*nrel;
+	}
+
+	/* .text, relocations */
+	for(i=0;i<textLen;++i)
+	{
+		put8(b,(i/4<nrel)?0:codeByte(m,i));
+	}
+	for(k=0;k<nrel;++k)
+	{
+		put32(b,4*k);
+		target=relocTarget(m,k,&n);
+		switch(target)
+		{
+		case TGT_EXT:
+			put32(b,firstExt+n);
+			put16(b,COFF_DIR32);
+			break;
+		case TGT_SELF:
+			put32(b,firstExt+n);
+			put16(b,COFF_REL32);
+			break;
+		case TGT_LIB:
+			put32(b,firstLib+n);
+			put16(b,COFF_DIR32);
+			break;
+		default:
+			put32(b,2); /* .data section symbol */
+			put16(b,COFF_DIR32);
+			break;
+		}
+	}
+	/* .data */
+	for(i=0;i<dataLen;++i)
+	{
+		put8(b,i);
+	}
+	/* COMDATs */
+	for(i=0;i<m->comdats;++i)
+	{
+		putFill(b,0xc3,16);
+	}
+
+	/* symbol table, then string table */
+	set32(b,8,b->length);
+	for(i=0;i<symCount;++i)
+	{
+		putCOFFName(b,&strtab,syms[i].name);
+		put32(b,syms[i].value);
+		put16(b,syms[i].section);
+		put16(b,0);
+		put8(b,syms[i].class);
+		put8(b,syms[i].aux?1:0);
+		if(syms[i].aux)
+		{
+			put32(b,syms[i].auxLength);
+			put16(b,syms[i].auxRelocs);
+			put16(b,0);
+			put32(b,0);
+			put16(b,syms[i].auxNumber);
+			put8(b,syms[i].auxSelect);
+			putFill(b,0,3);
+		}
+	}
+	put32(b,strtab.length+4);
+	putBytes(b,strtab.data,strtab.length);
+
+	for(i=0;i<symCount;++i)
+	{
+		if(syms[i].class==COFF_EXTERNAL) free(syms[i].name);
+	}
+	free(syms);
+	free(strtab.data);
+}
+
+static void putArchiveHeader(PBUFFER b,PCHAR name,UINT size)
+{
+	char buf[61];
+
+	sprintf(buf,"%-16s%-12s%-6s%-6s%-8s%-10lu`\n",name,"0","","","0",size);
+	putBytes(b,buf,60);
+}
+
+struct archsym
+{
+	PCHAR name;
+	UINT member;
+};
+
+typedef struct archsym ARCHSYM,*PARCHSYM;
+
+static int archSymCompare(const void *x1,const void *x2)
+{
+	return strcmp(((PARCHSYM)x1)->name,((PARCHSYM)x2)->name);
+}
+
+static BOOL writeCOFFLibrary(PCHAR name,PMEMBER members,UINT count)
+{
+	BUFFER b={NULL,0,0};
+	PARCHSYM syms;
+	UINT *offsets;
+	UINT symCount,firstSize,secondSize,names;
+	UINT i,j,pos;
+	char memberName[32];
+	BOOL ok;
+
+	for(i=0,symCount=0,names=0;i<count;++i)
+	{
+		for(j=0;j<members[i].symCount;++j)
+		{
+			names+=strlen(members[i].syms[j])+1;
+		}
+		symCount+=members[i].symCount;
+	}
+	syms=checkMalloc((symCount+1)*sizeof(ARCHSYM));
+	for(i=0,symCount=0;i<count;++i)
+	{
+		for(j=0;j<members[i].symCount;++j,++symCount)
+		{
+			syms[symCount].name=members[i].syms[j];
+			syms[symCount].member=i;
+		}
+	}
+
+	/* member offsets, after both linker members */
+	firstSize=4+4*symCount+names;
+	secondSize=4+4*count+4+2*symCount+names;
+	pos=8+60+firstSize;
+	pos+=pos&1;
+	pos+=60+secondSize;
+	pos+=pos&1;
+	offsets=checkMalloc((count+1)*sizeof(UINT));
+	for(i=0;i<count;++i)
+	{
+		offsets[i]=pos;
+		pos+=60+members[i].data.length;
+		pos+=pos&1;
+	}
+
+	putBytes(&b,"!<arch>\n",8);
+	/* first linker member, symbols in member order, big-endian */
+	putArchiveHeader(&b,"/",firstSize);
+	put32BE(&b,symCount);
+	for(i=0;i<symCount;++i)
+	{
+		put32BE(&b,offsets[syms[i].member]);
+	}
+	for(i=0;i<symCount;++i)
+	{
+		putBytes(&b,syms[i].name,strlen(syms[i].name)+1);
+	}
+	if(b.length&1) put8(&b,'\n');
+
+	/* second linker member, symbols sorted, little-endian */
+	qsort(syms,symCount,sizeof(ARCHSYM),archSymCompare);
+	putArchiveHeader(&b,"/",secondSize);
+	put32(&b,count);
+	for(i=0;i<count;++i)
+	{
+		put32(&b,offsets[i]);
+	}
+	put32(&b,symCount);
+	for(i=0;i<symCount;++i)
+	{
+		put16(&b,syms[i].member+1);
+	}
+	for(i=0;i<symCount;++i)
+	{
+		putBytes(&b,syms[i].name,strlen(syms[i].name)+1);
+	}
+	if(b.length&1) put8(&b,'\n');
+
+	for(i=0;i<count;++i)
+	{
+		sprintf(memberName,"k%lu.obj/",i);
+		putArchiveHeader(&b,memberName,members[i].data.length);
+		putBytes(&b,members[i].data.data,members[i].data.length);
+		if(b.length&1) put8(&b,'\n');
+	}
+
+	ok=writeFile(name,&b);
+	free(offsets);
+	free(syms);
+	free(b.data);
+	return ok;
+}
+
+/****************************************************************************/
+/* resources */
+
+static BOOL writeResources(PCHAR name)
+{
+	BUFFER b={NULL,0,0};
+	UINT i,len;
+	BOOL ok;
+
+	/* empty entry marking a 32-bit resource file */
+	put32(&b,0);
+	put32(&b,0x20);
+	put16(&b,0xffff);
+	put16(&b,0);
+	put16(&b,0xffff);
+	put16(&b,0);
+	putFill(&b,0,16);
+
+	for(i=0;i<resources;++i)
+	{
+		len=64+(i%64);
+		put32(&b,len);
+		put32(&b,0x20);
+		put16(&b,0xffff);
+		put16(&b,10);	/* RT_RCDATA */
+		put16(&b,0xffff);
+		put16(&b,i+1);
+		put32(&b,0);
+		put16(&b,0x30);
+		put16(&b,0x409);
+		put32(&b,0);
+		put32(&b,0);
+		putFill(&b,i,len);
+		putFill(&b,0,(4-len%4)%4);
+	}
+
+	ok=writeFile(name,&b);
+	free(b.data);
+	return ok;
+}
+
+/****************************************************************************/
+
+static void setModule(PMODULE m,PCHAR pubFormat,UINT index,UINT count,UINT publics,UINT relocCount)
+{
+	memset(m,0,sizeof(MODULE));
+	m->pubFormat=pubFormat;
+	m->index=index;
+	m->publics=publics;
+	m->relocs=relocCount;
+	m->extIndex=(index+1)%count;
+	m->extCount=(publics<relocCount/4+1)?publics:relocCount/4+1;
+}
+
+/* objects reference enough library modules between them to pull in the whole library */
+static void setLibRefs(PMODULE m,PCHAR libFormat)
+{
+	UINT per;
+
+	if(!libModules) return;
+	per=(libModules+modules-1)/modules;
+	m->libFormat=libFormat;
+	m->libFirst=m->index*per;
+	m->libCount=per;
+	m->libModules=libModules;
+}
+
+static BOOL writeLibrary(PCHAR name,PCHAR pubFormat,BOOL coff)
+{
+	PMEMBER members;
+	MODULE m;
+	UINT i,j;
+	BOOL ok;
+
+	members=checkMalloc((libModules+1)*sizeof(MEMBER));
+	for(i=0;i<libModules;++i)
+	{
+		setModule(&m,pubFormat,i,libModules,libSymbols,4*libSymbols);
+		memset(&members[i].data,0,sizeof(BUFFER));
+		if(coff)
+			writeCOFFModule(&members[i].data,&m);
+		else
+			writeOMFModule(&members[i].data,&m);
+		members[i].symCount=libSymbols;
+		members[i].syms=checkMalloc((libSymbols+1)*sizeof(PCHAR));
+		for(j=0;j<libSymbols;++j)
+		{
+			members[i].syms[j]=makeName(pubFormat,i,j);
+		}
+	}
+	if(coff)
+		ok=writeCOFFLibrary(name,members,libModules);
+	else
+		ok=writeOMFLibrary(name,members,libModules);
+	for(i=0;i<libModules;++i)
+	{
+		for(j=0;j<libSymbols;++j)
+		{
+			free(members[i].syms[j]);
+		}
+		free(members[i].syms);
+		free(members[i].data.data);
+	}
+	free(members);
+	return ok;
+}
+
+static BOOL writeObjects(PCHAR nameFormat,PCHAR pubFormat,PCHAR libFormat,PCHAR libName,PCHAR rspName,BOOL coff)
+{
+	BUFFER b={NULL,0,0};
+	BUFFER rsp={NULL,0,0};
+	MODULE m;
+	UINT i;
+	char name[64];
+
+	for(i=0;i<modules;++i)
+	{
+		setModule(&m,pubFormat,i,modules,symbols,relocs);
+		setLibRefs(&m,libFormat);
+		m.comdats=comdats;
+		m.start=(i==0) && !coff;
+		b.length=0;
+		if(coff)
+			writeCOFFModule(&b,&m);
+		else
+			writeOMFModule(&b,&m);
+		sprintf(name,nameFormat,i);
+		if(!writeFile(name,&b)) return FALSE;
+		putBytes(&rsp,name,strlen(name));
+		put8(&rsp,'\n');
+	}
+	if(libModules)
+	{
+		putBytes(&rsp,libName,strlen(libName));
+		put8(&rsp,'\n');
+	}
+	free(b.data);
+	if(!writeFile(rspName,&rsp)) return FALSE;
+	free(rsp.data);
+	return TRUE;
+}
+
+static BOOL getNumber(PCHAR arg,PCHAR value,UINT *result)
+{
+	PCHAR end;
+
+	if(!value)
+	{
+		fprintf(stderr,"Missing value for %s\n",arg);
+		return FALSE;
+	}
+	*result=strtoul(value,&end,0);
+	if(*end)
+	{
+		fprintf(stderr,"Invalid value %s for %s\n",value,arg);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void usage(void)
+{
+	printf("Usage: gencorpus [options] outdir\n");
+	printf("  -modules n      object modules of each kind (%lu)\n",modules);
+	printf("  -symbols n      public symbols per module (%lu)\n",symbols);
+	printf("  -relocs n       relocations per module (%lu)\n",relocs);
+	printf("  -libmodules n   modules per library (%lu)\n",libModules);
+	printf("  -libsymbols n   public symbols per library module (%lu)\n",libSymbols);
+	printf("  -comdats n      shared COMDATs per module (%lu)\n",comdats);
+	printf("  -resources n    resources in bench.res (%lu)\n",resources);
+	printf("Writes OMF objects m*.obj with omf.lib, COFF objects c*.obj with coff.lib,\n");
+	printf("bench.res, and the response files omf.rsp and coff.rsp listing them.\n");
+}
+
+int main(int argc,char *argv[])
+{
+	int i;
+	BOOL ok=TRUE;
+
+	for(i=1;ok && (i<argc);++i)
+	{
+		if(argv[i][0]!='-')
+		{
+			outDir=argv[i];
+			continue;
+		}
+		if(!strcmp(argv[i],"-modules"))
+			ok=getNumber(argv[i],argv[i+1],&modules);
+		else if(!strcmp(argv[i],"-symbols"))
+			ok=getNumber(argv[i],argv[i+1],&symbols);
+		else if(!strcmp(argv[i],"-relocs"))
+			ok=getNumber(argv[i],argv[i+1],&relocs);
+		else if(!strcmp(argv[i],"-libmodules"))
+			ok=getNumber(argv[i],argv[i+1],&libModules);
+		else if(!strcmp(argv[i],"-libsymbols"))
+			ok=getNumber(argv[i],argv[i+1],&libSymbols);
+		else if(!strcmp(argv[i],"-comdats"))
+			ok=getNumber(argv[i],argv[i+1],&comdats);
+		else if(!strcmp(argv[i],"-resources"))
+			ok=getNumber(argv[i],argv[i+1],&resources);
+		else
+		{
+			usage();
+			return 1;
+		}
+		++i;
+	}
+	if(!ok) return 1;
+	if(!modules)
+	{
+		fprintf(stderr,"At least one module is required\n");
+		return 1;
+	}
+
+	printf("Generating %lu modules x %lu symbols, %lu relocations, %lu library modules in %s\n",
+	       modules,symbols,relocs,libModules,outDir);
+	ok=writeObjects("m%05lu.obj","_m%lu_%lu","_l%lu_%lu","omf.lib","omf.rsp",FALSE)
+		&& writeObjects("c%05lu.obj","_c%lu_%lu","_k%lu_%lu","coff.lib","coff.rsp",TRUE)
+		&& (!libModules || writeLibrary("omf.lib","_l%lu_%lu",FALSE))
+		&& (!libModules || writeLibrary("coff.lib","_k%lu_%lu",TRUE))
+		&& writeResources("bench.res");
+
+	return ok?0:1;
+}
@@ -0,0 +1,352 @@
+/* micro-benchmarks driving alink's core data structure operations directly */
+
+/* pull in the linker itself, without its entry point */
+#define main alinkMain
+#include "alink.c"
+#undef main
+
+#define DEFAULT_COUNT 100000
+
+typedef void (*PBENCHFUNC)(UINT n);
+
+struct bench
+{
+	PCHAR name;
+	PBENCHFUNC func;
+	PCHAR desc;
+};
+
+typedef struct bench BENCH,*PBENCH;
+
+static clock_t benchStart;
+static PMODULE benchModule=NULL;
+
+static void startClock(void)
+{
+	benchStart=clock();
+}
+
+static void stopClock(PCHAR name,UINT n)
+{
+	double t;
+
+	t=((double)(clock()-benchStart))/CLOCKS_PER_SEC;
+	printf("  %-28s %10lu %12.3f %12.1f\n",name,n,t*1000.0,n?t*1e9/n:0.0);
+}
+
+/* distinct names in a scrambled order, multiplying by an odd constant is a bijection */
+static void symbolName(PCHAR buf,UINT i)
+{
+	sprintf(buf,"sym%08lX",(i*2654435761UL)&0xffffffffUL);
+}
+
+static PSEG benchSection(PCHAR name)
+{
+	PSEG s;
+
+	s=createSection(name,"DATA",NULL,benchModule,0,1);
+	s->use32=TRUE;
+	s->initdata=s->read=s->write=TRUE;
+	return s;
+}
+
+static void benchSymbols(UINT n)
+{
+	UINT i;
+	PPCHAR names;
+	char buf[32];
+	PSEG s;
+
+	s=benchSection("SYMS");
+	names=checkMalloc(n*sizeof(PCHAR));
+	for(i=0;i<n;++i)
+	{
+		symbolName(buf,i);
+		names[i]=checkStrdup(buf);
+	}
+
+	startClock();
+	for(i=0;i<n;++i)
+	{
+		addGlobalSymbol(createSymbol(names[i],PUB_PUBLIC,benchModule,s,i,-1,-1));
+	}
+	stopClock("addGlobalSymbol",n);
+
+	startClock();
+	for(i=0;i<n;++i)
+	{
+		if(!findSymbol(names[i])) addError("Symbol %s not found",names[i]);
+	}
+	stopClock("findSymbol (hit)",n);
+
+	startClock();
+	for(i=0;i<n;++i)
+	{
+		sprintf(buf,"missing%08lX",i);
+		if(findSymbol(buf)) addError("Symbol %s found",buf);
+	}
+	stopClock("findSymbol (miss)",n);
+
+	checkFree(names);
+}
+
+static void benchAddData(UINT n)
+{
+	UINT i;
+	PSEG s;
+	UCHAR buf[16];
+
+	memset(buf,0x90,sizeof(buf));
+	s=benchSection("ADDDATA");
+	startClock();
+	for(i=0;i<n;++i)
+	{
+		addData(s,createDataBlock(buf,0,sizeof(buf),4));
+	}
+	stopClock("addData",n);
+}
+
+static void benchAddFixedData(UINT n)
+{
+	UINT i;
+	PSEG s;
+	UCHAR buf[16];
+
+	memset(buf,0x90,sizeof(buf));
+	s=benchSection("FIXED");
+	startClock();
+	for(i=0;i<n;++i)
+	{
+		addFixedData(s,createDataBlock(buf,i*sizeof(buf),sizeof(buf),1));
+	}
+	stopClock("addFixedData (ascending)",n);
+
+	s=benchSection("FIXEDREV");
+	startClock();
+	for(i=n;i;--i)
+	{
+		addFixedData(s,createDataBlock(buf,(i-1)*sizeof(buf),sizeof(buf),1));
+	}
+	stopClock("addFixedData (descending)",n);
+}
+
+static void benchAddSeg(UINT n)
+{
+	UINT i;
+	PSEG s,c;
+
+	s=benchSection("PARENT");
+	startClock();
+	for(i=0;i<n;++i)
+	{
+		c=benchSection("CHILD");
+		c->length=16;
+		c->align=4;
+		addSeg(s,c);
+	}
+	stopClock("addSeg",n);
+}
+
+/* n 32-bit fixups spread over 256-byte data blocks */
+static void benchFixups(UINT n)
+{
+	UINT i;
+	PSEG s,t;
+	PRELOC r;
+
+	t=benchSection("TARGET");
+	t->base=0x1000;
+	s=benchSection("FIXUPS");
+	for(i=0;i<(4*n+255)/256;++i)
+	{
+		addFixedData(s,createDataBlock(NULL,i*256,256,1));
+	}
+	s->relocs=checkMalloc(n*sizeof(RELOC));
+	s->relocCount=n;
+	for(i=0;i<n;++i)
+	{
+		r=s->relocs+i;
+		r->rtype=REL_OFS32;
+		r->base=REL_DEFAULT;
+		r->ofs=4*i;
+		r->tseg=r->fseg=t;
+		r->text=r->fext=NULL;
+		r->disp=i;
+	}
+
+	startClock();
+	performFixups(s);
+	stopClock("performFixups",n);
+}
+
+static void benchChecksum(UINT n)
+{
+	UINT i,pos;
+	PSEG s;
+	UCHAR buf[16];
+
+	for(i=0;i<sizeof(buf);++i)
+	{
+		buf[i]=i*13;
+	}
+	s=benchSection("CHECKSUM");
+	for(i=0;i<n;++i)
+	{
+		addFixedData(s,createDataBlock(buf,i*sizeof(buf),sizeof(buf),1));
+	}
+	s->fpset=TRUE;
+	pos=0;
+
+	startClock();
+	calcSegChecksum(s,&pos);
+	stopClock("calcSegChecksum",n);
+}
+
+static PLIBLOCK benchLeaf(UINT count,UINT length)
+{
+	PLIBLOCK p;
+
+	p=checkMalloc(sizeof(LIBLOCK));
+	p->count=count;
+	p->blocks=0;
+	p->dataofs=0;
+	p->length=length;
+	p->data=checkMalloc(length+1);
+	((PUCHAR)p->data)[0]=length;
+	memset(((PUCHAR)p->data)+1,0xcc,length);
+	return p;
+}
+
+static BOOL countLiBytes(PUCHAR p,UINT len,void *ctx)
+{
+	*(UINT *)ctx+=len;
+	return TRUE;
+}
+
+/* a repeat of n copies of a nested block, much as DUP() emits */
+static void benchLiData(UINT n)
+{
+	PLIBLOCK top,inner;
+	PDATABLOCK d;
+	PUCHAR buf;
+	UINT total;
+
+	inner=checkMalloc(sizeof(LIBLOCK));
+	inner->count=4;
+	inner->blocks=2;
+	inner->dataofs=0;
+	inner->data=checkMalloc(2*sizeof(PLIBLOCK));
+	((PPLIBLOCK)inner->data)[0]=benchLeaf(2,3);
+	((PPLIBLOCK)inner->data)[1]=benchLeaf(1,2);
+	inner->length=2*3+1*2;
+
+	top=checkMalloc(sizeof(LIBLOCK));
+	top->count=n;
+	top->blocks=1;
+	top->dataofs=0;
+	top->data=checkMalloc(sizeof(PLIBLOCK));
+	((PPLIBLOCK)top->data)[0]=inner;
+	top->length=inner->count*inner->length;
+
+	/* the block owns the tree from here */
+	d=createIteratedDataBlock(top,0,1);
+	if(d->length!=n*4*8) addError("Bad LIDATA length");
+
+	buf=checkMalloc(d->length);
+	startClock();
+	copyDataBlock(d,buf);
+	stopClock("copyDataBlock",n);
+	if(d->length && (buf[d->length-1]!=0xcc)) addError("Bad LIDATA expansion");
+	checkFree(buf);
+
+	total=0;
+	startClock();
+	scanDataBlock(d,countLiBytes,&total);
+	stopClock("scanDataBlock",n);
+	if(total!=d->length) addError("Bad LIDATA expansion");
+
+	freeDataBlock(d);
+}
+
+static BENCH benchList[]={
+	{"symbols",benchSymbols,"addGlobalSymbol and findSymbol"},
+	{"adddata",benchAddData,"addData"},
+	{"addfixeddata",benchAddFixedData,"addFixedData, in ascending and descending order"},
+	{"addseg",benchAddSeg,"addSeg"},
+	{"fixups",benchFixups,"performFixups"},
+	{"checksum",benchChecksum,"calcSegChecksum"},
+	{"lidata",benchLiData,"copyDataBlock and scanDataBlock on iterated data"},
+	{NULL,NULL,NULL}
+};
+
+static BOOL isSelected(PCHAR name,int argc,char *argv[])
+{
+	int i;
+	BOOL any=FALSE;
+
+	for(i=1;i<argc;++i)
+	{
+		if(!strcmp(argv[i],"-n"))
+		{
+			++i;
+			continue;
+		}
+		if(!strcmp(argv[i],name)) return TRUE;
+		any=TRUE;
+	}
+	return !any;
+}
+
+int main(int argc,char *argv[])
+{
+	UINT n=DEFAULT_COUNT;
+	UINT j;
+	int i;
+	PCHAR end;
+
+	for(i=1;i<argc;++i)
+	{
+		if(!strcmp(argv[i],"-n") && (i+1<argc))
+		{
+			n=strtoul(argv[++i],&end,0);
+			if(*end || !n)
+			{
+				fprintf(stderr,"Invalid count %s\n",argv[i]);
+				return 1;
+			}
+			continue;
+		}
+		for(j=0;benchList[j].name;++j)
+		{
+			if(!strcmp(argv[i],benchList[j].name)) break;
+		}
+		if(!benchList[j].name)
+		{
+			printf("Usage: microbench [-n count] [benchmark...]\n");
+			for(j=0;benchList[j].name;++j)
+			{
+				printf("  %-14s %s\n",benchList[j].name,benchList[j].desc);
+			}
+			return 1;
+		}
+	}
+
+	case_sensitive=TRUE;
+	benchModule=createModule("microbench");
+
+	printf("  %-28s %10s %12s %12s\n","Operation","Count","Time(ms)","ns/op");
+	for(j=0;benchList[j].name;++j)
+	{
+		if(isSelected(benchList[j].name,argc,argv))
+		{
+			benchList[j].func(n);
+		}
+	}
+
+	if(errorCount)
+	{
+		listErrors();
+		return 1;
+	}
+	return 0;
+}
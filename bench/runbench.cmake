@@ -0,0 +1,65 @@
+# link the generated benchmark corpus in each output format, recording phase times
+#
+# cmake -DALINK=path/to/alink -DBENCH_DIR=dir -P runbench.cmake
+#
+# expects the corpus from gencorpus in BENCH_DIR/corpus, writes the JSON time
+# reports to BENCH_DIR/results and the linked images to BENCH_DIR/out
+
+if(NOT ALINK OR NOT BENCH_DIR)
+	message( FATAL_ERROR "ALINK and BENCH_DIR must be set" )
+endif()
+
+set( CORPUS ${BENCH_DIR}/corpus )
+set( RESULTS ${BENCH_DIR}/results )
+set( OUT ${BENCH_DIR}/out )
+file( MAKE_DIRECTORY ${RESULTS} ${OUT} )
+
+# name, then alink arguments
+set( CASES
+	"omf-pe|-f pe @omf.rsp bench.res -o ${OUT}/omf-pe.exe"
+	"omf-exe|-f exe @omf.rsp -o ${OUT}/omf-mz.exe"
+	"omf-bin|-f bin @omf.rsp -o ${OUT}/omf.bin"
+	"coff-pe|-f pe @coff.rsp bench.res -entry _c0_0 -o ${OUT}/coff-pe.exe"
+)
+
+set( FAILED 0 )
+foreach( CASE ${CASES} )
+	string( REGEX REPLACE "\\|.*" "" NAME "${CASE}" )
+	string( REGEX REPLACE "^[^|]*\\|" "" ARGS "${CASE}" )
+	separate_arguments( ARGS )
+	set( REPORT ${RESULTS}/${NAME}.json )
+	file( REMOVE ${REPORT} )
+
+	execute_process(
+		COMMAND ${ALINK} ${ARGS} -time-report-json ${REPORT}
+		WORKING_DIRECTORY ${CORPUS}
+		RESULT_VARIABLE RESULT
+		OUTPUT_VARIABLE OUTPUT
+		ERROR_VARIABLE OUTPUT
+	)
+	if(NOT RESULT EQUAL 0 OR NOT EXISTS ${REPORT})
+		message( "${NAME}: link failed\n${OUTPUT}" )
+		set( FAILED 1 )
+	else()
+		file( READ ${REPORT} JSON )
+		message( "${NAME}:" )
+		string( REGEX MATCHALL "\"name\": \"[^\"]*\", \"depth\": [0-9]+, \"wall\": [0-9.]+" PHASES "${JSON}" )
+		foreach( PHASE ${PHASES} )
+			string( REGEX REPLACE "\"name\": \"([^\"]*)\".*" "\\1" PNAME "${PHASE}" )
+			string( REGEX REPLACE ".*\"depth\": ([0-9]+).*" "\\1" PDEPTH "${PHASE}" )
+			string( REGEX REPLACE ".*\"wall\": ([0-9.]+)" "\\1" PWALL "${PHASE}" )
+			set( INDENT "" )
+			foreach( I RANGE ${PDEPTH} )
+				set( INDENT "${INDENT}  " )
+			endforeach()
+			message( "${INDENT}${PNAME} ${PWALL}s" )
+		endforeach()
+		string( REGEX REPLACE ".*\"total\": {\"wall\": ([0-9.]+).*" "\\1" TOTAL "${JSON}" )
+		string( REGEX REPLACE ".*\"peak_rss_kb\": ([0-9]+).*" "\\1" RSS "${JSON}" )
+		message( "  total ${TOTAL}s, peak RSS ${RSS} KB" )
+	endif()
+endforeach()
+
+if(FAILED)
+	message( FATAL_ERROR "One or more benchmark links failed" )
+endif()
@@ -1,24 +1,41 @@
-#ifndef ALINK_CONFIG_H
-#define ALINK_CONFIG_H
-
-/* stricmp, strcmpi and strcasecmp are platform-dependent case-insenstive */
-/* string compare functions */
-#cmakedefine GOT_STRICMP
-#cmakedefine GOT_STRCMPI
-#cmakedefine GOT_STRCASECMP
-
-/* strdup is sometimes _strdup */
-#cmakedefine GOT_STRDUP
-#cmakedefine GOT__STRDUP
-
-/* strupr is not always available */
-#cmakedefine GOT_STRUPR
-
-/* which of snprintf and _snprintf do we have (we need one) */
-#cmakedefine GOT_SNPRINTF
-#cmakedefine GOT__SNPRINTF
-
-/* MSVC has vsnprintf but no snprintf */
-#cmakedefine GOT_VSNPRINTF
-
-#endif
+#ifndef ALINK_CONFIG_H
+#define ALINK_CONFIG_H
+
+/* stricmp, strcmpi and strcasecmp are platform-dependent case-insenstive */
+/* string compare functions */
+#cmakedefine GOT_STRICMP
+#cmakedefine GOT_STRCMPI
+#cmakedefine GOT_STRCASECMP
+
+/* strdup is sometimes _strdup */
+#cmakedefine GOT_STRDUP
+#cmakedefine GOT__STRDUP
+
+/* strupr is not always available */
+#cmakedefine GOT_STRUPR
+
+/* which of snprintf and _snprintf do we have (we need one) */
+#cmakedefine GOT_SNPRINTF
+#cmakedefine GOT__SNPRINTF
+
+/* MSVC has vsnprintf but no snprintf */
+#cmakedefine GOT_VSNPRINTF
+
+/* high resolution wall clock and peak memory use, for -time-report */
+#cmakedefine GOT_GETTIMEOFDAY
+#cmakedefine GOT_GETRUSAGE
+
+/* current directory, for recognising the same library from anywhere */
+#cmakedefine GOT_GETCWD
+
+/* link server needs fork and unix domain sockets */
+#cmakedefine GOT_FORK
+#cmakedefine GOT_SYS_UN_H
+
+/* library index files are mapped rather than read where possible */
+#cmakedefine GOT_MMAP
+
+/* sub-second file modification times, to notice quick rewrites */
+#cmakedefine GOT_ST_MTIM
+
+#endif
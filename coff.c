@@ -38,6 +38,9 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 	UINT *numlines=NULL;
 	UINT *lineofs=NULL;
 	PUCHAR lineptr;
+	PUCHAR relptr;
+	PUCHAR rel;
+	UCHAR relcount[4];
 	PCHAR sectname;
 	PCHAR sectorder;
 	PCOFFSYM sym=NULL;
@@ -349,6 +352,25 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 		base=buf[COFF_OBJECT_RAWPTR]+(buf[COFF_OBJECT_RAWPTR+1]<<8)+
 			(buf[COFF_OBJECT_RAWPTR+2]<<16)+(buf[COFF_OBJECT_RAWPTR+3]<<24);
 
+		/* a count too big for the header is in the first relocation, which counts itself */
+		if((winFlags & WINF_EXT_RELOC) && (numrel==0xffff))
+		{
+			fseek(objfile,fileStart+relofs[i],SEEK_SET);
+			if(fread(relcount,1,4,objfile)!=4)
+			{
+				addError("Invalid COFF object file %s, unable to read reloc table",mod->file);
+				return FALSE;
+			}
+			numrel=relcount[0]+(relcount[1]<<8)+(relcount[2]<<16)+((UINT)relcount[3]<<24);
+			if(!numrel)
+			{
+				addError("Invalid COFF object file %s, bad relocation count for %s",mod->file,sectname);
+				return FALSE;
+			}
+			numrel--;
+			relofs[i]+=COFF_RELOC_SIZE;
+		}
+
 		/* nopad is equivalent to align to 1 byte */
 		if(winFlags & WINF_ALIGN_NOPAD)
 		{
@@ -549,7 +571,13 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 
 		if(thisSect->length)
 		{
-			if(base)
+			if(base && (thisSect->discard || (thisSect->parent==&comdatParent)))
+			{
+				/* may well be thrown away, so only read it if kept */
+				data=createDeferredDataBlock(mod->file,fileStart+base,thisSect->length,1);
+				addFixedData(thisSect,data);
+			}
+			else if(base)
 			{
 				data=createDataBlock(NULL,0,thisSect->length,1);
 				fseek(objfile,fileStart+base,SEEK_SET);
@@ -559,6 +587,12 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 					addError("Invalid COFF object file %s, unable to read section data for %s",mod->file,sectname);
 					return FALSE;
 				}
+				/* keep zeroes only as a length, unless fixups will go there */
+				if(!numrel && isZeroData(data->data,data->length))
+				{
+					checkFree(data->data);
+					data->data=NULL;
+				}
 				addFixedData(thisSect,data);
 			}
 		}
@@ -714,16 +748,19 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 	{
 		if(!seglist[i]->relocCount) continue; /* skip seg if no relocs */
 		thisSect=seglist[i];
+		/* whole table at once, then decode each entry */
 		fseek(objfile,fileStart+relofs[i],SEEK_SET);
-		for(j=0;j<thisSect->relocCount;++j)
+		relptr=checkMalloc(thisSect->relocCount*COFF_RELOC_SIZE);
+		if(fread(relptr,COFF_RELOC_SIZE,thisSect->relocCount,objfile)!=thisSect->relocCount)
+		{
+			addError("Invalid COFF object file %s, unable to read reloc table",mod->file);
+			checkFree(relptr);
+			return FALSE;
+		}
+		for(j=0,rel=relptr;j<thisSect->relocCount;++j,rel+=COFF_RELOC_SIZE)
 		{
-			if(fread(buf,1,COFF_RELOC_SIZE,objfile)!=COFF_RELOC_SIZE)
-			{
-				addError("Invalid COFF object file %s, unable to read reloc table",mod->file);
-				return FALSE;
-			}
 			/* get address to relocate */
-			thisSect->relocs[j].ofs=buf[0]+(buf[1]<<8)+(buf[2]<<16)+(buf[3]<<24);
+			thisSect->relocs[j].ofs=rel[0]+(rel[1]<<8)+(rel[2]<<16)+(rel[3]<<24);
 			thisSect->relocs[j].ofs-=relshift[i];
 			/* get segment */
 			thisSect->relocs[j].disp=0;
@@ -734,10 +771,11 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 			thisSect->relocs[j].text=NULL;
 			thisSect->relocs[j].base=REL_ABS;
 			/* get relocation target external index */
-			k=buf[4]+(buf[5]<<8)+(buf[6]<<16)+(buf[7]<<24);
+			k=rel[4]+(rel[5]<<8)+(rel[6]<<16)+(rel[7]<<24);
 			if(k>=numSymbols)
 			{
 				addError("Invalid COFF object file %s, undefined symbol %li",mod->file,k);
+				checkFree(relptr);
 				return FALSE;
 			}
 			/* assume external reloc */
@@ -747,6 +785,7 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 				if(sym[k].section<-1)
 				{
 					addError("Cannot create a fixup against a debug information, in COFF object file %s",mod->file);
+					checkFree(relptr);
 					return FALSE;
 				}
 				/* external section? */
@@ -796,6 +835,7 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 				if(sym[k].section<-1)
 				{
 					addError("cannot relocate against a debug info symbol, in COFF object file %s",mod->file);
+					checkFree(relptr);
 					return FALSE;
 					break;
 				}
@@ -829,6 +869,7 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 					{
 						/* no, undefined symbol then */
 						addError("Undefined symbol %s, in COFF object file %s",sym[k].name,mod->file);
+						checkFree(relptr);
 						return FALSE;
 					}
 				}
@@ -850,10 +891,11 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 				break;
 			default:
 				addError("undefined symbol class 0x%02X for symbol %s, in COFF object file %s",sym[k].class,sym[k].name,mod->file);
+				checkFree(relptr);
 				return FALSE;
 			}
 			/* set relocation type */
-			switch(buf[8]+(buf[9]<<8))
+			switch(rel[8]+(rel[9]<<8))
 			{
 			case COFF_FIX_DIR32:
 				thisSect->relocs[j].rtype=REL_OFS32;
@@ -888,10 +930,12 @@ static BOOL loadcoff(PFILE objfile,PMODULE mod,BOOL isDjgpp)
 				}
 				break;
 			default:
-				addError("unsupported COFF relocation type %04X in %s",buf[8]+(buf[9]<<8),mod->file);
+				addError("unsupported COFF relocation type %04X in %s",rel[8]+(rel[9]<<8),mod->file);
+				checkFree(relptr);
 				return FALSE;
 			}
 		}
+		checkFree(relptr);
 	}
 	/* build PUBDEFs or COMDEFs for external symbols defined here that aren't COMDAT symbols. */
 	for(i=0;i<numSymbols;i++)
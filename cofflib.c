@@ -33,7 +33,7 @@ BOOL COFFLibDetect(PFILE libfile,PCHAR libname)
 	}
 	buf[16]=0;
 	/* check name of first linker member */
-	if(strcmp(buf,"/			   ")) /* 15 spaces */
+	if(strcmp(buf,"/               ")) /* 15 spaces */
 	{
 		return FALSE;
 	}
@@ -70,7 +70,7 @@ BOOL DJGPPLibLoad(PFILE libfile,PMODULE mod)
 	return COFFLibLoad(libfile,mod,TRUE);
 }
 
-static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
+PLIBINDEX COFFLibReadIndex(PFILE libfile,PCHAR file)
 {
 	UINT i,j;
 	UINT numsyms;
@@ -80,41 +80,46 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 	PUCHAR endptr;
 	PCHAR name;
 	PUCHAR modbuf;
-	PUCHAR longnames;
-	PPSYMBOL symlist;
+	PLIBINDEX idx;
 	INT x;
 	UCHAR buf[60];
 
+	idx=createLibIndex(file,LIBINDEX_COFF);
 	startPoint=ftell(libfile);
 	if(fread(buf,1,8,libfile)!=8)
 	{
-		addError("Error reading from file %s",mod->file);
-		return FALSE;
+		addError("Error reading from file %s",file);
+		freeLibIndex(idx);
+		return NULL;
 	}
 	buf[8]=0;
 	/* complain if file header is wrong */
 	if(strcmp(buf,"!<arch>\n"))
 	{
 		addError("Invalid library file format - bad file header: \"%s\"",buf);
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 	/* read archive member header */
 	if(fread(buf,1,60,libfile)!=60)
 	{
-		addError("Error reading from file %s",mod->file);
-		return FALSE;
+		addError("Error reading from file %s",file);
+		freeLibIndex(idx);
+		return NULL;
 	}
 	if((buf[58]!=0x60) || (buf[59]!='\n'))
 	{
-		addError("Invalid library file format for %s - bad member signature",mod->file);
-		return FALSE;
+		addError("Invalid library file format for %s - bad member signature",file);
+		freeLibIndex(idx);
+		return NULL;
 	}
 	buf[16]=0;
 	/* check name of first linker member */
-	if(strcmp(buf,"/			   ")) /* 15 spaces */
+	if(strcmp(buf,"/               ")) /* 15 spaces */
 	{
-		addError("Invalid library file format for %s - bad member name",mod->file);
-		return FALSE;
+		addError("Invalid library file format for %s - bad member name",file);
+		freeLibIndex(idx);
+		return NULL;
 	}
 	buf[58]=0;
 
@@ -131,12 +136,14 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 	if(errno || (*endptr))
 	{
 		addError("Invalid library file format - bad member size\n");
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 	if((memberSize<4) && memberSize)
 	{
 		addError("Invalid library file format - bad member size\n");
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 	if(!memberSize)
 	{
@@ -147,7 +154,8 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 		if(fread(buf,1,4,libfile)!=4)
 		{
 			addError("Error reading from file\n");
-			return FALSE;
+			freeLibIndex(idx);
+			return NULL;
 		}
 		numsyms=buf[3]+(buf[2]<<8)+(buf[1]<<16)+(buf[0]<<24);
 	}
@@ -157,9 +165,10 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 		if(fread(modbuf,1,4*numsyms,libfile)!=4*numsyms)
 		{
 			addError("Error reading from file\n");
-			return FALSE;
+			checkFree(modbuf);
+			freeLibIndex(idx);
+			return NULL;
 		}
-		symlist=(PPSYMBOL)checkMalloc(sizeof(PSYMBOL)*numsyms);
 	}
 	for(i=0;i<numsyms;i++)
 	{
@@ -170,7 +179,10 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 			if((x=getc(libfile))==EOF)
 			{
 				addError("Error reading from file\n");
-				return FALSE;
+				checkFree(name);
+				checkFree(modbuf);
+				freeLibIndex(idx);
+				return NULL;
 			}
 			if(!x) break;
 			name=(char*)checkRealloc(name,j+2);
@@ -180,16 +192,19 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 		if(!name)
 		{
 			addError("NULL name for symbol %li\n",i);
-			return FALSE;
+			checkFree(modbuf);
+			freeLibIndex(idx);
+			return NULL;
 		}
-		symlist[i]=createSymbol(name,PUB_LIBSYM,mod,modpage,isDjgpp?DJGPPLibModLoad:MSCOFFLibModLoad);
+		addLibIndexSymbol(idx,name,modpage);
 	}
 
 	checkFree(modbuf);
 	if(ftell(libfile)!=(startPoint+68+memberSize))
 	{
 		addError("Invalid first linker member: Pos=%08lX, should be %08lX",ftell(libfile),startPoint+68+memberSize);
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 
 	/* move to an even byte boundary in the file */
@@ -204,16 +219,18 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 	if(fread(buf,1,60,libfile)!=60)
 	{
 		addError("Error reading from file\n");
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 	if((buf[58]!=0x60) || (buf[59]!='\n'))
 	{
 		addError("Invalid library file format - bad member signature\n");
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 	buf[16]=0;
 	/* check name of second linker member */
-	if(!strcmp(buf,"/			   ")) /* 15 spaces */
+	if(!strcmp(buf,"/               ")) /* 15 spaces */
 	{
 		/* OK, so we've found it, now skip over */
 		buf[58]=0;
@@ -231,12 +248,14 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 		if(errno || (*endptr))
 		{
 			addError("Invalid library file format - bad member size\n");
-			return FALSE;
+			freeLibIndex(idx);
+			return NULL;
 		}
 		if((memberSize<8) && memberSize)
 		{
 			addError("Invalid library file format - bad member size\n");
-			return FALSE;
+			freeLibIndex(idx);
+			return NULL;
 		}
 
 		/* move over second linker member */
@@ -252,22 +271,23 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 		fseek(libfile,startPoint,SEEK_SET);
 	}
 	startPoint=ftell(libfile);
-	longnames=NULL;
 
 	/* read archive member header */
 	if(fread(buf,1,60,libfile)!=60)
 	{
 		addError("Error reading from file\n");
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 	if((buf[58]!=0x60) || (buf[59]!='\n'))
 	{
 		addError("Invalid library file format - bad 3rd member signature\n");
-		return FALSE;
+		freeLibIndex(idx);
+		return NULL;
 	}
 	buf[16]=0;
 	/* check name of long names linker member */
-	if(!strcmp(buf,"//			  ")) /* 14 spaces */
+	if(!strcmp(buf,"//              ")) /* 14 spaces */
 	{
 		buf[58]=0;
 
@@ -284,15 +304,18 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 		if(errno || (*endptr))
 		{
 			addError("Invalid library file format - bad member size\n");
-			return FALSE;
+			freeLibIndex(idx);
+			return NULL;
 		}
 		if(memberSize)
 		{
-			longnames=(PUCHAR)checkMalloc(memberSize);
-			if(fread(longnames,1,memberSize,libfile)!=memberSize)
+			idx->longnames=(PUCHAR)checkMalloc(memberSize);
+			idx->longnamesLength=memberSize;
+			if(fread(idx->longnames,1,memberSize,libfile)!=memberSize)
 			{
 				addError("Error reading from file\n");
-				return FALSE;
+				freeLibIndex(idx);
+				return NULL;
 			}
 		}
 	}
@@ -302,14 +325,18 @@ static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
 		fseek(libfile,startPoint,SEEK_SET);
 	}
 
-	mod->formatSpecificData=longnames;
-	for(i=0;i<numsyms;++i)
-	{
-		addGlobalSymbol(symlist[i]);
-	}
+	return idx;
+}
 
-	checkFree(symlist);
-	return TRUE;
+static BOOL COFFLibLoad(PFILE libfile,PMODULE mod,BOOL isDjgpp)
+{
+	PLIBINDEX idx;
+	BOOL cached,ok;
+
+	if(!(idx=getLibIndex(libfile,mod->file,LIBINDEX_COFF,COFFLibReadIndex,&cached))) return FALSE;
+	ok=useLibIndex(idx,mod,isDjgpp?DJGPPLibModLoad:MSCOFFLibModLoad);
+	if(!cached) releaseLibIndex(idx);
+	return ok;
 }
 
 static BOOL DJGPPLibModLoad(PFILE libfile,PMODULE libmod)
@@ -329,6 +356,9 @@ static BOOL COFFLibModLoad(PFILE libfile,PMODULE libmod,BOOL isDjgpp)
 	UCHAR buf[60];
 	PMODULE mod;
 	UINT i;
+	UINT end;
+
+	end=ftell(libfile)+60;
 	if(fread(buf,1,60,libfile)!=60)
 	{
 		addError("Error reading from file\n");
@@ -339,6 +369,7 @@ static BOOL COFFLibModLoad(PFILE libfile,PMODULE libmod,BOOL isDjgpp)
 		addError("Invalid library member header\n");
 		return FALSE;
 	}
+	end+=strtoul(buf+48,NULL,10);
 	buf[16]=0;
 	if(buf[0]=='/')
 	{
@@ -392,5 +423,8 @@ static BOOL COFFLibModLoad(PFILE libfile,PMODULE libmod,BOOL isDjgpp)
 		addError("Unable to find format descriptor\n");
 		return FALSE;
 	}
-	return mod->fmt->load(libfile,mod);
+	if(!mod->fmt->load(libfile,mod)) return FALSE;
+	/* leave file at end of member, so the caller can tell its extent */
+	fseek(libfile,end,SEEK_SET);
+	return TRUE;
 }
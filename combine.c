@@ -3,10 +3,14 @@
 
 static void reorderGroups(void)
 {
-	UINT i,j;
+	UINT i,j,k;
+	UINT counts[3],next[3];
 	PSEG grp;
 	UINT contentCount;
 	PCONTENT contentList;
+	UCHAR *kind;
+	PPSEG list;
+
 	for(i=0;i<globalSegCount;++i)
 	{
 		if(!globalSegs[i]) continue;
@@ -18,87 +22,136 @@ static void reorderGroups(void)
 		grp->contentList=NULL;
 		grp->length=0;
 
-		/* first add all group headers */
+		/* first all group headers, next all segments with content, */
+		/* finally all segments without content, each in original order */
+		kind=checkMalloc(contentCount+1);
+		list=checkMalloc((contentCount+1)*sizeof(PSEG));
+		counts[0]=counts[1]=counts[2]=0;
 		for(j=0;j<contentCount;++j)
 		{
 			if(contentList[j].seg->group)
-				addSeg(grp,contentList[j].seg);
-		}
-		/* next add all segments with content */
-		for(j=0;j<contentCount;++j)
-		{
-			if(contentList[j].seg->group) continue;
-			if(getInitLength(contentList[j].seg))
-				addSeg(grp,contentList[j].seg);
+				k=0;
+			else if(getInitLength(contentList[j].seg))
+				k=1;
+			else
+				k=2;
+			kind[j]=(UCHAR)k;
+			counts[k]++;
 		}
-		/* finally add all segments without content */
+		next[0]=0;
+		next[1]=counts[0];
+		next[2]=counts[0]+counts[1];
 		for(j=0;j<contentCount;++j)
 		{
-			if(contentList[j].seg->group) continue;
-			if(!getInitLength(contentList[j].seg))
-				addSeg(grp,contentList[j].seg);
+			list[next[kind[j]]++]=contentList[j].seg;
 		}
+		addSegs(grp,list,contentCount);
+		checkFree(list);
+		checkFree(kind);
+		checkFree(contentList);
 	}
 }
 
 
 static void combineGroups(void)
 {
-	UINT i,j,k,l;
+	UINT i,j,k,count,mask,h;
+	INT l,g;
+	INT *buckets,*nextName,*nextSame,*lastSame;
+	UINT *hashes;
+	PPSEG list;
 	PSEG mgrp,s;
 
 	diagnostic(DIAG_VERBOSE,"Combining Groups\n");
 
+	/* chain groups with the same name together, in list order */
+	for(mask=15;mask<globalSegCount;mask=mask*2+1);
+	buckets=checkMalloc((mask+1)*sizeof(INT));
+	for(i=0;i<=mask;++i) buckets[i]=-1;
+	nextName=checkMalloc((globalSegCount+1)*sizeof(INT));
+	nextSame=checkMalloc((globalSegCount+1)*sizeof(INT));
+	lastSame=checkMalloc((globalSegCount+1)*sizeof(INT));
+	hashes=checkMalloc((globalSegCount+1)*sizeof(UINT));
 	for(i=0;i<globalSegCount;++i)
 	{
 		if(!globalSegs[i]) continue; /* skip if entry in global seg list is empty */
 		if(!globalSegs[i]->group) continue; /* skip if not a group */
+		h=hashes[i]=hashString(HASH_INIT,globalSegs[i]->name);
+		nextSame[i]=-1;
+		for(g=buckets[h&mask];g>=0;g=nextName[g])
+		{
+			if((hashes[g]==h) && !strcmp(globalSegs[g]->name,globalSegs[i]->name)) break;
+		}
+		if(g>=0)
+		{
+			nextSame[lastSame[g]]=i;
+			lastSame[g]=i;
+			lastSame[i]=-1; /* not the first group with this name */
+			continue;
+		}
+		nextName[i]=buckets[h&mask];
+		buckets[h&mask]=i;
+		lastSame[i]=i;
+	}
+
+	for(i=0;i<globalSegCount;++i)
+	{
+		if(!globalSegs[i]) continue;
+		if(!globalSegs[i]->group) continue;
+		if((lastSame[i]<0) || (nextSame[i]<0)) continue; /* skip if not first of several */
 
-		mgrp=NULL; /* no master group yet */
-		for(j=i+1;j<globalSegCount;++j)
+		/* same name. Create master group */
+		mgrp=createDuplicateSection(globalSegs[i]);
+		mgrp->mod=NULL;
+		mgrp->group=TRUE;
+		mgrp->parent=globalSegs[i]->parent;
+		mgrp->base=globalSegs[i]->base;
+		count=0;
+		for(l=i;l>=0;l=nextSame[l]) count++;
+		list=checkMalloc(count*sizeof(PSEG));
+		count=0;
+		for(l=i;l>=0;l=nextSame[l])
 		{
-			/* search for another group */
-			if(!globalSegs[j]) continue;
-			if(!globalSegs[j]->group) continue;
-			/* OK we've found another group. Check name */
-			if(strcmp(globalSegs[i]->name,globalSegs[j]->name)) continue; /* skip if no match */
-			/* same name. Create master group if not already one */
-			if(!mgrp)
-			{
-				mgrp=createDuplicateSection(globalSegs[i]);
-				mgrp->mod=NULL;
-				mgrp->group=TRUE;
-				mgrp->parent=globalSegs[i]->parent;
-				mgrp->base=globalSegs[i]->base;
-				addSeg(mgrp,globalSegs[i]); /* add original to master */
-				globalSegs[i]=mgrp; /* replace original group with master in list */
-			}
-			addSeg(mgrp,globalSegs[j]); /* add second, third, etc. group to master */
-			globalSegs[j]=NULL; /* and remove from list */
+			list[count++]=globalSegs[l];
+			globalSegs[l]=NULL; /* remove from list */
 		}
+		addSegs(mgrp,list,count); /* add original, second, third, etc. group to master */
+		globalSegs[i]=mgrp; /* replace original group with master in list */
 
-		if(mgrp)
+		/* OK, so we got a master group. Now move segments out of sub-groups, and into master */
+		for(j=0,count=0;j<mgrp->contentCount;++j)
 		{
-			/* OK, so we got a master group. Now move segments out of sub-groups, and into master */
-			mgrp->length=0; /* no length for master yet */
-			l=mgrp->contentCount; /* get number of sub-groups */
-			for(j=0;j<l;++j)
+			count+=mgrp->contentList[j].seg->contentCount;
+		}
+		checkFree(list);
+		list=checkMalloc((count+1)*sizeof(PSEG));
+		count=0;
+		mgrp->length=0; /* no length for master yet */
+		for(j=0;j<mgrp->contentCount;++j)
+		{
+			s=mgrp->contentList[j].seg;
+			s->base=0; /* all sub-groups go at beginning */
+			s->length=0; /* and have no length */
+			for(k=0;k<s->contentCount;++k)
 			{
-				s=mgrp->contentList[j].seg;
-				s->base=0; /* all sub-groups go at beginning */
-				s->length=0; /* and have no length */
-				/* add all entries from subgroup to main group */
-				for(k=0;k<s->contentCount;++k)
-				{
-					addSeg(mgrp,s->contentList[k].seg);
-				}
-				/* remove subgroup list of entries */
-				checkFree(s->contentList);
-				s->contentList=NULL;
-				s->contentCount=0;
+				list[count++]=s->contentList[k].seg;
 			}
+			/* remove subgroup list of entries */
+			checkFree(s->contentList);
+			s->contentList=NULL;
+			s->contentCount=0;
+			s->initKnown=FALSE;
 		}
+		/* add all entries from subgroups to main group, laid out once */
+		addSegs(mgrp,list,count);
+		checkFree(list);
 	}
+
+	checkFree(buckets);
+	checkFree(nextName);
+	checkFree(nextSame);
+	checkFree(lastSame);
+	checkFree(hashes);
 }
 
 static void updateTargetNames(void)
@@ -127,10 +180,204 @@ static void updateTargetNames(void)
 	}
 }
 
+/* segments combine if they have the same key: the combine type, and */
+/* except for stack segments the target name, class and for private segments the module */
+typedef struct segkey
+{
+	PSEG seg;        /* first segment with this key */
+	PCHAR name;      /* and its target name */
+	UINT hash;
+	INT next;        /* next key in the same bucket */
+	INT firstFree;   /* ungrouped segments, in list order */
+	INT lastFree;
+	INT firstMember; /* grouped segments, in group order */
+	INT lastMember;
+	UINT group;      /* group currently being combined, plus one */
+	UINT index;      /* and index of the first segment in it */
+	PSEG master;     /* master seg created in place of it */
+} SEGKEY,*PSEGKEY;
+
+static PSEGKEY segKeys=NULL;
+static UINT segKeyCount=0;
+static INT *keyBuckets=NULL;
+static UINT keyBucketMask=0;
+static INT *freeNext=NULL;
+static UINT *memberGroup=NULL;
+static INT *memberNext=NULL;
+static UINT memberCount=0;
+
+static BOOL sameString(PCHAR a,PCHAR b)
+{
+	if(!a || !b) return a==b;
+	return !strcmp(a,b);
+}
+
+/* index of key for seg, or -1 if it doesn't combine with anything */
+static INT segKeyIndex(PSEG s,BOOL create)
+{
+	PCHAR name;
+	UINT h;
+	INT i;
+	PSEGKEY k;
+
+	if((s->combine==SEGF_PRIVATE) && !s->mod) return -1; /* global private segs are never combined */
+
+	name=NULL;
+	h=hashValue(HASH_INIT,s->combine);
+	if(s->combine!=SEGF_STACK)
+	{
+		if(s->name) name=lookupTargetName(s->name);
+		h=hashValue(h,name!=NULL);
+		if(name) h=hashString(h,name);
+		h=hashValue(h,s->class!=NULL);
+		if(s->class) h=hashString(h,s->class);
+		if(s->combine==SEGF_PRIVATE) h=hashBytes(h,(PUCHAR)&s->mod,sizeof(s->mod));
+	}
+
+	for(i=keyBuckets[h&keyBucketMask];i>=0;i=k->next)
+	{
+		k=segKeys+i;
+		if(k->hash!=h) continue;
+		if(k->seg->combine!=s->combine) continue;
+		if(s->combine==SEGF_STACK) return i;
+		if(!sameString(k->name,name)) continue;
+		if(!sameString(k->seg->class,s->class)) continue;
+		if((s->combine==SEGF_PRIVATE) && (k->seg->mod!=s->mod)) continue;
+		return i;
+	}
+	if(!create) return -1;
+
+	segKeys=checkRealloc(segKeys,(segKeyCount+1)*sizeof(SEGKEY));
+	k=segKeys+segKeyCount;
+	k->seg=s;
+	k->name=name;
+	k->hash=h;
+	k->next=keyBuckets[h&keyBucketMask];
+	k->firstFree=k->lastFree=-1;
+	k->firstMember=k->lastMember=-1;
+	k->group=0;
+	k->index=0;
+	k->master=NULL;
+	keyBuckets[h&keyBucketMask]=segKeyCount;
+	return segKeyCount++;
+}
+
+/* bucket all ungrouped segments, and the segments included in groups */
+static UINT buildSegKeys(void)
+{
+	UINT i,j,count,maxContents;
+	INT k;
+	PSEG g;
+
+	count=globalSegCount;
+	maxContents=0;
+	for(i=0;i<globalSegCount;++i)
+	{
+		if(!globalSegs[i] || !globalSegs[i]->group) continue;
+		count+=globalSegs[i]->contentCount;
+		if(globalSegs[i]->contentCount>maxContents) maxContents=globalSegs[i]->contentCount;
+	}
+	for(keyBucketMask=15;keyBucketMask<count;keyBucketMask=keyBucketMask*2+1);
+	keyBuckets=checkMalloc((keyBucketMask+1)*sizeof(INT));
+	for(i=0;i<=keyBucketMask;++i) keyBuckets[i]=-1;
+	freeNext=checkMalloc((globalSegCount+1)*sizeof(INT));
+	memberGroup=checkMalloc((count+1)*sizeof(UINT));
+	memberNext=checkMalloc((count+1)*sizeof(INT));
+	segKeys=NULL;
+	segKeyCount=0;
+	memberCount=0;
+
+	for(i=0;i<globalSegCount;++i)
+	{
+		if(!globalSegs[i]) continue;
+		if(globalSegs[i]->group)
+		{
+			g=globalSegs[i];
+			for(j=0;j<g->contentCount;++j)
+			{
+				if(g->contentList[j].seg->group) continue; /* skip included groups */
+				k=segKeyIndex(g->contentList[j].seg,TRUE);
+				if(k<0) continue;
+				memberGroup[memberCount]=i;
+				memberNext[memberCount]=-1;
+				if(segKeys[k].lastMember>=0)
+					memberNext[segKeys[k].lastMember]=memberCount;
+				else
+					segKeys[k].firstMember=memberCount;
+				segKeys[k].lastMember=memberCount++;
+			}
+		}
+		else
+		{
+			k=segKeyIndex(globalSegs[i],TRUE);
+			if(k<0) continue;
+			freeNext[i]=-1;
+			if(segKeys[k].lastFree>=0)
+				freeNext[segKeys[k].lastFree]=i;
+			else
+				segKeys[k].firstFree=i;
+			segKeys[k].lastFree=i;
+		}
+	}
+	return maxContents;
+}
+
+static void freeSegKeys(void)
+{
+	checkFree(segKeys);
+	checkFree(keyBuckets);
+	checkFree(freeNext);
+	checkFree(memberGroup);
+	checkFree(memberNext);
+	segKeys=NULL;
+	keyBuckets=NULL;
+	freeNext=NULL;
+	memberGroup=NULL;
+	memberNext=NULL;
+	segKeyCount=memberCount=0;
+}
+
+static PSEG createMasterSeg(PSEG sa,PSEG parent)
+{
+	PSEG mseg;
+
+	mseg=createDuplicateSection(sa);
+	mseg->mod=NULL;
+	mseg->parent=parent;
+	mseg->base=sa->base;
+	if(sa->combine==SEGF_COMMON)
+	{
+		sa->base=0; /* its place in a group is no offset within the common seg */
+		addCommonSeg(mseg,sa);
+	}
+	else
+	{
+		addSeg(mseg,sa); /* add original to master */
+	}
+	return mseg;
+}
+
+static void mergeSeg(PSEG mseg,PSEG sb)
+{
+	if(sb->combine==SEGF_COMMON)
+	{
+		sb->base=0;
+		addCommonSeg(mseg,sb);
+	}
+	else
+	{
+		addSeg(mseg,sb); /* add second, third, etc. seg to master */
+	}
+}
+
 BOOL combineSegments(void)
 {
-	UINT i,j,k,l;
+	UINT i,k,n;
+	INT l,c;
+	INT *contentKey;
 	PSEG sa,sb,mseg,ga,gb;
+	PSEGKEY key;
+	BOOL ok=TRUE;
 
 	/* remove segments marked for discard */
 	for(i=0;i<globalSegCount;++i)
@@ -145,6 +392,8 @@ BOOL combineSegments(void)
 	/* ensure groups are combined first, as it makes things easier */
 	combineGroups();
 
+	contentKey=checkMalloc((buildSegKeys()+1)*sizeof(INT));
+
 	/* combine grouped segs with non-grouped segs */
 	/* and warn if match other grouped segs */
 	for(i=0;i<globalSegCount;++i)
@@ -152,138 +401,92 @@ BOOL combineSegments(void)
 		if(!globalSegs[i]) continue; /* skip empty entries */
 		if(!globalSegs[i]->group) continue; /* skip all but groups */
 		ga=globalSegs[i];
-		for(k=0;k<ga->contentCount;++k)
-		{
-			sa=ga->contentList[k].seg; /* get included seg */
-			if(sa->group) continue; /* skip included groups */
-			mseg=NULL;
 
-			for(l=k+1;l<ga->contentCount;++l)
+		/* merge segs with the same key within the group into the first one */
+		/* masters are only attached to the group once it has been compacted */
+		for(k=0,n=0;k<ga->contentCount;++k)
+		{
+			sb=ga->contentList[k].seg;
+			c=sb->group?-1:segKeyIndex(sb,FALSE);
+			if(c>=0)
 			{
-				sb=ga->contentList[l].seg;
-				if(sb->group) continue; /* skip included groups */
-				if(sb->combine != sa->combine) continue; /* skip if don't combine the same way */
-				/* if "STACK" segments then combine, otherwise check names */
-				if(sa->combine!=SEGF_STACK)
+				key=segKeys+c;
+				if(key->group==i+1)
 				{
-					if((sa->name && sb->name && strcmp(lookupTargetName(sa->name),lookupTargetName(sb->name)))
-					   || (sa->name && !sb->name) || (!sa->name && sb->name)
-					   ) continue; /* skip if names don't match */
-					if((sa->class && sb->class && strcmp(sa->class,sb->class))
-					   || (sa->class && !sb->class) || (!sa->class && sb->class)
-					   ) continue; /* skip if classes don't match */
-					if((sa->combine==SEGF_PRIVATE) && ((sa->mod!=sb->mod) || !sa->mod))
-						continue; /* skip if private segs from different modules, or global */
-				}
-				diagnostic(DIAG_VERBOSE,"Combining segs %s and %s\n",sa->name,sb->name);
-				/* we now have a match within the same group */
-				/* same name+class. Create master seg if not already one */
-				if(!mseg)
-				{
-					mseg=createDuplicateSection(sa);
-					mseg->mod=NULL;
-					mseg->parent=sa->parent;
-					mseg->base=sa->base;
-					ga->contentList[k].seg=mseg; /* replace original group with master in list */
-					if(sa->combine==SEGF_COMMON)
-					{
-						addCommonSeg(mseg,sa);
-					}
-					else
+					sa=ga->contentList[key->index].seg;
+					diagnostic(DIAG_VERBOSE,"Combining segs %s and %s\n",sa->name,sb->name);
+					if(!key->master)
 					{
-						addSeg(mseg,sa); /* add original to master */
+						key->master=createMasterSeg(sa,NULL);
+						ga->contentList[key->index].seg=key->master; /* replace original with master in list */
 					}
+					mergeSeg(key->master,sb);
+					continue; /* and remove from list */
 				}
-				removeContent(ga,l); /* remove from list */
-				if(sb->combine==SEGF_COMMON)
-				{
-					addCommonSeg(mseg,sb);
-				}
-				else
-				{
-					addSeg(mseg,sb); /* add second, third, etc. group to master */
-				}
-				--l; /* next check has same index */
+				key->group=i+1;
+				key->index=n;
+				key->master=NULL;
 			}
-			for(j=0;j<globalSegCount;++j)
+			contentKey[n]=c;
+			ga->contentList[n++]=ga->contentList[k];
+		}
+		ga->contentCount=n;
+		invalidateInitLength(ga);
+
+		for(k=0;k<ga->contentCount;++k)
+		{
+			c=contentKey[k];
+			if(c<0) continue;
+			key=segKeys+c;
+			sa=ga->contentList[k].seg;
+
+			/* other groups including a seg with the same key */
+			for(l=key->firstMember;(l>=0) && (memberGroup[l]<=i);l=memberNext[l]);
+			key->firstMember=l;
+			for(;l>=0;l=memberNext[l])
 			{
-				if(j==i) continue; /* don't process the same entry against itself */
-				if(!globalSegs[j]) continue;
-				if(globalSegs[j]->group)
+				gb=globalSegs[memberGroup[l]];
+				if(sa->combine==SEGF_STACK)
 				{
-					if(j<i) continue; /* don't repeat a comparison already made */
-					/* seg is a group, so check contents */
-					gb=globalSegs[j];
-					for(l=0;l<gb->contentCount;++l)
-					{
-						sb=gb->contentList[l].seg; /* get included seg */
-						if(sb->group) continue; /* skip included groups */
-						if(sb->combine != sa->combine) continue; /* skip if don't combine the same way */
-						if(sa->combine==SEGF_STACK)
-						{
-							addError("Explicit stack part of group %s and %s\n",
-								   ga->name,gb->name);
-							return FALSE;
-						}
-						if((sa->name && sb->name && strcmp(lookupTargetName(sa->name),lookupTargetName(sb->name)))
-						   || (sa->name && !sb->name) || (!sa->name && sb->name)
-						   ) continue; /* skip if names don't match */
-						if((sa->class && sb->class && strcmp(sa->class,sb->class))
-						   || (sa->class && !sb->class) || (!sa->class && sb->class)
-						   ) continue; /* skip if classes don't match */
-						if((sa->combine==SEGF_PRIVATE) && ((sa->mod!=sb->mod) || !sa->mod))
-							continue; /* skip if private segs from different modules, or global */
-						diagnostic(DIAG_BASIC,"Warning, segment %s is a member of groups %s and %s\n",
-						           sa->name?sa->name:"",
-						           ga->name?ga->name:"",
-						           gb->name?gb->name:"");
-					}
+					addError("Explicit stack part of group %s and %s\n",
+						   ga->name,gb->name);
+					ok=FALSE;
+					break;
 				}
-				else
+				diagnostic(DIAG_BASIC,"Warning, segment %s is a member of groups %s and %s\n",
+				           sa->name?sa->name:"",
+				           ga->name?ga->name:"",
+				           gb->name?gb->name:"");
+			}
+
+			if(!ok) break;
+
+			/* non-grouped segs go to the first group including their key */
+			for(l=key->firstFree;l>=0;l=freeNext[l])
+			{
+				sb=globalSegs[l];
+				diagnostic(DIAG_VERBOSE,"Combining segs %s and %s\n",sa->name,sb->name);
+				if(!key->master)
 				{
-					sb=globalSegs[j]; /* get next seg */
-					if(sb->combine != sa->combine) continue; /* skip if don't combine the same way */
-					/* if "STACK" segments then combine, otherwise check names */
-					if(sa->combine!=SEGF_STACK)
-					{
-						if((sa->name && sb->name && strcmp(lookupTargetName(sa->name),lookupTargetName(sb->name)))
-						   || (sa->name && !sb->name) || (!sa->name && sb->name)
-						   ) continue; /* skip if names don't match */
-						if((sa->class && sb->class && strcmp(sa->class,sb->class))
-						   || (sa->class && !sb->class) || (!sa->class && sb->class)
-						   ) continue; /* skip if classes don't match */
-						if((sa->combine==SEGF_PRIVATE) && ((sa->mod!=sb->mod) || !sa->mod))
-							continue; /* skip if private segs from different modules, or global */
-					}
-					diagnostic(DIAG_VERBOSE,"Combining segs %s and %s\n",sa->name,sb->name);
-					/* same name+class. Create master seg if not already one */
-					if(!mseg)
-					{
-						mseg=createDuplicateSection(sa);
-						mseg->mod=NULL;
-						mseg->parent=sa->parent;
-						mseg->base=sa->base;
-						ga->contentList[k].seg=mseg; /* replace original group with master in list */
-						if(sa->combine==SEGF_COMMON)
-						{
-							addCommonSeg(mseg,sa);
-						}
-						else
-						{
-							addSeg(mseg,sa); /* add original to master */
-						}
-					}
-					if(sb->combine==SEGF_COMMON)
-					{
-						addCommonSeg(mseg,sb);
-					}
-					else
-					{
-						addSeg(mseg,sb); /* add second, third, etc. group to master */
-					}
-					globalSegs[j]=NULL; /* and remove from list */
+					key->master=createMasterSeg(sa,NULL);
+					ga->contentList[k].seg=key->master; /* replace original with master in list */
 				}
+				mergeSeg(key->master,sb);
+				globalSegs[l]=NULL; /* and remove from list */
 			}
+			key->firstFree=-1;
+		}
+
+		for(k=0;k<ga->contentCount;++k)
+		{
+			c=contentKey[k];
+			if((c>=0) && segKeys[c].master) segKeys[c].master->parent=ga;
+		}
+		if(!ok)
+		{
+			checkFree(contentKey);
+			freeSegKeys();
+			return FALSE;
 		}
 	}
 	/* now combine non-grouped segments */
@@ -291,59 +494,33 @@ BOOL combineSegments(void)
 	{
 		if(!globalSegs[i]) continue; /* skip empty entries */
 		if(globalSegs[i]->group) continue; /* skip groups */
+		c=segKeyIndex(globalSegs[i],FALSE);
+		if(c<0) continue;
+		key=segKeys+c;
+		if(key->firstFree!=(INT)i) continue;
 		sa=globalSegs[i];
 		mseg=NULL;
-		for(j=i+1;j<globalSegCount;++j)
+		for(l=freeNext[i];l>=0;l=freeNext[l])
 		{
-			if(!globalSegs[j]) continue;
-			if(globalSegs[j]->group) continue;
-			sb=globalSegs[j]; /* get next seg */
-			if(sb->combine != sa->combine) continue; /* skip if don't combine the same way */
-			/* if "STACK" segments then combine, otherwise check names */
-			if(sa->combine!=SEGF_STACK)
-			{
-				if((sa->name && sb->name && strcmp(lookupTargetName(sa->name),lookupTargetName(sb->name)))
-				   || (sa->name && !sb->name) || (!sa->name && sb->name)
-				   ) continue; /* skip if names don't match */
-				if((sa->class && sb->class && strcmp(sa->class,sb->class))
-				   || (sa->class && !sb->class) || (!sa->class && sb->class)
-				   ) continue; /* skip if classes don't match */
-				if((sa->combine==SEGF_PRIVATE) && ((sa->mod!=sb->mod) || !sa->mod))
-					continue; /* skip if private segs from different modules, or global */
-			}
+			sb=globalSegs[l];
 			diagnostic(DIAG_VERBOSE,"Combining segs %s and %s\n",sa->name,sb->name);
 			/* same name+class. Create master seg if not already one */
 			if(!mseg)
 			{
 				PCHAR tempName;
-				mseg=createDuplicateSection(sa);
-				mseg->mod=NULL;
-				mseg->parent=sa->parent;
-				mseg->base=sa->base;
+				mseg=createMasterSeg(sa,sa->parent);
 				tempName=mseg->name;
 				mseg->name=checkStrdup(lookupTargetName(tempName));
 				checkFree(tempName);
 				globalSegs[i]=mseg; /* replace original group with master in list */
-				if(sa->combine==SEGF_COMMON)
-				{
-					addCommonSeg(mseg,sa);
-				}
-				else
-				{
-					addSeg(mseg,sa); /* add original to master */
-				}
-			}
-			if(sb->combine==SEGF_COMMON)
-			{
-				addCommonSeg(mseg,sb);
-			}
-			else
-			{
-				addSeg(mseg,sb); /* add second, third, etc. group to master */
 			}
-			globalSegs[j]=NULL; /* and remove from list */
+			mergeSeg(mseg,sb);
+			globalSegs[l]=NULL; /* and remove from list */
 		}
+		key->firstFree=-1;
 	}
+	checkFree(contentKey);
+	freeSegKeys();
 
 	updateTargetNames();
 	reorderGroups();
@@ -0,0 +1,321 @@
+#include "alink.h"
+
+struct rodata
+{
+	PSEG seg;
+	UINT index;
+	UINT hash;
+	PUCHAR data;
+	BOOL isString;
+	PSEG target;
+	UINT delta;
+};
+
+typedef struct rodata RODATA,*PRODATA,**PPRODATA;
+
+static PPRODATA roList=NULL;
+static UINT roCount=0;
+
+/* a segment can be merged if it is a leaf of read-only, non-code data with no fixups of its own */
+static BOOL isMergeable(PSEG s)
+{
+	UINT i;
+
+	if(s->group || s->addressspace || s->absolute || s->internal) return FALSE;
+	if(s->code || s->execute || s->write || !s->read) return FALSE;
+	if(s->combine==SEGF_COMMON || s->combine==SEGF_STACK) return FALSE;
+	if(!s->length || s->relocCount || s->lineCount) return FALSE;
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag!=DATA) return FALSE;
+	}
+	return TRUE;
+}
+
+static void addCandidate(PSEG s)
+{
+	UINT i;
+	PRODATA r;
+	PDATABLOCK d;
+
+	r=checkMalloc(sizeof(RODATA));
+	r->seg=s;
+	r->index=roCount;
+	r->target=NULL;
+	r->delta=0;
+	/* flatten content, zero-filling any gaps */
+	r->data=checkMalloc(s->length);
+	memset(r->data,0,s->length);
+	for(i=0;i<s->contentCount;++i)
+	{
+		d=s->contentList[i].data;
+		copyDataBlock(d,r->data+d->offset);
+	}
+	/* FNV-1a */
+	r->hash=2166136261UL;
+	for(i=0;i<s->length;++i)
+	{
+		r->hash^=r->data[i];
+		r->hash=(r->hash*16777619UL)&0xffffffffUL;
+	}
+	/* single NUL-terminated string? */
+	r->isString=(r->data[s->length-1]==0) && !memchr(r->data,0,s->length-1);
+
+	roList=checkRealloc(roList,(roCount+1)*sizeof(PRODATA));
+	roList[roCount]=r;
+	roCount++;
+}
+
+static void findCandidates(PSEG s)
+{
+	UINT i;
+
+	if(!s) return;
+	if(isMergeable(s))
+	{
+		addCandidate(s);
+		return;
+	}
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag==SEGMENT)
+			findCandidates(s->contentList[i].seg);
+	}
+}
+
+static int contentCompare(PPRODATA r1,PPRODATA r2)
+{
+	int c;
+
+	if((*r1)->hash!=(*r2)->hash) return ((*r1)->hash<(*r2)->hash)?-1:+1;
+	if((*r1)->seg->length!=(*r2)->seg->length) return ((*r1)->seg->length<(*r2)->seg->length)?-1:+1;
+	c=memcmp((*r1)->data,(*r2)->data,(*r1)->seg->length);
+	if(c) return c;
+	if((*r1)->index==(*r2)->index) return 0;
+	return ((*r1)->index<(*r2)->index)?-1:+1;
+}
+
+/* compare strings backwards, so a string sorts immediately before those it is a tail of */
+static int tailCompare(PPRODATA r1,PPRODATA r2)
+{
+	UINT i,j;
+
+	i=(*r1)->seg->length;
+	j=(*r2)->seg->length;
+	while(i && j)
+	{
+		--i;
+		--j;
+		if((*r1)->data[i]!=(*r2)->data[j]) return ((*r1)->data[i]<(*r2)->data[j])?-1:+1;
+	}
+	if(i!=j) return (i<j)?-1:+1;
+	if((*r1)->index==(*r2)->index) return 0;
+	return ((*r1)->index<(*r2)->index)?-1:+1;
+}
+
+static int segCompare(PPRODATA r1,PPRODATA r2)
+{
+	if((*r1)->seg==(*r2)->seg) return 0;
+	return ((*r1)->seg<(*r2)->seg)?-1:+1;
+}
+
+static PRODATA findMerged(PSEG s)
+{
+	UINT lo,hi,mid;
+
+	if(!s) return NULL;
+	lo=0;
+	hi=roCount;
+	while(lo<hi)
+	{
+		mid=(lo+hi)/2;
+		if(roList[mid]->seg==s) return roList[mid]->target?roList[mid]:NULL;
+		if(roList[mid]->seg<s)
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	return NULL;
+}
+
+static void redirectRelocs(PSEG s)
+{
+	UINT i;
+	PRODATA r;
+
+	if(!s) return;
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag==SEGMENT)
+			redirectRelocs(s->contentList[i].seg);
+	}
+	for(i=0;i<s->relocCount;++i)
+	{
+		if((r=findMerged(s->relocs[i].tseg)))
+		{
+			s->relocs[i].tseg=r->target;
+			s->relocs[i].disp+=r->delta;
+		}
+		if((r=findMerged(s->relocs[i].fseg)))
+		{
+			s->relocs[i].fseg=r->target;
+		}
+	}
+}
+
+static void redirectSymbols(PPSYMBOL list,UINT count)
+{
+	UINT i;
+	PRODATA r;
+
+	for(i=0;i<count;++i)
+	{
+		if(!list[i]) continue;
+		if((r=findMerged(list[i]->seg)))
+		{
+			list[i]->seg=r->target;
+			list[i]->ofs+=r->delta;
+		}
+	}
+}
+
+static void removeMerged(PSEG s)
+{
+	UINT i;
+
+	if(!s) return;
+	for(i=s->contentCount;i;--i)
+	{
+		if(s->contentList[i-1].flag!=SEGMENT) continue;
+		if(findMerged(s->contentList[i-1].seg))
+		{
+			removeContent(s,i-1);
+		}
+		else
+		{
+			removeMerged(s->contentList[i-1].seg);
+		}
+	}
+}
+
+BOOL mergeReadOnlyData(void)
+{
+	UINT i,j,k,n;
+	UINT blockCount=0,savedBytes=0;
+	PRODATA r,keep;
+	PSEG target;
+	PPRODATA strList;
+
+	diagnostic(DIAG_VERBOSE,"Merging read-only data\n");
+
+	for(i=0;i<globalSegCount;++i)
+	{
+		findCandidates(globalSegs[i]);
+	}
+	if(roCount<2) goto merge_end;
+
+	/* identical blocks, keeping the most strictly aligned copy */
+	qsort(roList,roCount,sizeof(PRODATA),(PCOMPAREFUNC)contentCompare);
+	for(i=0;i<roCount;i=j)
+	{
+		keep=roList[i];
+		for(j=i+1;j<roCount;++j)
+		{
+			if(roList[j]->hash!=roList[i]->hash) break;
+			if(roList[j]->seg->length!=roList[i]->seg->length) break;
+			if(memcmp(roList[j]->data,roList[i]->data,roList[i]->seg->length)) break;
+			if(roList[j]->seg->align>keep->seg->align) keep=roList[j];
+		}
+		for(k=i;k<j;++k)
+		{
+			if(roList[k]==keep) continue;
+			roList[k]->target=keep->seg;
+			roList[k]->delta=0;
+		}
+	}
+
+	/* tail merging of remaining NUL-terminated strings */
+	strList=checkMalloc(roCount*sizeof(PRODATA));
+	for(i=0,n=0;i<roCount;++i)
+	{
+		if(roList[i]->isString && !roList[i]->target)
+			strList[n++]=roList[i];
+	}
+	if(n>1)
+	{
+		qsort(strList,n,sizeof(PRODATA),(PCOMPAREFUNC)tailCompare);
+		for(i=n-1;i;--i)
+		{
+			r=strList[i-1];
+			keep=strList[i];
+			if(r->seg->length>=keep->seg->length) continue;
+			k=keep->seg->length-r->seg->length;
+			if(memcmp(r->data,keep->data+k,r->seg->length)) continue;
+			k+=keep->delta; /* the longer string may itself be a tail */
+			target=keep->target?keep->target:keep->seg;
+			if((target->align<r->seg->align) || (k%r->seg->align)) continue;
+			r->target=target;
+			r->delta=k;
+		}
+	}
+	checkFree(strList);
+
+	for(i=0;i<roCount;++i)
+	{
+		if(!roList[i]->target) continue;
+		diagnostic(DIAG_EXTRA,"Merging %s from %s into %s+%08lX\n",
+		           roList[i]->seg->name?roList[i]->seg->name:"",
+		           (roList[i]->seg->mod && roList[i]->seg->mod->file)?roList[i]->seg->mod->file:"",
+		           roList[i]->target->name?roList[i]->target->name:"",
+		           roList[i]->delta);
+		blockCount++;
+		savedBytes+=roList[i]->seg->length;
+	}
+	if(!blockCount) goto merge_end;
+
+	/* now point everything referencing a merged block at its replacement */
+	qsort(roList,roCount,sizeof(PRODATA),(PCOMPAREFUNC)segCompare);
+	for(i=0;i<globalSegCount;++i)
+	{
+		redirectRelocs(globalSegs[i]);
+	}
+	if(gotstart)
+	{
+		if((r=findMerged(startaddr.tseg)))
+		{
+			startaddr.tseg=r->target;
+			startaddr.disp+=r->delta;
+		}
+		if((r=findMerged(startaddr.fseg)))
+		{
+			startaddr.fseg=r->target;
+		}
+	}
+	redirectSymbols(globalSymbols,globalSymbolCount);
+	redirectSymbols(localSymbols,localSymbolCount);
+
+	/* and drop the merged blocks from the output */
+	for(i=0;i<globalSegCount;++i)
+	{
+		if(!globalSegs[i]) continue;
+		if(findMerged(globalSegs[i]))
+		{
+			globalSegs[i]=NULL;
+			continue;
+		}
+		removeMerged(globalSegs[i]);
+	}
+
+	diagnostic(DIAG_VERBOSE,"Merged %li read-only data blocks, saving %li bytes\n",blockCount,savedBytes);
+
+ merge_end:
+	for(i=0;i<roCount;++i)
+	{
+		checkFree(roList[i]->data);
+		checkFree(roList[i]);
+	}
+	checkFree(roList);
+	roList=NULL;
+	roCount=0;
+	return TRUE;
+}
@@ -0,0 +1,116 @@
+#include "alink.h"
+
+/* make-style dependency file, listing the inputs which affected the link */
+
+PCHAR depFileName=NULL;
+
+static PPCHAR depList=NULL;
+static UINT depCount=0;
+static UINT cmdFileCount=0;
+
+static BOOL isDependency(PCHAR file)
+{
+	UINT i;
+
+	for(i=0;i<depCount;++i)
+	{
+		if(!strcmp(depList[i],file)) return TRUE;
+	}
+	return FALSE;
+}
+
+/* response file, stub or library which supplied a module */
+void addDependency(PCHAR file)
+{
+	if(isDependency(file)) return;
+	depList=checkRealloc(depList,(depCount+1)*sizeof(PCHAR));
+	depList[depCount]=checkStrdup(file);
+	depCount++;
+}
+
+static BOOL isLibraryFormat(PCINPUTFMT fmt)
+{
+	if(!fmt) return FALSE;
+	return (fmt->load==OMFLibLoad) || (fmt->load==MSCOFFLibLoad) || (fmt->load==DJGPPLibLoad);
+}
+
+/* files named on the command line, later ones are default libraries */
+void depNoteFiles(void)
+{
+	cmdFileCount=fileCount;
+}
+
+static void writeDepName(PFILE f,PCHAR name)
+{
+	for(;*name;++name)
+	{
+		switch(*name)
+		{
+		case ' ':
+		case '\t':
+		case '#':
+			fputc('\\',f);
+			break;
+		case '$':
+			fputc('$',f);
+			break;
+		}
+		fputc(*name,f);
+	}
+}
+
+static void writeDep(PFILE f,PCHAR name)
+{
+	fprintf(f," \\\n ");
+	writeDepName(f,name);
+}
+
+BOOL writeDepFile(PCHAR outname)
+{
+	PFILE f;
+	UINT i,j;
+	BOOL ok;
+
+	f=fopen(depFileName,"wt");
+	if(!f)
+	{
+		addError("Unable to open dependency file %s",depFileName);
+		return FALSE;
+	}
+	writeDepName(f,outname);
+	fprintf(f,":");
+	/* response files and stub, then inputs in link order */
+	for(i=0;i<depCount;++i)
+	{
+		if(!strcmp(depList[i],outname)) continue;
+		for(j=0;j<fileCount;++j)
+		{
+			if(!strcmp(fileNames[j]->file,depList[i])) break;
+		}
+		if(j==fileCount) writeDep(f,depList[i]);
+	}
+	for(i=0;i<fileCount;++i)
+	{
+		if(!fileNames[i]->fmt) continue;
+		for(j=0;j<i;++j)
+		{
+			if(!strcmp(fileNames[j]->file,fileNames[i]->file)) break;
+		}
+		if(j!=i) continue;
+		/* only libraries which supplied modules, unless a default library */
+		if(isLibraryFormat(fileNames[i]->fmt) && (i<cmdFileCount) && !isDependency(fileNames[i]->file))
+		{
+			continue;
+		}
+		writeDep(f,fileNames[i]->file);
+	}
+	fprintf(f,"\n");
+	ok=!ferror(f);
+	if(fclose(f)) ok=FALSE;
+	if(!ok)
+	{
+		addError("Error writing dependency file %s",depFileName);
+		remove(depFileName);
+	}
+	return ok;
+}
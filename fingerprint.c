@@ -0,0 +1,541 @@
+#include "alink.h"
+
+/* input fingerprints: a link records a hash of the switches and of every */
+/* input it used in OUTPUT.fp, only the members actually loaded counting  */
+/* for libraries, so a later link with the same inputs can skip the work */
+
+BOOL fingerprint=FALSE;
+
+#define FP_EXT ".fp"
+#define FP_HEADER "ALINK fingerprint 2"
+#define FP_LINE 4096
+#define FP_BUFSIZE 0x10000
+#define FP_ALL 0xffffffffUL
+
+typedef struct fpfile
+{
+	PCHAR name;
+	UINT hash;
+} FPFILE,*PFPFILE;
+
+typedef struct fpmember
+{
+	UINT filepos;
+	UINT length;
+	UINT hash;
+} FPMEMBER,*PFPMEMBER;
+
+typedef struct fplib
+{
+	PCHAR name;
+	FILESTAMP stamp;
+	UINT namesHash;
+	UINT entryCount; /* dictionary entries, only kept during the link */
+	UINT *entryHash;
+	UINT *entryPos;
+	PFPMEMBER members;
+	UINT memberCount;
+} FPLIB,*PFPLIB;
+
+static UINT argsHash=0;
+static PCHAR stubName=NULL;
+
+static PFPFILE fpFiles=NULL;
+static UINT fpFileCount=0;
+static PFPLIB fpLibs=NULL;
+static UINT fpLibCount=0;
+static UINT fpArgs;
+static FILESTAMP fpOut;
+
+UINT hashBytes(UINT h,PUCHAR p,UINT len)
+{
+	UINT i;
+
+	for(i=0;i<len;++i)
+	{
+		h^=p[i];
+		h=(h*16777619UL)&0xffffffffUL;
+	}
+	return h;
+}
+
+UINT hashString(UINT h,PCHAR s)
+{
+	return hashBytes(h,(PUCHAR)s,strlen(s)+1);
+}
+
+UINT hashValue(UINT h,UINT v)
+{
+	UCHAR buf[4];
+
+	Set32(buf,v);
+	return hashBytes(h,buf,4);
+}
+
+/* switches which don't affect the output */
+static PCHAR reportSwitches[]={"v","time-report","time-report-json","trace","alloc-stats","libindex","fingerprint",NULL};
+
+/* switches and input files, after response files have been expanded */
+UINT hashArgs(PSWITCHPARAM sp)
+{
+	UINT h=HASH_INIT;
+	UINT i,j;
+	PCHAR epoch;
+
+	for(i=0;sp && sp[i].name;++i)
+	{
+		for(j=0;reportSwitches[j];++j)
+		{
+			if(!strcmp(sp[i].name,reportSwitches[j])) break;
+		}
+		if(reportSwitches[j]) continue;
+		h=hashString(h,sp[i].name);
+		for(j=0;j<sp[i].count;++j)
+		{
+			h=hashString(h,sp[i].params[j]);
+		}
+	}
+	for(i=0;i<fileCount;++i)
+	{
+		h=hashString(h,fileNames[i]->file);
+	}
+	/* a fixed timestamp ends up in the output as well */
+	epoch=getenv("SOURCE_DATE_EPOCH");
+	if(epoch) h=hashString(h,epoch);
+	return h;
+}
+
+/* hash length bytes from the current position, or up to end of file */
+static BOOL hashFile(PFILE f,UINT length,UINT *hash)
+{
+	UCHAR buf[FP_BUFSIZE];
+	UINT h=HASH_INIT;
+	UINT n;
+
+	while(length)
+	{
+		n=fread(buf,1,(length>FP_BUFSIZE)?FP_BUFSIZE:length,f);
+		if(!n) break;
+		h=hashBytes(h,buf,n);
+		if(length!=FP_ALL) length-=n;
+	}
+	if(ferror(f) || ((length!=FP_ALL) && length)) return FALSE;
+	*hash=h;
+	return TRUE;
+}
+
+static BOOL hashFileName(PCHAR name,UINT *hash)
+{
+	PFILE f;
+	BOOL ok;
+
+	f=fopen(name,"rb");
+	if(!f) return FALSE;
+	ok=hashFile(f,FP_ALL,hash);
+	fclose(f);
+	return ok;
+}
+
+static BOOL hashMembers(PFPLIB lib,BOOL check)
+{
+	PFILE f;
+	UINT i,h;
+	BOOL ok=TRUE;
+
+	if(!lib->memberCount) return TRUE;
+	f=fopen(lib->name,"rb");
+	if(!f) return FALSE;
+	for(i=0;ok && (i<lib->memberCount);++i)
+	{
+		ok=!fseek(f,lib->members[i].filepos,SEEK_SET)
+			&& hashFile(f,lib->members[i].length,&h);
+		if(!ok) break;
+		if(check)
+		{
+			ok=(h==lib->members[i].hash);
+		}
+		else
+		{
+			lib->members[i].hash=h;
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+static int memberCompare(const void *x1,const void *x2)
+{
+	UINT a=((PFPMEMBER)x1)->filepos,b=((PFPMEMBER)x2)->filepos;
+
+	return (a<b)?-1:((a>b)?1:0);
+}
+
+/* dictionary entries, paired with the loaded member they lead to */
+/* summed, so the order of the dictionary doesn't matter */
+static UINT hashNames(PFPLIB lib,UINT count,UINT *entryHash,UINT *entryPos)
+{
+	PFPMEMBER sorted=NULL,m;
+	FPMEMBER key;
+	UINT i,h=0;
+
+	if(lib->memberCount)
+	{
+		sorted=checkMalloc(lib->memberCount*sizeof(FPMEMBER));
+		memcpy(sorted,lib->members,lib->memberCount*sizeof(FPMEMBER));
+		qsort(sorted,lib->memberCount,sizeof(FPMEMBER),memberCompare);
+	}
+	for(i=0;i<count;++i)
+	{
+		key.filepos=entryPos[i];
+		m=sorted?bsearch(&key,sorted,lib->memberCount,sizeof(FPMEMBER),memberCompare):NULL;
+		h+=hashValue(entryHash[i],m?m->hash:0);
+	}
+	checkFree(sorted);
+	return h&0xffffffffUL;
+}
+
+static PCHAR fpName(PCHAR outname)
+{
+	PCHAR name;
+
+	name=checkMalloc(strlen(outname)+strlen(FP_EXT)+1);
+	strcpy(name,outname);
+	strcat(name,FP_EXT);
+	return name;
+}
+
+static PFPLIB findLib(PCHAR name)
+{
+	UINT i;
+
+	for(i=0;i<fpLibCount;++i)
+	{
+		if(!strcmp(fpLibs[i].name,name)) return fpLibs+i;
+	}
+	return NULL;
+}
+
+static PFPLIB addLib(PCHAR name)
+{
+	PFPLIB lib;
+
+	fpLibs=checkRealloc(fpLibs,(fpLibCount+1)*sizeof(FPLIB));
+	lib=fpLibs+fpLibCount;
+	fpLibCount++;
+	lib->name=checkStrdup(name);
+	memset(&lib->stamp,0,sizeof(FILESTAMP));
+	lib->namesHash=0;
+	lib->entryCount=0;
+	lib->entryHash=NULL;
+	lib->entryPos=NULL;
+	lib->members=NULL;
+	lib->memberCount=0;
+	return lib;
+}
+
+static void addFile(PCHAR name,UINT hash)
+{
+	fpFiles=checkRealloc(fpFiles,(fpFileCount+1)*sizeof(FPFILE));
+	fpFiles[fpFileCount].name=checkStrdup(name);
+	fpFiles[fpFileCount].hash=hash;
+	fpFileCount++;
+}
+
+static void freeFingerprint(void)
+{
+	UINT i;
+
+	for(i=0;i<fpFileCount;++i)
+	{
+		checkFree(fpFiles[i].name);
+	}
+	for(i=0;i<fpLibCount;++i)
+	{
+		checkFree(fpLibs[i].name);
+		checkFree(fpLibs[i].entryHash);
+		checkFree(fpLibs[i].entryPos);
+		checkFree(fpLibs[i].members);
+	}
+	checkFree(fpFiles);
+	checkFree(fpLibs);
+	fpFiles=NULL;
+	fpLibs=NULL;
+	fpFileCount=fpLibCount=0;
+}
+
+static BOOL readFingerprint(PCHAR outname)
+{
+	PCHAR name;
+	PFILE f;
+	char line[FP_LINE];
+	int n;
+	UINT i;
+	PFPLIB lib=NULL;
+	PFPMEMBER m;
+	BOOL ok=TRUE;
+
+	name=fpName(outname);
+	f=fopen(name,"rt");
+	checkFree(name);
+	if(!f) return FALSE;
+	freeFingerprint();
+	if(!fgets(line,sizeof(line),f) || strncmp(line,FP_HEADER,strlen(FP_HEADER)))
+	{
+		fclose(f);
+		return FALSE;
+	}
+	while(ok && fgets(line,sizeof(line),f))
+	{
+		i=strlen(line);
+		if(!i || (line[i-1]!='\n'))
+		{
+			ok=FALSE;
+			break;
+		}
+		line[i-1]=0;
+		if(!strncmp(line,"member ",7))
+		{
+			if(!lib)
+			{
+				ok=FALSE;
+				break;
+			}
+			lib->members=checkRealloc(lib->members,(lib->memberCount+1)*sizeof(FPMEMBER));
+			m=lib->members+lib->memberCount;
+			if(sscanf(line,"member %lu %lu %lX",&m->filepos,&m->length,&m->hash)<3)
+			{
+				ok=FALSE;
+				break;
+			}
+			lib->memberCount++;
+		}
+		else if(!strncmp(line,"lib ",4))
+		{
+			lib=addLib("");
+			if(sscanf(line,"lib %lu %lu %lu %lX %n",&lib->stamp.size,&lib->stamp.mtime,&lib->stamp.mtimeNsec,
+			          &lib->namesHash,&n)<4)
+			{
+				ok=FALSE;
+				break;
+			}
+			checkFree(lib->name);
+			lib->name=checkStrdup(line+n);
+		}
+		else if(!strncmp(line,"file ",5))
+		{
+			if(sscanf(line,"file %lX %n",&i,&n)<1)
+			{
+				ok=FALSE;
+				break;
+			}
+			addFile(line+n,i);
+		}
+		else if(sscanf(line,"args %lX",&fpArgs)==1) continue;
+		else if(sscanf(line,"output %lu %lu %lu",&fpOut.size,&fpOut.mtime,&fpOut.mtimeNsec)==3) continue;
+		else ok=FALSE;
+	}
+	fclose(f);
+	if(!ok) freeFingerprint();
+	return ok;
+}
+
+static BOOL writeFingerprint(PCHAR outname)
+{
+	PCHAR name;
+	PFILE f;
+	UINT i,j;
+	BOOL ok;
+
+	name=fpName(outname);
+	f=fopen(name,"wt");
+	if(!f)
+	{
+		addError("Unable to open fingerprint file %s",name);
+		checkFree(name);
+		return FALSE;
+	}
+	fprintf(f,"%s\n",FP_HEADER);
+	fprintf(f,"args %08lX\n",fpArgs);
+	fprintf(f,"output %lu %lu %lu\n",fpOut.size,fpOut.mtime,fpOut.mtimeNsec);
+	for(i=0;i<fpFileCount;++i)
+	{
+		fprintf(f,"file %08lX %s\n",fpFiles[i].hash,fpFiles[i].name);
+	}
+	for(i=0;i<fpLibCount;++i)
+	{
+		fprintf(f,"lib %lu %lu %lu %08lX %s\n",fpLibs[i].stamp.size,fpLibs[i].stamp.mtime,
+		        fpLibs[i].stamp.mtimeNsec,fpLibs[i].namesHash,fpLibs[i].name);
+		for(j=0;j<fpLibs[i].memberCount;++j)
+		{
+			fprintf(f,"member %lu %lu %08lX\n",fpLibs[i].members[j].filepos,
+			        fpLibs[i].members[j].length,fpLibs[i].members[j].hash);
+		}
+	}
+	ok=!ferror(f);
+	if(fclose(f)) ok=FALSE;
+	if(!ok)
+	{
+		addError("Error writing fingerprint file %s",name);
+		remove(name);
+	}
+	checkFree(name);
+	return ok;
+}
+
+/* a library the dictionary of which was needed has changed */
+static BOOL checkLibNames(PFPLIB lib)
+{
+	PLIBINDEX idx;
+	BOOL cached;
+	UINT i,h;
+	UINT *entryHash;
+
+	idx=openLibIndex(lib->name,&cached);
+	if(!idx) return FALSE;
+	entryHash=checkMalloc((idx->count+1)*sizeof(UINT));
+	for(i=0;i<idx->count;++i)
+	{
+		entryHash[i]=hashString(HASH_INIT,idx->names[i]);
+	}
+	h=hashNames(lib,idx->count,entryHash,idx->filepos);
+	checkFree(entryHash);
+	if(!cached) releaseLibIndex(idx);
+	return h==lib->namesHash;
+}
+
+/* check the inputs against those of the last link, TRUE if output is up to date */
+BOOL fingerprintCheck(PSWITCHPARAM sp,PCHAR outname)
+{
+	UINT i,h;
+	FILESTAMP stamp;
+
+	argsHash=hashArgs(sp);
+	for(i=0;sp && sp[i].name;++i)
+	{
+		if(!strcmp(sp[i].name,"stub")) stubName=sp[i].params[0];
+	}
+	if(!readFingerprint(outname))
+	{
+		diagnostic(DIAG_VERBOSE,"Fingerprint: no previous link\n");
+		return FALSE;
+	}
+	if((fpArgs!=argsHash) || !getFileStamp(outname,&stamp) || !sameFileStamp(&stamp,&fpOut))
+	{
+		diagnostic(DIAG_VERBOSE,"Fingerprint: options or output changed\n");
+		freeFingerprint();
+		return FALSE;
+	}
+	for(i=0;i<fpFileCount;++i)
+	{
+		if(!hashFileName(fpFiles[i].name,&h) || (h!=fpFiles[i].hash))
+		{
+			diagnostic(DIAG_VERBOSE,"Fingerprint: %s changed\n",fpFiles[i].name);
+			freeFingerprint();
+			return FALSE;
+		}
+	}
+	for(i=0;i<fpLibCount;++i)
+	{
+		if(!hashMembers(fpLibs+i,TRUE))
+		{
+			diagnostic(DIAG_VERBOSE,"Fingerprint: loaded modules of %s changed\n",fpLibs[i].name);
+			freeFingerprint();
+			return FALSE;
+		}
+		/* untouched library, so the dictionary hasn't changed either */
+		if(getFileStamp(fpLibs[i].name,&stamp) && sameFileStamp(&stamp,&fpLibs[i].stamp))
+		{
+			continue;
+		}
+		if(!checkLibNames(fpLibs+i))
+		{
+			diagnostic(DIAG_VERBOSE,"Fingerprint: dictionary of %s changed\n",fpLibs[i].name);
+			freeFingerprint();
+			return FALSE;
+		}
+	}
+	freeFingerprint();
+	diagnostic(DIAG_BASIC,"%s is up to date\n",outname);
+	return TRUE;
+}
+
+/* library dictionary added to the symbol table */
+void fingerprintNoteLibrary(PLIBINDEX idx,PMODULE mod)
+{
+	PFPLIB lib;
+	UINT i;
+
+	lib=findLib(mod->file);
+	if(!lib) lib=addLib(mod->file);
+	checkFree(lib->entryHash);
+	checkFree(lib->entryPos);
+	lib->entryCount=idx->count;
+	lib->entryHash=checkMalloc((idx->count+1)*sizeof(UINT));
+	lib->entryPos=checkMalloc((idx->count+1)*sizeof(UINT));
+	for(i=0;i<idx->count;++i)
+	{
+		lib->entryHash[i]=hashString(HASH_INIT,idx->names[i]);
+		lib->entryPos[i]=idx->filepos[i];
+	}
+}
+
+/* library module loaded from filepos, ending at end */
+void fingerprintNoteMember(PMODULE mod,UINT filepos,UINT end)
+{
+	PFPLIB lib;
+	PFPMEMBER m;
+
+	lib=findLib(mod->file);
+	if(!lib) lib=addLib(mod->file);
+	lib->members=checkRealloc(lib->members,(lib->memberCount+1)*sizeof(FPMEMBER));
+	m=lib->members+lib->memberCount;
+	m->filepos=filepos;
+	m->length=(end>filepos)?(end-filepos):0;
+	m->hash=0;
+	lib->memberCount++;
+}
+
+/* record the inputs of output just written */
+void fingerprintSave(PCHAR outname)
+{
+	UINT i,j,h;
+	PFPLIB lib;
+	BOOL ok=TRUE;
+
+	fpArgs=argsHash;
+	if(!getFileStamp(outname,&fpOut)) ok=FALSE;
+	for(i=0;ok && (i<fpLibCount);++i)
+	{
+		lib=fpLibs+i;
+		getFileStamp(lib->name,&lib->stamp);
+		ok=hashMembers(lib,FALSE);
+		if(!ok) break;
+		lib->namesHash=hashNames(lib,lib->entryCount,lib->entryHash,lib->entryPos);
+	}
+	for(i=0;ok && (i<fileCount);++i)
+	{
+		if(!fileNames[i]->fmt) continue;
+		if(findLib(fileNames[i]->file)) continue;
+		for(j=0;j<fpFileCount;++j)
+		{
+			if(!strcmp(fpFiles[j].name,fileNames[i]->file)) break;
+		}
+		if(j!=fpFileCount) continue;
+		ok=hashFileName(fileNames[i]->file,&h);
+		if(ok) addFile(fileNames[i]->file,h);
+	}
+	if(ok && stubName)
+	{
+		ok=hashFileName(stubName,&h);
+		if(ok) addFile(stubName,h);
+	}
+	if(ok)
+	{
+		writeFingerprint(outname);
+	}
+	else
+	{
+		diagnostic(DIAG_BASIC,"Warning: unable to fingerprint inputs of %s\n",outname);
+	}
+	freeFingerprint();
+}
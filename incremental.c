@@ -0,0 +1,1044 @@
+#include "alink.h"
+#include "pe.h"
+
+/* incremental linking: a full link records the layout of the output in */
+/* OUTPUT.ilk and pads code segments from object files, so that later   */
+/* links where only some objects have changed can patch their segments  */
+/* straight into the existing image, falling back to a full link when   */
+/* anything doesn't fit */
+
+BOOL incremental=FALSE;
+
+#define ILK_EXT ".ilk"
+#define ILK_HEADER "ALINK incremental 3"
+#define ILK_LINE 4096
+
+typedef struct incfile
+{
+	PCHAR name;
+	PCHAR fmt;
+	FILESTAMP stamp;
+	BOOL changed;
+} INCFILE,*PINCFILE;
+
+typedef struct incseg
+{
+	UINT file;
+	BOOL placed;
+	UINT va;
+	UINT filepos;
+	UINT length;
+	UINT initLength;
+	BOOL code;
+	UINT relocSig;
+	PCHAR name;
+} INCSEG,*PINCSEG,**PPINCSEG;
+
+typedef struct incsym
+{
+	PCHAR name;
+	UINT va;
+	INT file;
+	UINT length; /* size of common symbols */
+} INCSYM,*PINCSYM;
+
+static UINT argsHash=0;
+static UINT exportCount,resourceCount;
+
+/* segments from object files named on the command line, in load order */
+static PPSEG noteSegs=NULL;
+static UINT *noteFile=NULL;
+static UINT *noteSig=NULL;
+static UINT noteCount=0;
+
+/* COMDATs chosen from those files, known once common symbols are emitted */
+static PPSYMBOL noteComdats=NULL;
+static UINT *noteComdatFile=NULL;
+static UINT *noteComdatSig=NULL;
+static UINT noteComdatCount=0;
+
+/* layout read from .ilk file */
+static UINT ilkArgs;
+static UINT ilkBase;
+static BOOL ilkRelocs;
+static FILESTAMP ilkOut;
+static BOOL ilkGotEntry;
+static UINT ilkEntry;
+static PINCFILE ilkFiles=NULL;
+static UINT ilkFileCount=0;
+static PINCSEG ilkSegs=NULL;
+static UINT ilkSegCount=0;
+static PINCSEG ilkComdats=NULL; /* sorted by name */
+static UINT ilkComdatCount=0;
+static PINCSYM ilkSyms=NULL;
+static UINT ilkSymCount=0;
+
+/* signature of the fixups which need base relocations */
+static UINT relocSignature(PSEG s)
+{
+	UINT h=HASH_INIT;
+	UINT i;
+
+	for(i=0;i<s->relocCount;++i)
+	{
+		if((s->relocs[i].base!=REL_ABS) && (s->relocs[i].base!=REL_DEFAULT)) continue;
+		h=hashValue(h,s->relocs[i].ofs);
+		h=hashValue(h,s->relocs[i].rtype);
+	}
+	return h;
+}
+
+static BOOL isObjectFormat(PCINPUTFMT fmt)
+{
+	if(!fmt) return FALSE;
+	return (fmt->load==loadOMFModule) || (fmt->load==MSCOFFLoad) || (fmt->load==DJGPPLoad);
+}
+
+/* address of a segment, and the top of its tree */
+static PSEG segAddress(PSEG s,UINT *va)
+{
+	*va=0;
+	while(s)
+	{
+		*va+=s->base;
+		if(!s->parent) break;
+		s=s->parent;
+	}
+	return s;
+}
+
+static UINT segFilePos(PSEG s)
+{
+	UINT ofs=0;
+
+	while(s && !s->fpset)
+	{
+		ofs+=s->base;
+		s=s->parent;
+	}
+	return s?(s->filepos+ofs):0;
+}
+
+static PCHAR ilkName(PCHAR outname)
+{
+	PCHAR name;
+
+	name=checkMalloc(strlen(outname)+strlen(ILK_EXT)+1);
+	strcpy(name,outname);
+	strcat(name,ILK_EXT);
+	return name;
+}
+
+static void addNote(PSEG s,UINT file)
+{
+	noteSegs=checkRealloc(noteSegs,(noteCount+1)*sizeof(PSEG));
+	noteFile=checkRealloc(noteFile,(noteCount+1)*sizeof(UINT));
+	noteSig=checkRealloc(noteSig,(noteCount+1)*sizeof(UINT));
+	noteSegs[noteCount]=s;
+	noteFile[noteCount]=file;
+	noteSig[noteCount]=relocSignature(s);
+	noteCount++;
+}
+
+static void noteSegment(PSEG s,UINT file)
+{
+	UINT i;
+	BOOL leaf=TRUE;
+
+	if(!s || s->absolute) return;
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag!=SEGMENT) continue;
+		noteSegment(s->contentList[i].seg,file);
+		leaf=FALSE;
+	}
+	if(!leaf || s->group || !s->mod) return;
+	addNote(s,file);
+}
+
+static void padSegment(PSEG s)
+{
+	UINT pad;
+	PDATABLOCK d;
+
+	if(!s->code || (s->combine==SEGF_COMMON) || (s->combine==SEGF_STACK)) return;
+	pad=((s->length>>3)+16+15)&~(UINT)15;
+	d=createDataBlock(NULL,s->length,pad,1);
+	memset(d->data,0xcc,pad); /* int 3 */
+	addFixedData(s,d);
+}
+
+static UINT findFile(PMODULE mod)
+{
+	UINT i;
+
+	for(i=0;i<fileCount;++i)
+	{
+		if((fileNames[i]==mod) || !strcmp(fileNames[i]->file,mod->file)) return i;
+	}
+	return fileCount;
+}
+
+/* collect segments of loaded object files, padding code to leave room to grow */
+void incrementalNoteSegments(void)
+{
+	UINT i,j,start;
+	PSEG s;
+
+	for(i=0;i<globalSegCount;++i)
+	{
+		s=globalSegs[i];
+		if(!s || !s->mod) continue;
+		j=findFile(s->mod);
+		if((j==fileCount) || !isObjectFormat(fileNames[j]->fmt)) continue;
+		start=noteCount;
+		noteSegment(s,j);
+		for(;start<noteCount;++start)
+		{
+			padSegment(noteSegs[start]);
+		}
+	}
+}
+
+/* collect the single-segment COMDAT instances chosen from object files */
+void incrementalNoteComdats(void)
+{
+	UINT i,j;
+	PSYMBOL p;
+	PSEG s;
+
+	for(i=0;i<globalSymbolCount;++i)
+	{
+		p=globalSymbols[i];
+		if((p->type!=PUB_COMDAT) || !(s=p->seg) || !s->mod) continue;
+		for(j=0;j<p->comdatCount;++j)
+		{
+			if(p->comdatList[j]->segList[0]==s) break;
+		}
+		if((j==p->comdatCount) || (p->comdatList[j]->segCount!=1)) continue;
+		j=findFile(s->mod);
+		if((j==fileCount) || !isObjectFormat(fileNames[j]->fmt)) continue;
+		padSegment(s);
+		noteComdats=checkRealloc(noteComdats,(noteComdatCount+1)*sizeof(PSYMBOL));
+		noteComdatFile=checkRealloc(noteComdatFile,(noteComdatCount+1)*sizeof(UINT));
+		noteComdatSig=checkRealloc(noteComdatSig,(noteComdatCount+1)*sizeof(UINT));
+		noteComdats[noteComdatCount]=p;
+		noteComdatFile[noteComdatCount]=j;
+		noteComdatSig[noteComdatCount]=relocSignature(s);
+		noteComdatCount++;
+	}
+}
+
+static void freeIlk(void)
+{
+	UINT i;
+
+	for(i=0;i<ilkFileCount;++i)
+	{
+		checkFree(ilkFiles[i].name);
+		checkFree(ilkFiles[i].fmt);
+	}
+	for(i=0;i<ilkSegCount;++i)
+	{
+		checkFree(ilkSegs[i].name);
+	}
+	for(i=0;i<ilkComdatCount;++i)
+	{
+		checkFree(ilkComdats[i].name);
+	}
+	for(i=0;i<ilkSymCount;++i)
+	{
+		checkFree(ilkSyms[i].name);
+	}
+	checkFree(ilkFiles);
+	checkFree(ilkSegs);
+	checkFree(ilkComdats);
+	checkFree(ilkSyms);
+	ilkFiles=NULL;
+	ilkSegs=NULL;
+	ilkComdats=NULL;
+	ilkSyms=NULL;
+	ilkFileCount=ilkSegCount=ilkComdatCount=ilkSymCount=0;
+}
+
+static void writeIlkSeg(PFILE f,PCHAR kind,PINCSEG s)
+{
+	fprintf(f,"%s %lu %i %08lX %08lX %lu %lu %i %08lX %s\n",kind,s->file,s->placed?1:0,s->va,s->filepos,
+	        s->length,s->initLength,s->code?1:0,s->relocSig,s->name);
+}
+
+static BOOL writeIlk(PCHAR outname)
+{
+	PCHAR name;
+	PFILE f;
+	UINT i;
+	BOOL ok;
+
+	name=ilkName(outname);
+	f=fopen(name,"wt");
+	if(!f)
+	{
+		addError("Unable to open incremental link file %s",name);
+		checkFree(name);
+		return FALSE;
+	}
+	fprintf(f,"%s\n",ILK_HEADER);
+	fprintf(f,"args %08lX\n",ilkArgs);
+	fprintf(f,"base %08lX\n",ilkBase);
+	fprintf(f,"relocs %i\n",ilkRelocs?1:0);
+	fprintf(f,"output %lu %lu %lu\n",ilkOut.size,ilkOut.mtime,ilkOut.mtimeNsec);
+	if(ilkGotEntry)
+	{
+		fprintf(f,"entry %08lX\n",ilkEntry);
+	}
+	for(i=0;i<ilkFileCount;++i)
+	{
+		fprintf(f,"file %s %lu %lu %lu %s\n",ilkFiles[i].fmt,ilkFiles[i].stamp.size,ilkFiles[i].stamp.mtime,
+		        ilkFiles[i].stamp.mtimeNsec,ilkFiles[i].name);
+	}
+	for(i=0;i<ilkSegCount;++i)
+	{
+		writeIlkSeg(f,"seg",ilkSegs+i);
+	}
+	/* COMDATs and symbols are written in symbol table order, so sorted by name */
+	for(i=0;i<ilkComdatCount;++i)
+	{
+		writeIlkSeg(f,"comdat",ilkComdats+i);
+	}
+	for(i=0;i<ilkSymCount;++i)
+	{
+		fprintf(f,"sym %08lX %li %lu %s\n",ilkSyms[i].va,ilkSyms[i].file,ilkSyms[i].length,ilkSyms[i].name);
+	}
+	ok=!ferror(f);
+	if(fclose(f)) ok=FALSE;
+	if(!ok)
+	{
+		addError("Error writing incremental link file %s",name);
+		remove(name);
+	}
+	checkFree(name);
+	return ok;
+}
+
+/* record layout of output just written */
+void incrementalSave(PCHAR outname)
+{
+	UINT i,va;
+	PSEG root,top,s;
+	PSYMBOL p;
+	PMODULE mod;
+
+	if(!spaceCount) return;
+	root=spaceList[0];
+	freeIlk();
+
+	ilkArgs=argsHash;
+	ilkBase=root->base;
+	ilkRelocs=relocsRequired;
+	if(!getFileStamp(outname,&ilkOut)) return;
+
+	ilkGotEntry=FALSE;
+	if(gotstart)
+	{
+		top=NULL;
+		va=0;
+		if(startaddr.tseg)
+		{
+			top=segAddress(startaddr.tseg,&va);
+		}
+		else if(startaddr.text && startaddr.text->pubdef && startaddr.text->pubdef->seg)
+		{
+			top=segAddress(startaddr.text->pubdef->seg,&va);
+			va+=startaddr.text->pubdef->ofs;
+		}
+		if(top==root)
+		{
+			ilkGotEntry=TRUE;
+			ilkEntry=va+startaddr.disp;
+		}
+	}
+
+	ilkFiles=checkMalloc((fileCount+1)*sizeof(INCFILE));
+	for(i=0;i<fileCount;++i)
+	{
+		ilkFiles[i].name=checkStrdup(fileNames[i]->file);
+		ilkFiles[i].fmt=checkStrdup(fileNames[i]->fmt?fileNames[i]->fmt->name:"-");
+		memset(&ilkFiles[i].stamp,0,sizeof(FILESTAMP));
+		getFileStamp(fileNames[i]->file,&ilkFiles[i].stamp);
+	}
+	ilkFileCount=fileCount;
+
+	ilkSegs=checkMalloc((noteCount+1)*sizeof(INCSEG));
+	for(i=0;i<noteCount;++i)
+	{
+		ilkSegs[i].file=noteFile[i];
+		ilkSegs[i].placed=(segAddress(noteSegs[i],&ilkSegs[i].va)==root);
+		ilkSegs[i].filepos=segFilePos(noteSegs[i]);
+		ilkSegs[i].length=noteSegs[i]->length;
+		ilkSegs[i].initLength=getInitLength(noteSegs[i]);
+		ilkSegs[i].code=noteSegs[i]->code;
+		ilkSegs[i].relocSig=noteSig[i];
+		ilkSegs[i].name=checkStrdup(noteSegs[i]->name?noteSegs[i]->name:"-");
+	}
+	ilkSegCount=noteCount;
+
+	ilkComdats=checkMalloc((noteComdatCount+1)*sizeof(INCSEG));
+	for(i=0;i<noteComdatCount;++i)
+	{
+		s=noteComdats[i]->seg;
+		ilkComdats[i].file=noteComdatFile[i];
+		ilkComdats[i].placed=(segAddress(s,&ilkComdats[i].va)==root);
+		ilkComdats[i].filepos=segFilePos(s);
+		ilkComdats[i].length=s->length;
+		ilkComdats[i].initLength=getInitLength(s);
+		ilkComdats[i].code=s->code;
+		ilkComdats[i].relocSig=noteComdatSig[i];
+		ilkComdats[i].name=checkStrdup(noteComdats[i]->name);
+	}
+	ilkComdatCount=noteComdatCount;
+
+	ilkSyms=checkMalloc((globalSymbolCount+1)*sizeof(INCSYM));
+	for(i=0;i<globalSymbolCount;++i)
+	{
+		p=globalSymbols[i];
+		if(!p->seg) continue;
+		if(segAddress(p->seg,&va)!=root) continue;
+		ilkSyms[ilkSymCount].name=checkStrdup(p->name);
+		ilkSyms[ilkSymCount].va=va+p->ofs;
+		/* a COMDAT belongs to the module its chosen instance came from */
+		mod=(p->type==PUB_COMDAT)?p->seg->mod:p->mod;
+		ilkSyms[ilkSymCount].file=mod?(INT)findFile(mod):-1;
+		if(ilkSyms[ilkSymCount].file==(INT)fileCount) ilkSyms[ilkSymCount].file=-1;
+		ilkSyms[ilkSymCount].length=(p->type==PUB_COMDEF)?p->length:0;
+		ilkSymCount++;
+	}
+
+	writeIlk(outname);
+	freeIlk();
+}
+
+static BOOL readIlkSeg(PCHAR line,PINCSEG s)
+{
+	int n,placed,code;
+
+	if(sscanf(line,"%lu %i %lX %lX %lu %lu %i %lX %n",&s->file,&placed,&s->va,&s->filepos,&s->length,
+	          &s->initLength,&code,&s->relocSig,&n)<8)
+	{
+		return FALSE;
+	}
+	s->placed=placed;
+	s->code=code;
+	s->name=checkStrdup(line+n);
+	return TRUE;
+}
+
+static BOOL readIlk(PCHAR outname)
+{
+	PCHAR name;
+	PFILE f;
+	char line[ILK_LINE];
+	char fmt[64];
+	int n,placed;
+	UINT i;
+	BOOL ok=TRUE;
+
+	name=ilkName(outname);
+	f=fopen(name,"rt");
+	checkFree(name);
+	if(!f) return FALSE;
+	freeIlk();
+	ilkGotEntry=FALSE;
+	if(!fgets(line,sizeof(line),f) || strncmp(line,ILK_HEADER,strlen(ILK_HEADER)))
+	{
+		fclose(f);
+		return FALSE;
+	}
+	while(ok && fgets(line,sizeof(line),f))
+	{
+		i=strlen(line);
+		if(!i || (line[i-1]!='\n'))
+		{
+			ok=FALSE;
+			break;
+		}
+		line[i-1]=0;
+		if(!strncmp(line,"sym ",4))
+		{
+			if(!(ilkSymCount&0xfff))
+			{
+				ilkSyms=checkRealloc(ilkSyms,(ilkSymCount+0x1000)*sizeof(INCSYM));
+			}
+			if(sscanf(line,"sym %lX %li %lu %n",&ilkSyms[ilkSymCount].va,&ilkSyms[ilkSymCount].file,
+			          &ilkSyms[ilkSymCount].length,&n)<3)
+			{
+				ok=FALSE;
+				break;
+			}
+			ilkSyms[ilkSymCount].name=checkStrdup(line+n);
+			ilkSymCount++;
+		}
+		else if(!strncmp(line,"seg ",4))
+		{
+			ilkSegs=checkRealloc(ilkSegs,(ilkSegCount+1)*sizeof(INCSEG));
+			if(!readIlkSeg(line+4,ilkSegs+ilkSegCount))
+			{
+				ok=FALSE;
+				break;
+			}
+			ilkSegCount++;
+		}
+		else if(!strncmp(line,"comdat ",7))
+		{
+			ilkComdats=checkRealloc(ilkComdats,(ilkComdatCount+1)*sizeof(INCSEG));
+			if(!readIlkSeg(line+7,ilkComdats+ilkComdatCount))
+			{
+				ok=FALSE;
+				break;
+			}
+			ilkComdatCount++;
+		}
+		else if(!strncmp(line,"file ",5))
+		{
+			ilkFiles=checkRealloc(ilkFiles,(ilkFileCount+1)*sizeof(INCFILE));
+			if(sscanf(line,"file %63s %lu %lu %lu %n",fmt,&ilkFiles[ilkFileCount].stamp.size,
+			          &ilkFiles[ilkFileCount].stamp.mtime,&ilkFiles[ilkFileCount].stamp.mtimeNsec,&n)<4)
+			{
+				ok=FALSE;
+				break;
+			}
+			ilkFiles[ilkFileCount].fmt=checkStrdup(fmt);
+			ilkFiles[ilkFileCount].name=checkStrdup(line+n);
+			ilkFiles[ilkFileCount].changed=FALSE;
+			ilkFileCount++;
+		}
+		else if(sscanf(line,"args %lX",&ilkArgs)==1) continue;
+		else if(sscanf(line,"base %lX",&ilkBase)==1) continue;
+		else if(sscanf(line,"relocs %i",&placed)==1) ilkRelocs=placed;
+		else if(sscanf(line,"output %lu %lu %lu",&ilkOut.size,&ilkOut.mtime,&ilkOut.mtimeNsec)==3) continue;
+		else if(sscanf(line,"entry %lX",&ilkEntry)==1) ilkGotEntry=TRUE;
+		else ok=FALSE;
+	}
+	fclose(f);
+	for(i=0;ok && (i<ilkSegCount);++i)
+	{
+		if(ilkSegs[i].file>=ilkFileCount) ok=FALSE;
+	}
+	for(i=0;ok && (i<ilkComdatCount);++i)
+	{
+		if(ilkComdats[i].file>=ilkFileCount) ok=FALSE;
+	}
+	if(!ok) freeIlk();
+	return ok;
+}
+
+static PINCSYM findIlkSymbol(PCHAR name)
+{
+	UINT i,count;
+	INT j;
+	PINCSYM list;
+
+	count=ilkSymCount;
+	list=ilkSyms;
+	while(count)
+	{
+		i=count/2;
+		j=strcmp(name,list[i].name);
+		if(!j) return list+i;
+		if(j<0)
+		{
+			count=i;
+		}
+		else
+		{
+			list+=i+1;
+			count-=i+1;
+		}
+	}
+	return NULL;
+}
+
+static PINCSEG findIlkComdat(PCHAR name)
+{
+	UINT i,count;
+	INT j;
+	PINCSEG list;
+
+	count=ilkComdatCount;
+	list=ilkComdats;
+	while(count)
+	{
+		i=count/2;
+		j=strcmp(name,list[i].name);
+		if(!j) return list+i;
+		if(j<0)
+		{
+			count=i;
+		}
+		else
+		{
+			list+=i+1;
+			count-=i+1;
+		}
+	}
+	return NULL;
+}
+
+static BOOL isChangedFile(PMODULE mod)
+{
+	UINT i;
+
+	if(!mod) return FALSE;
+	for(i=0;i<ilkFileCount;++i)
+	{
+		if(ilkFiles[i].changed && !strcmp(ilkFiles[i].name,mod->file)) return TRUE;
+	}
+	return FALSE;
+}
+
+/* recompute PE checksum over the whole patched file */
+static BOOL updateChecksum(PFILE f)
+{
+	UINT length,i,sum,peofs;
+	PUCHAR image;
+
+	fseek(f,0,SEEK_END);
+	length=ftell(f);
+	fseek(f,0,SEEK_SET);
+	image=checkMalloc(length);
+	if(fread(image,1,length,f)!=length)
+	{
+		checkFree(image);
+		return FALSE;
+	}
+	peofs=image[PE_SIGNATURE_OFFSET]+(image[PE_SIGNATURE_OFFSET+1]<<8)
+		+(image[PE_SIGNATURE_OFFSET+2]<<16)+(image[PE_SIGNATURE_OFFSET+3]<<24);
+	if((peofs+PE_CHECKSUM+4)>length)
+	{
+		checkFree(image);
+		return FALSE;
+	}
+	Set32(image+peofs+PE_CHECKSUM,0);
+	sum=0;
+	for(i=0;i<length;++i)
+	{
+		sum+=(i&1)?(image[i]<<8):image[i];
+		sum=(sum&0xffff)+(sum>>16);
+	}
+	sum+=length;
+	Set32(image,sum);
+	fseek(f,peofs+PE_CHECKSUM,SEEK_SET);
+	i=(fwrite(image,1,4,f)==4);
+	checkFree(image);
+	return i;
+}
+
+/* patch changed object files into the existing output, FALSE if it can't be done */
+static BOOL patchOutput(PCHAR outname)
+{
+	PPMODULE oldFileNames,newFileNames=NULL;
+	UINT oldFileCount,newFileCount=0;
+	UINT segStart,i,j,k,va,matched,expected;
+	PSEG root,target,s,t;
+	PINCSYM is;
+	PSYMBOL p;
+	PEXTREF e;
+	PRELOC r;
+	PDATABLOCK d;
+	PUCHAR buf;
+	PFILE f;
+	PINCSEG rec;
+	PPINCSEG recMap=NULL;
+	PCOMDATREC c;
+
+	root=createSection("Global",NULL,NULL,NULL,0,1);
+	root->internal=TRUE;
+	root->addressspace=TRUE;
+	root->use32=TRUE;
+	root->base=ilkBase;
+	/* holder for symbols in unchanged modules */
+	target=createSection("incremental",NULL,NULL,NULL,0,1);
+	target->internal=TRUE;
+	target->parent=root;
+
+	/* load just the changed files */
+	for(i=0;i<ilkFileCount;++i)
+	{
+		if(!ilkFiles[i].changed) continue;
+		newFileNames=checkRealloc(newFileNames,(newFileCount+1)*sizeof(PMODULE));
+		newFileNames[newFileCount]=createModule(checkStrdup(ilkFiles[i].name));
+		newFileNames[newFileCount]->fmt=findInputFormat(ilkFiles[i].fmt);
+		newFileCount++;
+	}
+	segStart=globalSegCount;
+	oldFileNames=fileNames;
+	oldFileCount=fileCount;
+	fileNames=newFileNames;
+	fileCount=newFileCount;
+	beginPhase("loadFiles");
+	loadFiles();
+	endPhase();
+	/* loading may have added default libraries to the list */
+	newFileNames=fileNames;
+	fileNames=oldFileNames;
+	fileCount=oldFileCount;
+	checkFree(newFileNames);
+	if(errorCount) return FALSE;
+
+	/* match up segments with their previous placement */
+	i=noteCount;
+	for(j=segStart;j<globalSegCount;++j)
+	{
+		noteSegment(globalSegs[j],0);
+	}
+	recMap=checkMalloc((noteCount-i+1)*sizeof(PINCSEG));
+	for(j=0,k=0;k<ilkSegCount;++k)
+	{
+		if(!ilkFiles[ilkSegs[k].file].changed) continue;
+		if((i+j)>=noteCount)
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: segment %s removed\n",ilkSegs[k].name);
+			return FALSE;
+		}
+		s=noteSegs[i+j];
+		rec=ilkSegs+k;
+		if(strcmp(rec->name,s->name?s->name:"-") || !rec->placed
+		   || (s->combine==SEGF_COMMON) || (s->combine==SEGF_STACK))
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: segment %s changed\n",rec->name);
+			return FALSE;
+		}
+		if((s->length>rec->length) || (getInitLength(s)>rec->initLength))
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: segment %s has outgrown its space\n",rec->name);
+			return FALSE;
+		}
+		if(ilkRelocs && (noteSig[i+j]!=rec->relocSig))
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: base relocations in segment %s changed\n",rec->name);
+			return FALSE;
+		}
+		s->parent=root;
+		s->base=rec->va-ilkBase;
+		invalidateInitLength(s);
+		recMap[j]=rec;
+		j++;
+	}
+	if((i+j)!=noteCount)
+	{
+		diagnostic(DIAG_VERBOSE,"Incremental: segments added\n");
+		return FALSE;
+	}
+	matched=j;
+
+	/* externals resolve to where the previous link put them */
+	for(i=0;i<globalExternCount;++i)
+	{
+		e=globalExterns[i];
+		if(!(is=findIlkSymbol(e->name)))
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: new external %s\n",e->name);
+			return FALSE;
+		}
+		e->pubdef=createSymbol(checkStrdup(e->name),PUB_PUBLIC,NULL,target,is->va-ilkBase,-1,-1);
+	}
+	for(i=0;i<localExternCount;++i)
+	{
+		e=localExterns[i];
+		if(!isChangedFile(e->mod)) continue;
+		if(!e->pubdef || !e->pubdef->seg || (segAddress(e->pubdef->seg,&va)!=root))
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: local symbol %s not placed\n",e->name);
+			return FALSE;
+		}
+	}
+
+	/* publics of changed modules must stay where they were */
+	k=0;
+	for(i=0;i<globalSymbolCount;++i)
+	{
+		p=globalSymbols[i];
+		if(!isChangedFile(p->mod)) continue;
+		switch(p->type)
+		{
+		case PUB_PUBLIC:
+			if(!p->seg || (segAddress(p->seg,&va)!=root)
+			   || !(is=findIlkSymbol(p->name)) || (is->va!=(va+p->ofs))
+			   || (is->file<0) || !ilkFiles[is->file].changed)
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: symbol %s moved\n",p->name);
+				return FALSE;
+			}
+			k++;
+			break;
+		case PUB_COMDEF:
+			if(!(is=findIlkSymbol(p->name)))
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: new common symbol %s\n",p->name);
+				return FALSE;
+			}
+			if(p->length>is->length)
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: common symbol %s has grown\n",p->name);
+				return FALSE;
+			}
+			if((is->file>=0) && ilkFiles[is->file].changed) k++;
+			break;
+		case PUB_COMDAT:
+			/* only pick-any COMDATs can keep whichever instance is already there */
+			for(j=0;j<p->comdatCount;++j)
+			{
+				if(p->comdatList[j]->combine!=COMDAT_ANY) break;
+			}
+			if((j!=p->comdatCount) || !(is=findIlkSymbol(p->name)))
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: COMDAT %s changed\n",p->name);
+				return FALSE;
+			}
+			/* externals already point at an instance from an unchanged module */
+			if((is->file<0) || !ilkFiles[is->file].changed) break;
+			c=p->comdatList[0];
+			s=c->segList[0];
+			rec=findIlkComdat(p->name);
+			if((c->segCount!=1) || !s->mod || strcmp(s->mod->file,ilkFiles[is->file].name)
+			   || !rec || !rec->placed || (rec->va!=is->va))
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: COMDAT %s changed\n",p->name);
+				return FALSE;
+			}
+			if((s->length>rec->length) || (getInitLength(s)>rec->initLength))
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: COMDAT %s has outgrown its space\n",p->name);
+				return FALSE;
+			}
+			if(ilkRelocs && (relocSignature(s)!=rec->relocSig))
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: base relocations in COMDAT %s changed\n",p->name);
+				return FALSE;
+			}
+			s->parent=root;
+			s->base=rec->va-ilkBase;
+			invalidateInitLength(s);
+			p->seg=s;
+			p->ofs=0;
+			addNote(s,rec->file);
+			recMap=checkRealloc(recMap,(matched+1)*sizeof(PINCSEG));
+			recMap[matched]=rec;
+			matched++;
+			k++;
+			break;
+		default:
+			diagnostic(DIAG_VERBOSE,"Incremental: unsupported symbol type for %s\n",p->name);
+			return FALSE;
+		}
+	}
+	expected=0;
+	for(i=0;i<ilkSymCount;++i)
+	{
+		if((ilkSyms[i].file>=0) && ((UINT)ilkSyms[i].file<ilkFileCount) && ilkFiles[ilkSyms[i].file].changed)
+		{
+			expected++;
+		}
+	}
+	if(k!=expected)
+	{
+		diagnostic(DIAG_VERBOSE,"Incremental: public symbols removed\n");
+		return FALSE;
+	}
+	if((globalExportCount!=exportCount) || (globalResourceCount!=resourceCount))
+	{
+		diagnostic(DIAG_VERBOSE,"Incremental: exports or resources in changed files\n");
+		return FALSE;
+	}
+
+	if(gotstart)
+	{
+		t=NULL;
+		va=0;
+		if(startaddr.tseg)
+		{
+			t=segAddress(startaddr.tseg,&va);
+		}
+		else if(startaddr.text && startaddr.text->pubdef && startaddr.text->pubdef->seg)
+		{
+			t=segAddress(startaddr.text->pubdef->seg,&va);
+			va+=startaddr.text->pubdef->ofs;
+		}
+		if((t!=root) || !ilkGotEntry || ((va+startaddr.disp)!=ilkEntry))
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: entry point moved\n");
+			return FALSE;
+		}
+	}
+
+	/* only flat fixups can be reapplied without the rest of the image */
+	for(i=noteCount-matched;i<noteCount;++i)
+	{
+		s=noteSegs[i];
+		for(j=0;j<s->relocCount;++j)
+		{
+			r=s->relocs+j;
+			if((r->base==REL_FRAME) || (r->base==REL_FILEPOS)
+			   || (r->rtype==REL_SEG) || (r->rtype==REL_PTR16) || (r->rtype==REL_PTR32)
+			   || (r->fseg && r->fseg->absolute)
+			   || (r->tseg && (segAddress(r->tseg,&va)!=root)))
+			{
+				diagnostic(DIAG_VERBOSE,"Incremental: unsupported fixup in segment %s\n",s->name);
+				return FALSE;
+			}
+		}
+	}
+
+	beginPhase("performFixups");
+	for(i=noteCount-matched;i<noteCount;++i)
+	{
+		performFixups(noteSegs[i]);
+	}
+	endPhase();
+	if(errorCount) return FALSE;
+
+	beginPhase("writeSeg");
+	f=fopen(outname,"r+b");
+	if(!f) return FALSE;
+	for(i=0;i<matched;++i)
+	{
+		s=noteSegs[noteCount-matched+i];
+		rec=recMap[i];
+		if(!rec->initLength) continue;
+		buf=checkMalloc(rec->initLength);
+		memset(buf,rec->code?0xcc:0,rec->initLength);
+		for(j=0;j<s->contentCount;++j)
+		{
+			if(s->contentList[j].flag!=DATA) continue;
+			d=s->contentList[j].data;
+			if(!isZeroBlock(d))
+			{
+				copyDataBlock(d,buf+d->offset);
+			}
+			else if(d->offset<rec->initLength)
+			{
+				/* zero-filled, and possibly cut short by the initialised length */
+				memset(buf+d->offset,0,((d->offset+d->length)>rec->initLength)?(rec->initLength-d->offset):d->length);
+			}
+		}
+		fseek(f,rec->filepos,SEEK_SET);
+		k=fwrite(buf,1,rec->initLength,f);
+		checkFree(buf);
+		if(k!=rec->initLength)
+		{
+			fclose(f);
+			return FALSE;
+		}
+	}
+	if(!updateChecksum(f))
+	{
+		fclose(f);
+		return FALSE;
+	}
+	fclose(f);
+	endPhase();
+	checkFree(recMap);
+
+	for(i=0;i<ilkFileCount;++i)
+	{
+		if(!ilkFiles[i].changed) continue;
+		getFileStamp(ilkFiles[i].name,&ilkFiles[i].stamp);
+	}
+	getFileStamp(outname,&ilkOut);
+	writeIlk(outname);
+	diagnostic(DIAG_BASIC,"Incremental link updated %lu segments\n",matched);
+	return TRUE;
+}
+
+/* try to bring output up to date without a full link, TRUE if done */
+BOOL incrementalRelink(PSWITCHPARAM sp,PCHAR outname)
+{
+	UINT i,changed;
+	FILESTAMP stamp;
+	UINT segCount,symCount,extCount,locExtCount,locSymCount,modCount;
+	PPSYMBOL symbols;
+	BOOL start;
+	RELOC entry;
+
+	argsHash=hashArgs(sp);
+	if(!readIlk(outname))
+	{
+		diagnostic(DIAG_VERBOSE,"Incremental: no previous link, doing full link\n");
+		return FALSE;
+	}
+	if((ilkArgs!=argsHash) || !getFileStamp(outname,&stamp) || !sameFileStamp(&stamp,&ilkOut))
+	{
+		diagnostic(DIAG_VERBOSE,"Incremental: options or output changed, doing full link\n");
+		freeIlk();
+		return FALSE;
+	}
+	changed=0;
+	for(i=0;i<ilkFileCount;++i)
+	{
+		if(!getFileStamp(ilkFiles[i].name,&stamp))
+		{
+			freeIlk();
+			return FALSE;
+		}
+		if(sameFileStamp(&stamp,&ilkFiles[i].stamp)) continue;
+		if(!isObjectFormat(findInputFormat(ilkFiles[i].fmt)))
+		{
+			diagnostic(DIAG_VERBOSE,"Incremental: %s changed, doing full link\n",ilkFiles[i].name);
+			freeIlk();
+			return FALSE;
+		}
+		ilkFiles[i].changed=TRUE;
+		changed++;
+	}
+	if(!changed)
+	{
+		diagnostic(DIAG_BASIC,"%s is up to date\n",outname);
+		freeIlk();
+		return TRUE;
+	}
+
+	/* remember state, so a failed attempt can be undone before the full link */
+	segCount=globalSegCount;
+	extCount=globalExternCount;
+	locExtCount=localExternCount;
+	locSymCount=localSymbolCount;
+	modCount=moduleCount;
+	symCount=globalSymbolCount;
+	symbols=checkMalloc((symCount+1)*sizeof(PSYMBOL));
+	if(symCount) memcpy(symbols,globalSymbols,symCount*sizeof(PSYMBOL));
+	start=gotstart;
+	entry=startaddr;
+	exportCount=globalExportCount;
+	resourceCount=globalResourceCount;
+
+	if(patchOutput(outname))
+	{
+		checkFree(symbols);
+		freeIlk();
+		return TRUE;
+	}
+
+	diagnostic(DIAG_VERBOSE,"Incremental: doing full link\n");
+	globalSegCount=segCount;
+	globalExternCount=extCount;
+	for(i=0;i<extCount;++i)
+	{
+		globalExterns[i]->pubdef=NULL;
+	}
+	localExternCount=locExtCount;
+	localSymbolCount=locSymCount;
+	moduleCount=modCount;
+	globalSymbolCount=symCount;
+	if(symCount) memcpy(globalSymbols,symbols,symCount*sizeof(PSYMBOL));
+	checkFree(symbols);
+	gotstart=start;
+	startaddr=entry;
+	globalExportCount=exportCount;
+	globalResourceCount=resourceCount;
+	noteCount=0;
+	while(errorCount)
+	{
+		checkFree(errorList[--errorCount]);
+	}
+	freeIlk();
+	return FALSE;
+}
@@ -0,0 +1,426 @@
+#include "alink.h"
+
+#include <sys/stat.h>
+#ifdef GOT_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* parsed library dictionaries, kept between links by the link server */
+BOOL libCacheEnabled=FALSE;
+/* keep dictionaries in index files beside the libraries */
+BOOL libIndexFiles=FALSE;
+
+static PPLIBINDEX libCache=NULL;
+static UINT libCacheCount=0;
+
+/* index file layout, all values little-endian 32-bit:                */
+/*   magic, then header words of version, type, library size, mtime, */
+/*   flags, count, longnames length, names length and mtime nanoseconds */
+/*   count entries of name offset and member file position           */
+/*   longnames, then NUL terminated names                            */
+#define INDEX_EXT ".aix"
+#define INDEX_MAGIC "ALNKLIDX"
+#define INDEX_VERSION 2
+#define INDEX_WORD(n) (8+(n)*4)
+#define INDEX_HEADER INDEX_WORD(9)
+#define INDEX_ENTRY 8
+
+static UINT get32(PUCHAR buf)
+{
+	return buf[0]+(buf[1]<<8)+(buf[2]<<16)+((UINT)buf[3]<<24);
+}
+
+PLIBINDEX createLibIndex(PCHAR file,UINT type)
+{
+	PLIBINDEX idx;
+
+	idx=checkMalloc(sizeof(LIBINDEX));
+	idx->file=checkStrdup(file);
+	idx->type=type;
+	if(!getFileStamp(file,&idx->stamp))
+	{
+		memset(&idx->stamp,0,sizeof(FILESTAMP));
+	}
+	idx->flags=0;
+	idx->count=0;
+	idx->names=NULL;
+	idx->filepos=NULL;
+	idx->longnames=NULL;
+	idx->longnamesLength=0;
+	idx->image=NULL;
+	idx->imageLength=0;
+	idx->mapped=FALSE;
+	return idx;
+}
+
+void addLibIndexSymbol(PLIBINDEX idx,PCHAR name,UINT filepos)
+{
+	/* grow in chunks, dictionaries can be large */
+	if(!(idx->count&0xff))
+	{
+		idx->names=checkRealloc(idx->names,(idx->count+0x100)*sizeof(PCHAR));
+		idx->filepos=checkRealloc(idx->filepos,(idx->count+0x100)*sizeof(UINT));
+	}
+	idx->names[idx->count]=name;
+	idx->filepos[idx->count]=filepos;
+	idx->count++;
+}
+
+void freeLibIndex(PLIBINDEX idx)
+{
+	UINT i;
+
+	if(!idx) return;
+	if(idx->image)
+	{
+		/* names and longnames point into the image */
+#ifdef GOT_MMAP
+		if(idx->mapped)
+		{
+			munmap(idx->image,idx->imageLength);
+		}
+		else
+#endif
+		{
+			checkFree(idx->image);
+		}
+	}
+	else
+	{
+		for(i=0;i<idx->count;++i)
+		{
+			checkFree(idx->names[i]);
+		}
+		checkFree(idx->longnames);
+	}
+	checkFree(idx->names);
+	checkFree(idx->filepos);
+	checkFree(idx->file);
+	checkFree(idx);
+}
+
+/* add library symbols for every entry in the index */
+BOOL useLibIndex(PLIBINDEX idx,PMODULE mod,PLOADFUNC modload)
+{
+	UINT i;
+
+	if(idx->longnamesLength)
+	{
+		mod->formatSpecificData=checkMalloc(idx->longnamesLength);
+		memcpy(mod->formatSpecificData,idx->longnames,idx->longnamesLength);
+	}
+	for(i=0;i<idx->count;++i)
+	{
+		addGlobalSymbol(createSymbol(checkStrdup(idx->names[i]),PUB_LIBSYM,mod,idx->filepos[i],modload));
+	}
+	if(fingerprint)
+	{
+		fingerprintNoteLibrary(idx,mod);
+	}
+	return TRUE;
+}
+
+static PCHAR indexFileName(PCHAR file)
+{
+	PCHAR name;
+
+	name=checkMalloc(strlen(file)+strlen(INDEX_EXT)+1);
+	strcpy(name,file);
+	strcat(name,INDEX_EXT);
+	return name;
+}
+
+/* read whole index file, mapping it where possible */
+static PUCHAR readIndexImage(PCHAR name,UINT *length,BOOL *mapped)
+{
+	PUCHAR image;
+	PFILE f;
+	struct stat st;
+#ifdef GOT_MMAP
+	int fd;
+#endif
+
+	if(stat(name,&st) || (st.st_size<INDEX_HEADER)) return NULL;
+	*length=st.st_size;
+#ifdef GOT_MMAP
+	fd=open(name,O_RDONLY);
+	if(fd>=0)
+	{
+		image=mmap(NULL,*length,PROT_READ,MAP_PRIVATE,fd,0);
+		close(fd);
+		if(image!=MAP_FAILED)
+		{
+			*mapped=TRUE;
+			return image;
+		}
+	}
+#endif
+	*mapped=FALSE;
+	f=fopen(name,"rb");
+	if(!f) return NULL;
+	image=checkMalloc(*length);
+	if(fread(image,1,*length,f)!=*length)
+	{
+		checkFree(image);
+		image=NULL;
+	}
+	fclose(f);
+	return image;
+}
+
+/* load index file for a library, if one exists and is up to date */
+static PLIBINDEX loadLibIndexFile(PCHAR file,UINT type)
+{
+	PCHAR name;
+	PUCHAR image,names;
+	UINT length,count,longnamesLength,namesLength,i,ofs;
+	BOOL mapped;
+	PLIBINDEX idx;
+
+	name=indexFileName(file);
+	image=readIndexImage(name,&length,&mapped);
+	if(!image)
+	{
+		checkFree(name);
+		return NULL;
+	}
+	idx=createLibIndex(file,type);
+	idx->image=image;
+	idx->imageLength=length;
+	idx->mapped=mapped;
+
+	count=get32(image+INDEX_WORD(5));
+	longnamesLength=get32(image+INDEX_WORD(6));
+	namesLength=get32(image+INDEX_WORD(7));
+	if(memcmp(image,INDEX_MAGIC,8) || (get32(image+INDEX_WORD(0))!=INDEX_VERSION)
+	   || (get32(image+INDEX_WORD(1))!=type)
+	   || (get32(image+INDEX_WORD(2))!=idx->stamp.size)
+	   || (get32(image+INDEX_WORD(3))!=idx->stamp.mtime)
+	   || (get32(image+INDEX_WORD(8))!=idx->stamp.mtimeNsec)
+	   || (count>((length-INDEX_HEADER)/INDEX_ENTRY))
+	   || (longnamesLength>length) || (namesLength>length)
+	   || (length!=(INDEX_HEADER+count*INDEX_ENTRY+longnamesLength+namesLength))
+	   || (namesLength && image[length-1]))
+	{
+		diagnostic(DIAG_VERBOSE,"Ignoring out of date index %s\n",name);
+		freeLibIndex(idx);
+		checkFree(name);
+		return NULL;
+	}
+	idx->flags=get32(image+INDEX_WORD(4));
+	idx->longnamesLength=longnamesLength;
+	if(longnamesLength)
+	{
+		idx->longnames=image+INDEX_HEADER+count*INDEX_ENTRY;
+	}
+	names=image+INDEX_HEADER+count*INDEX_ENTRY+longnamesLength;
+	if(count)
+	{
+		idx->names=checkMalloc(count*sizeof(PCHAR));
+		idx->filepos=checkMalloc(count*sizeof(UINT));
+	}
+	for(i=0;i<count;++i)
+	{
+		ofs=get32(image+INDEX_HEADER+i*INDEX_ENTRY);
+		if(ofs>=namesLength)
+		{
+			diagnostic(DIAG_VERBOSE,"Ignoring corrupt index %s\n",name);
+			freeLibIndex(idx);
+			checkFree(name);
+			return NULL;
+		}
+		idx->names[i]=names+ofs;
+		idx->filepos[i]=get32(image+INDEX_HEADER+i*INDEX_ENTRY+4);
+	}
+	idx->count=count;
+	diagnostic(DIAG_VERBOSE,"Using index file %s\n",name);
+	checkFree(name);
+	return idx;
+}
+
+/* write index file for a library, failure just means no index next time */
+static void saveLibIndexFile(PLIBINDEX idx)
+{
+	PCHAR name,tmpname;
+	PFILE f;
+	UCHAR buf[INDEX_HEADER];
+	UINT i,len,namesLength;
+	BOOL ok;
+
+	namesLength=0;
+	for(i=0;i<idx->count;++i)
+	{
+		namesLength+=strlen(idx->names[i])+1;
+	}
+	name=indexFileName(idx->file);
+	tmpname=checkMalloc(strlen(name)+5);
+	sprintf(tmpname,"%s.tmp",name);
+	f=fopen(tmpname,"wb");
+	if(!f)
+	{
+		diagnostic(DIAG_VERBOSE,"Unable to write index %s\n",name);
+		checkFree(tmpname);
+		checkFree(name);
+		return;
+	}
+
+	memcpy(buf,INDEX_MAGIC,8);
+	Set32(buf+INDEX_WORD(0),INDEX_VERSION);
+	Set32(buf+INDEX_WORD(1),idx->type);
+	Set32(buf+INDEX_WORD(2),idx->stamp.size);
+	Set32(buf+INDEX_WORD(3),idx->stamp.mtime);
+	Set32(buf+INDEX_WORD(4),idx->flags);
+	Set32(buf+INDEX_WORD(5),idx->count);
+	Set32(buf+INDEX_WORD(6),idx->longnamesLength);
+	Set32(buf+INDEX_WORD(7),namesLength);
+	Set32(buf+INDEX_WORD(8),idx->stamp.mtimeNsec);
+	ok=(fwrite(buf,1,INDEX_HEADER,f)==INDEX_HEADER);
+
+	namesLength=0;
+	for(i=0;ok && (i<idx->count);++i)
+	{
+		Set32(buf,namesLength);
+		Set32(buf+4,idx->filepos[i]);
+		ok=(fwrite(buf,1,INDEX_ENTRY,f)==INDEX_ENTRY);
+		namesLength+=strlen(idx->names[i])+1;
+	}
+	if(ok && idx->longnamesLength)
+	{
+		ok=(fwrite(idx->longnames,1,idx->longnamesLength,f)==idx->longnamesLength);
+	}
+	for(i=0;ok && (i<idx->count);++i)
+	{
+		len=strlen(idx->names[i])+1;
+		ok=(fwrite(idx->names[i],1,len,f)==len);
+	}
+	if(fclose(f)) ok=FALSE;
+
+	/* replace any old index in one step, so readers never see half an index */
+	if(ok && rename(tmpname,name))
+	{
+		remove(name);
+		ok=!rename(tmpname,name);
+	}
+	if(!ok)
+	{
+		diagnostic(DIAG_VERBOSE,"Unable to write index %s\n",name);
+		remove(tmpname);
+	}
+	checkFree(tmpname);
+	checkFree(name);
+}
+
+/* get cached index for a library, provided the file hasn't changed since */
+PLIBINDEX findLibIndex(PCHAR file)
+{
+	UINT i;
+	FILESTAMP stamp;
+	PCHAR path;
+
+	if(!libCacheCount) return NULL;
+	path=getFullPath(file);
+	for(i=0;i<libCacheCount;++i)
+	{
+		if(!strcmp(libCache[i]->file,path)) break;
+	}
+	checkFree(path);
+	if(i==libCacheCount) return NULL;
+	if(!getFileStamp(file,&stamp) || !sameFileStamp(&stamp,&libCache[i]->stamp)) return NULL;
+	diagnostic(DIAG_VERBOSE,"Using cached index for %s\n",file);
+	return libCache[i];
+}
+
+/* get index for a library from the cache, an index file or the library itself */
+PLIBINDEX getLibIndex(PFILE f,PCHAR file,UINT type,PLIBREADFUNC readIndex,BOOL *cached)
+{
+	PLIBINDEX idx;
+
+	if((idx=findLibIndex(file)))
+	{
+		*cached=TRUE;
+		return idx;
+	}
+	*cached=FALSE;
+	if(libIndexFiles && (idx=loadLibIndexFile(file,type)))
+	{
+		return idx;
+	}
+	idx=(*readIndex)(f,file);
+	if(idx && libIndexFiles)
+	{
+		saveLibIndexFile(idx);
+	}
+	return idx;
+}
+
+/* finished with a freshly read index, keep it if caching */
+void releaseLibIndex(PLIBINDEX idx)
+{
+	UINT i;
+	PCHAR path;
+
+	if(!idx) return;
+	serverNoteLibrary(idx->file);
+	if(!libCacheEnabled)
+	{
+		freeLibIndex(idx);
+		return;
+	}
+	path=getFullPath(idx->file);
+	checkFree(idx->file);
+	idx->file=path;
+	for(i=0;i<libCacheCount;++i)
+	{
+		if(!strcmp(libCache[i]->file,path))
+		{
+			freeLibIndex(libCache[i]);
+			libCache[i]=idx;
+			return;
+		}
+	}
+	libCache=checkRealloc(libCache,(libCacheCount+1)*sizeof(PLIBINDEX));
+	libCache[libCacheCount]=idx;
+	libCacheCount++;
+}
+
+/* read the index of a library of either type */
+PLIBINDEX openLibIndex(PCHAR file,BOOL *cached)
+{
+	PFILE f;
+	PLIBINDEX idx=NULL;
+
+	f=fopen(file,"rb");
+	if(!f) return NULL;
+	if(OMFLibDetect(f,file))
+	{
+		fseek(f,0,SEEK_SET);
+		idx=getLibIndex(f,file,LIBINDEX_OMF,OMFLibReadIndex,cached);
+	}
+	else
+	{
+		fseek(f,0,SEEK_SET);
+		if(COFFLibDetect(f,file))
+		{
+			fseek(f,0,SEEK_SET);
+			idx=getLibIndex(f,file,LIBINDEX_COFF,COFFLibReadIndex,cached);
+		}
+	}
+	fclose(f);
+	return idx;
+}
+
+/* read a library's index straight into the cache */
+BOOL cacheLibrary(PCHAR file)
+{
+	PLIBINDEX idx;
+	BOOL cached;
+
+	if(findLibIndex(file)) return TRUE;
+	idx=openLibIndex(file,&cached);
+	if(!idx) return FALSE;
+	diagnostic(DIAG_VERBOSE,"Cached index of %s, %li symbols\n",file,idx->count);
+	releaseLibIndex(idx);
+	return TRUE;
+}
@@ -0,0 +1,869 @@
+#include "alink.h"
+#include "omf.h"
+#include "coff.h"
+
+/* librarian: the input objects are copied into an OMF library or COFF */
+/* archive, with a dictionary built from the publics each one defines */
+
+#define OMF_DICBUCKETS 37
+#define OMF_DICBLOCK 512
+
+typedef struct libmember
+{
+	PCHAR name;
+	PUCHAR image; /* file contents, owned by first module of a file */
+	PUCHAR data;
+	UINT length;
+	PPCHAR syms;
+	PUCHAR strong; /* per symbol, FALSE for COMDATs and communals */
+	UINT symCount;
+} LIBMEMBER,*PLIBMEMBER;
+
+typedef struct archsym
+{
+	PCHAR name;
+	UINT member;
+} ARCHSYM,*PARCHSYM;
+
+BOOL libraryOutput=FALSE;
+
+static PLIBMEMBER members;
+static UINT memberCount;
+static PPCHAR omfNames;
+static UINT omfNameCount;
+
+BOOL OMFLibInitialise(PSWITCHPARAM sp)
+{
+	libraryOutput=TRUE;
+	return TRUE;
+}
+
+BOOL COFFLibInitialise(PSWITCHPARAM sp)
+{
+	libraryOutput=TRUE;
+	return TRUE;
+}
+
+static PLIBMEMBER addMember(PCHAR name,PUCHAR data,UINT length)
+{
+	PLIBMEMBER m;
+
+	members=checkRealloc(members,(memberCount+1)*sizeof(LIBMEMBER));
+	m=members+memberCount;
+	memberCount++;
+	m->name=name;
+	m->image=NULL;
+	m->data=data;
+	m->length=length;
+	m->syms=NULL;
+	m->strong=NULL;
+	m->symCount=0;
+	return m;
+}
+
+static void addMemberSymbol(PLIBMEMBER m,PCHAR name,BOOL strong)
+{
+	UINT i;
+
+	for(i=0;i<m->symCount;++i)
+	{
+		if(!strcmp(m->syms[i],name))
+		{
+			if(strong) m->strong[i]=TRUE;
+			checkFree(name);
+			return;
+		}
+	}
+	m->syms=checkRealloc(m->syms,(m->symCount+1)*sizeof(PCHAR));
+	m->strong=checkRealloc(m->strong,m->symCount+1);
+	m->syms[m->symCount]=name;
+	m->strong[m->symCount]=strong;
+	m->symCount++;
+}
+
+static PCHAR getCountedName(PUCHAR p)
+{
+	PCHAR name;
+
+	name=checkMalloc(p[0]+1);
+	memcpy(name,p+1,p[0]);
+	name[p[0]]=0;
+	return name;
+}
+
+static UINT getOMFIndex(PUCHAR p,UINT *j)
+{
+	UINT i;
+
+	i=p[*j];
+	(*j)++;
+	if(i&0x80)
+	{
+		i=((i&0x7f)<<8)+p[*j];
+		(*j)++;
+	}
+	return i;
+}
+
+static void skipCommunalLength(PUCHAR p,UINT *j)
+{
+	switch(p[*j])
+	{
+	case 0x81:
+		*j+=3;
+		break;
+	case 0x84:
+		*j+=4;
+		break;
+	case 0x88:
+		*j+=5;
+		break;
+	default:
+		*j+=1;
+		break;
+	}
+}
+
+/* OMF dictionaries keep names in upper case unless the library is case sensitive */
+static void addOMFSymbol(PLIBMEMBER m,PCHAR name,BOOL strong)
+{
+	if(!case_sensitive) strupr(name);
+	addMemberSymbol(m,name,strong);
+}
+
+/* publics from one OMF record */
+static BOOL scanOMFRecord(PLIBMEMBER m,UINT type,PUCHAR rec,UINT len)
+{
+	UINT j,flags,attr;
+
+	switch(type)
+	{
+	case LNAMES:
+	case LLNAMES:
+		for(j=0;j<len;j+=rec[j]+1)
+		{
+			omfNames=checkRealloc(omfNames,(omfNameCount+1)*sizeof(PCHAR));
+			omfNames[omfNameCount]=getCountedName(rec+j);
+			omfNameCount++;
+		}
+		break;
+	case PUBDEF:
+	case PUBDEF32:
+		j=0;
+		getOMFIndex(rec,&j);
+		if(!getOMFIndex(rec,&j)) j+=2; /* frame number */
+		while(j<len)
+		{
+			addOMFSymbol(m,getCountedName(rec+j),TRUE);
+			j+=rec[j]+1;
+			j+=(type==PUBDEF32)?4:2;
+			getOMFIndex(rec,&j);
+		}
+		break;
+	case COMDEF:
+		for(j=0;j<len;)
+		{
+			addOMFSymbol(m,getCountedName(rec+j),FALSE);
+			j+=rec[j]+1;
+			getOMFIndex(rec,&j);
+			switch(rec[j++])
+			{
+			case 0x61:
+				skipCommunalLength(rec,&j);
+				skipCommunalLength(rec,&j);
+				break;
+			case 0x62:
+				skipCommunalLength(rec,&j);
+				break;
+			default:
+				addError("Unknown COMDEF data type %02X in %s",rec[j-1],m->name);
+				return FALSE;
+			}
+		}
+		break;
+	case ALIAS:
+		for(j=0;j<len;)
+		{
+			addOMFSymbol(m,getCountedName(rec+j),TRUE);
+			j+=rec[j]+1;
+			j+=rec[j]+1; /* substitute name */
+		}
+		break;
+	case COMDAT:
+	case COMDAT32:
+		flags=rec[0];
+		attr=rec[1];
+		j=3;
+		j+=(type==COMDAT32)?4:2;
+		getOMFIndex(rec,&j);
+		if(!(attr&0xf))
+		{
+			getOMFIndex(rec,&j);
+			if(!getOMFIndex(rec,&j)) j+=2;
+		}
+		j=getOMFIndex(rec,&j);
+		if(flags&COMDAT_LOCAL) break;
+		if(!j || (j>omfNameCount))
+		{
+			addError("Bad COMDAT name in %s",m->name);
+			return FALSE;
+		}
+		addOMFSymbol(m,checkStrdup(omfNames[j-1]),FALSE);
+		break;
+	}
+	return TRUE;
+}
+
+/* split an OMF object into modules, collecting the publics of each */
+static BOOL scanOMFFile(PCHAR file,PUCHAR data,UINT length)
+{
+	UINT pos,start,type,len,i;
+	PLIBMEMBER m;
+
+	pos=0;
+	while(pos<length)
+	{
+		if((data[pos]!=THEADR) && (data[pos]!=LHEADR))
+		{
+			/* allow padding after the last module */
+			for(i=pos;(i<length) && !data[i];++i);
+			if(i==length) break;
+			addError("Invalid OMF module in %s",file);
+			return FALSE;
+		}
+		start=pos;
+		m=addMember(file,NULL,0);
+		omfNames=NULL;
+		omfNameCount=0;
+		do
+		{
+			if(pos+3>length)
+			{
+				addError("Truncated OMF module in %s",file);
+				return FALSE;
+			}
+			type=data[pos];
+			len=data[pos+1]+256*data[pos+2];
+			if(!len || (pos+3+len>length))
+			{
+				addError("Truncated OMF module in %s",file);
+				return FALSE;
+			}
+			/* ignore checksum */
+			if(!scanOMFRecord(m,type,data+pos+3,len-1)) return FALSE;
+			pos+=3+len;
+		}
+		while((type!=MODEND) && (type!=MODEND32));
+		if(!start) m->image=data;
+		m->data=data+start;
+		m->length=pos-start;
+		for(i=0;i<omfNameCount;++i)
+		{
+			checkFree(omfNames[i]);
+		}
+		checkFree(omfNames);
+	}
+	if(!pos)
+	{
+		addError("No modules in %s",file);
+		checkFree(data);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* collect the publics of a COFF object or short import */
+static BOOL scanCOFFFile(PCHAR file,PUCHAR data,UINT length)
+{
+	UINT i,symPtr,numSyms,strPtr,ofs,sectPtr,numSects;
+	PUCHAR p,q;
+	PCHAR name;
+	PLIBMEMBER m;
+	INT section;
+	BOOL strong;
+
+	m=addMember(file,data,length);
+	m->image=data;
+	if(!data[0] && !data[1] && (data[2]==0xff) && (data[3]==0xff))
+	{
+		/* short import, defines the symbol and its import pointer */
+		if((length<21) || data[length-1])
+		{
+			addError("Invalid import entry %s",file);
+			return FALSE;
+		}
+		name=checkStrdup(data+20);
+		addMemberSymbol(m,name,TRUE);
+		name=checkMalloc(strlen(data+20)+7);
+		sprintf(name,"__imp_%s",data+20);
+		addMemberSymbol(m,name,TRUE);
+		return TRUE;
+	}
+	symPtr=data[COFF_SYMBOLPTR]+(data[COFF_SYMBOLPTR+1]<<8)+
+		(data[COFF_SYMBOLPTR+2]<<16)+(data[COFF_SYMBOLPTR+3]<<24);
+	numSyms=data[COFF_NUMSYMBOLS]+(data[COFF_NUMSYMBOLS+1]<<8)+
+		(data[COFF_NUMSYMBOLS+2]<<16)+(data[COFF_NUMSYMBOLS+3]<<24);
+	if(!symPtr || !numSyms) return TRUE;
+	sectPtr=COFF_BASE_HEADER_SIZE+data[COFF_HDRSIZE]+256*data[COFF_HDRSIZE+1];
+	numSects=data[COFF_NUMOBJECTS]+256*data[COFF_NUMOBJECTS+1];
+	strPtr=symPtr+numSyms*COFF_SYMBOL_SIZE;
+	if((symPtr>length) || (numSyms>(length-symPtr)/COFF_SYMBOL_SIZE))
+	{
+		addError("Invalid symbol table in %s",file);
+		return FALSE;
+	}
+	for(i=0;i<numSyms;i+=1+p[COFF_SYMBOL_NUMAUX])
+	{
+		p=data+symPtr+i*COFF_SYMBOL_SIZE;
+		if(p[COFF_SYMBOL_STORAGE]!=COFF_SYM_EXTERNAL) continue;
+		section=(SHORT)(p[COFF_SYMBOL_SECTION]+256*p[COFF_SYMBOL_SECTION+1]);
+		/* undefined externs have no section and no common size */
+		if(!section && !(p[COFF_SYMBOL_VALUE]|p[COFF_SYMBOL_VALUE+1]|
+				 p[COFF_SYMBOL_VALUE+2]|p[COFF_SYMBOL_VALUE+3]))
+		{
+			continue;
+		}
+		/* commons and COMDATs are expected to turn up in several members */
+		strong=(section!=0);
+		if((section>0) && ((UINT)section<=numSects)
+			&& (sectPtr+section*COFF_OBJECTENTRY_SIZE<=length))
+		{
+			q=data+sectPtr+(section-1)*COFF_OBJECTENTRY_SIZE+COFF_OBJECT_FLAGS;
+			if((q[0]+(q[1]<<8)+(q[2]<<16)+((UINT)q[3]<<24))&WINF_COMDAT) strong=FALSE;
+		}
+		if(p[0]|p[1]|p[2]|p[3])
+		{
+			name=checkMalloc(9);
+			memcpy(name,p,8);
+			name[8]=0;
+		}
+		else
+		{
+			ofs=strPtr+p[4]+(p[5]<<8)+(p[6]<<16)+(p[7]<<24);
+			if((ofs>=length) || !memchr(data+ofs,0,length-ofs))
+			{
+				addError("Invalid symbol name in %s",file);
+				return FALSE;
+			}
+			name=checkStrdup(data+ofs);
+		}
+		addMemberSymbol(m,name,strong);
+	}
+	return TRUE;
+}
+
+static PUCHAR readWholeFile(PCHAR file,UINT *length)
+{
+	PFILE f;
+	PUCHAR data;
+
+	f=fopen(file,"rb");
+	if(!f)
+	{
+		addError("Unable to open file %s",file);
+		return NULL;
+	}
+	fseek(f,0,SEEK_END);
+	*length=ftell(f);
+	fseek(f,0,SEEK_SET);
+	data=checkMalloc(*length+1);
+	if(fread(data,1,*length,f)!=*length)
+	{
+		addError("Error reading from file %s",file);
+		checkFree(data);
+		data=NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+/* load input objects of the kind the library holds */
+static BOOL readMembers(BOOL coff)
+{
+	UINT i,length,machine;
+	PUCHAR data;
+	PCHAR file;
+	BOOL ok;
+
+	members=NULL;
+	memberCount=0;
+	for(i=0;i<fileCount;++i)
+	{
+		file=fileNames[i]->file;
+		if(!(data=readWholeFile(file,&length))) return FALSE;
+		if(coff)
+		{
+			ok=(length>=COFF_BASE_HEADER_SIZE);
+			if(ok)
+			{
+				machine=data[COFF_MACHINEID]+256*data[COFF_MACHINEID+1];
+				ok=((machine>=0x14c) && (machine<=0x14e))
+					|| (!machine && (data[2]==0xff) && (data[3]==0xff));
+			}
+			if(ok) fileNames[i]->fmt=findInputFormat("mscoff");
+		}
+		else
+		{
+			ok=length && ((data[0]==THEADR) || (data[0]==LHEADR));
+			if(ok) fileNames[i]->fmt=findInputFormat("omf");
+		}
+		if(!ok)
+		{
+			addError("%s is not %s object file",file,coff?"an MS COFF":"an OMF");
+			checkFree(data);
+			return FALSE;
+		}
+		if(coff)
+			ok=scanCOFFFile(file,data,length);
+		else
+			ok=scanOMFFile(file,data,length);
+		if(!ok) return FALSE;
+	}
+	return TRUE;
+}
+
+/* first definition wins, as it would when linking the objects in order */
+/* only duplicate publics are worth a warning, COMDATs are meant to repeat */
+static void dropDuplicateSymbols(void)
+{
+	UINT i,j,k,l;
+	PCHAR name;
+
+	for(i=1;i<memberCount;++i)
+	{
+		for(j=0;j<members[i].symCount;)
+		{
+			name=members[i].syms[j];
+			for(k=0;k<i;++k)
+			{
+				for(l=0;l<members[k].symCount;++l)
+				{
+					if(!strcmp(members[k].syms[l],name)) break;
+				}
+				if(l<members[k].symCount) break;
+			}
+			if(k==i)
+			{
+				++j;
+				continue;
+			}
+			if(members[k].strong[l] && members[i].strong[j])
+			{
+				diagnostic(DIAG_BASIC,"Warning: %s defined in %s and %s, keeping first\n",name,members[k].name,members[i].name);
+			}
+			checkFree(name);
+			members[i].symCount--;
+			members[i].syms[j]=members[i].syms[members[i].symCount];
+			members[i].strong[j]=members[i].strong[members[i].symCount];
+		}
+	}
+}
+
+static void freeMembers(void)
+{
+	UINT i,j;
+
+	for(i=0;i<memberCount;++i)
+	{
+		for(j=0;j<members[i].symCount;++j)
+		{
+			checkFree(members[i].syms[j]);
+		}
+		checkFree(members[i].syms);
+		checkFree(members[i].strong);
+		if(members[i].image) checkFree(members[i].image);
+	}
+	checkFree(members);
+	members=NULL;
+	memberCount=0;
+}
+
+/* hand the finished image to the output writer */
+static void setLibraryImage(PDATABLOCK d)
+{
+	PSEG a;
+
+	a=createSection("Global",NULL,NULL,NULL,0,1);
+	a->internal=TRUE;
+	a->addressspace=TRUE;
+	a->use32=TRUE; /* a file image, not a 16-bit segment */
+	addData(a,d);
+	spaceCount=1;
+	spaceList=checkMalloc(sizeof(PSEG));
+	spaceList[0]=a;
+}
+
+/****************************************************************************/
+/* OMF libraries */
+
+/* dictionary hash, as specified for OMF libraries */
+static void omfHash(PCHAR name,UINT blocks,UINT *blockIndex,UINT *blockDelta,UINT *bucketIndex,UINT *bucketDelta)
+{
+	UINT len=strlen(name);
+	PUCHAR pb=(PUCHAR)name-1,pe=(PUCHAR)name+len-1;
+	USHORT bx,bd,kx,kd,c;
+
+	bx=len|0x20;
+	kd=len|0x20;
+	bd=0;
+	kx=0;
+	while(TRUE)
+	{
+		c=*pe--|0x20;
+		kx=((kx>>2)|(kx<<14))^c;
+		bd=((bd<<2)|(bd>>14))^c;
+		if(!--len) break;
+		c=*++pb|0x20;
+		bx=((bx<<2)|(bx>>14))^c;
+		kd=((kd>>2)|(kd<<14))^c;
+	}
+	*blockIndex=bx%blocks;
+	*blockDelta=bd%blocks;
+	if(!*blockDelta) *blockDelta=1;
+	*bucketIndex=kx%OMF_DICBUCKETS;
+	*bucketDelta=kd%OMF_DICBUCKETS;
+	if(!*bucketDelta) *bucketDelta=1;
+}
+
+static BOOL isPrime(UINT n)
+{
+	UINT i;
+
+	if(n<2) return FALSE;
+	for(i=2;i*i<=n;++i)
+	{
+		if(!(n%i)) return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL dictionaryInsert(PUCHAR dic,UINT blocks,PCHAR name,UINT page)
+{
+	UINT bx,bd,kx,kd;
+	UINT i,j,k,len,size;
+	PUCHAR blk;
+
+	omfHash(name,blocks,&bx,&bd,&kx,&kd);
+	len=strlen(name);
+	size=(len+4)&~1UL;
+	for(i=0;i<blocks;++i,bx=(bx+bd)%blocks)
+	{
+		blk=dic+OMF_DICBLOCK*bx;
+		for(j=0,k=kx;j<OMF_DICBUCKETS;++j,k=(k+kd)%OMF_DICBUCKETS)
+		{
+			if(blk[k]) continue;
+			if((blk[OMF_DICBUCKETS]==0xff) || (2*blk[OMF_DICBUCKETS]+size>OMF_DICBLOCK))
+			{
+				blk[OMF_DICBUCKETS]=0xff; /* block full */
+				break;
+			}
+			blk[k]=blk[OMF_DICBUCKETS];
+			blk+=2*blk[k];
+			blk[0]=len;
+			memcpy(blk+1,name,len);
+			blk[len+1]=page&0xff;
+			blk[len+2]=(page>>8)&0xff;
+			dic[OMF_DICBLOCK*bx+OMF_DICBUCKETS]+=size/2;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* build dictionary, sized so most names go in their first choice of block */
+static PUCHAR buildDictionary(UINT *pages,UINT *pblocks)
+{
+	PUCHAR dic=NULL;
+	UINT blocks,entries,i,j;
+	BOOL ok;
+
+	for(i=0,entries=0;i<memberCount;++i)
+	{
+		for(j=0;j<members[i].symCount;++j)
+		{
+			if(strlen(members[i].syms[j])>255)
+			{
+				addError("Symbol name too long for OMF library: %s",members[i].syms[j]);
+				return NULL;
+			}
+			entries+=(strlen(members[i].syms[j])+4)&~1UL;
+		}
+	}
+	for(blocks=entries/(OMF_DICBLOCK-OMF_DICBUCKETS-1)*4/3+1;;++blocks)
+	{
+		if(!isPrime(blocks)) continue;
+		if(blocks>0xffff)
+		{
+			addError("Too many symbols for OMF library dictionary");
+			checkFree(dic);
+			return NULL;
+		}
+		dic=checkRealloc(dic,OMF_DICBLOCK*blocks);
+		memset(dic,0,OMF_DICBLOCK*blocks);
+		for(i=0;i<blocks;++i)
+		{
+			dic[OMF_DICBLOCK*i+OMF_DICBUCKETS]=(OMF_DICBUCKETS+1)/2;
+		}
+		ok=TRUE;
+		for(i=0;ok && (i<memberCount);++i)
+		{
+			for(j=0;ok && (j<members[i].symCount);++j)
+			{
+				ok=dictionaryInsert(dic,blocks,members[i].syms[j],pages[i]);
+			}
+		}
+		if(ok) break;
+	}
+	*pblocks=blocks;
+	return dic;
+}
+
+BOOL OMFLibFinalise(PCHAR name)
+{
+	UINT pageSize,total,blocks,i,j,pos,dicPos;
+	UINT *pages;
+	PUCHAR dic,buf;
+	PDATABLOCK d;
+
+	if(!readMembers(FALSE)) return FALSE;
+	dropDuplicateSymbols();
+
+	/* smallest page size that keeps module numbers in 16 bits */
+	for(pageSize=16;pageSize<32768;pageSize*=2)
+	{
+		total=1;
+		for(i=0;i<memberCount;++i)
+		{
+			total+=(members[i].length+pageSize-1)/pageSize;
+		}
+		if(total<0x10000) break;
+	}
+
+	pages=checkMalloc((memberCount+1)*sizeof(UINT));
+	pos=pageSize;
+	for(i=0;i<memberCount;++i)
+	{
+		pages[i]=pos/pageSize;
+		pos+=members[i].length;
+		pos=(pos+pageSize-1)&~(pageSize-1);
+	}
+	/* end record pads to a dictionary block boundary */
+	dicPos=(pos+3+OMF_DICBLOCK-1)&~(OMF_DICBLOCK-1);
+
+	if(!(dic=buildDictionary(pages,&blocks)))
+	{
+		checkFree(pages);
+		freeMembers();
+		return FALSE;
+	}
+
+	d=createDataBlock(NULL,0,dicPos+blocks*OMF_DICBLOCK,1);
+	buf=d->data;
+	memset(buf,0,d->length);
+
+	buf[0]=LIBHDR;
+	Set16(buf+1,pageSize-3);
+	Set32(buf+3,dicPos);
+	Set16(buf+7,blocks);
+	buf[9]=case_sensitive?LIBF_CASESENSITIVE:0;
+	for(i=0,j=0;i<pageSize-1;++i)
+	{
+		j+=buf[i];
+	}
+	buf[pageSize-1]=(0x100-j)&0xff;
+
+	for(i=0;i<memberCount;++i)
+	{
+		memcpy(buf+pages[i]*pageSize,members[i].data,members[i].length);
+	}
+	buf[pos]=LIBEND;
+	Set16(buf+pos+1,dicPos-pos-3);
+	memcpy(buf+dicPos,dic,blocks*OMF_DICBLOCK);
+
+	diagnostic(DIAG_VERBOSE,"OMF library: %li modules, page size %li, %li dictionary blocks\n",memberCount,pageSize,blocks);
+
+	checkFree(dic);
+	checkFree(pages);
+	freeMembers();
+	setLibraryImage(d);
+	return TRUE;
+}
+
+/****************************************************************************/
+/* COFF archives */
+
+static void setBE32(PUCHAR buf,UINT v)
+{
+	buf[0]=(v>>24)&0xff;
+	buf[1]=(v>>16)&0xff;
+	buf[2]=(v>>8)&0xff;
+	buf[3]=v&0xff;
+}
+
+static void setArchiveHeader(PUCHAR buf,PCHAR name,UINT size)
+{
+	char hdr[61];
+
+	/* no timestamps or owners, so identical inputs give an identical archive */
+	sprintf(hdr,"%-16s%-12s%-6s%-6s%-8s%-10lu`\n",name,"0","","","0",size);
+	memcpy(buf,hdr,60);
+}
+
+static int archSymCompare(const void *x1,const void *x2)
+{
+	return strcmp(((PARCHSYM)x1)->name,((PARCHSYM)x2)->name);
+}
+
+static PCHAR getMemberName(PCHAR file)
+{
+	UINT i;
+
+	for(i=strlen(file);i && !strchr(PATHCHARS,file[i-1]);--i);
+	return file+i;
+}
+
+BOOL COFFLibFinalise(PCHAR name)
+{
+	PARCHSYM syms;
+	UINT *offsets,*nameOfs;
+	UINT symCount,names,firstSize,secondSize,longSize;
+	UINT i,j,pos;
+	PUCHAR buf,p;
+	PCHAR mname;
+	PDATABLOCK d;
+	char hdrName[17];
+
+	if(!readMembers(TRUE)) return FALSE;
+	dropDuplicateSymbols();
+
+	for(i=0,symCount=0,names=0;i<memberCount;++i)
+	{
+		for(j=0;j<members[i].symCount;++j)
+		{
+			names+=strlen(members[i].syms[j])+1;
+		}
+		symCount+=members[i].symCount;
+	}
+	if(memberCount>0xffff)
+	{
+		addError("Too many members for COFF archive");
+		freeMembers();
+		return FALSE;
+	}
+	syms=checkMalloc((symCount+1)*sizeof(ARCHSYM));
+	for(i=0,symCount=0;i<memberCount;++i)
+	{
+		for(j=0;j<members[i].symCount;++j,++symCount)
+		{
+			syms[symCount].name=members[i].syms[j];
+			syms[symCount].member=i;
+		}
+	}
+
+	/* member names which don't fit in the header go in the long names member */
+	nameOfs=checkMalloc((memberCount+1)*sizeof(UINT));
+	for(i=0,longSize=0;i<memberCount;++i)
+	{
+		mname=getMemberName(members[i].name);
+		nameOfs[i]=longSize;
+		if(strlen(mname)>15) longSize+=strlen(mname)+1;
+	}
+
+	firstSize=4+4*symCount+names;
+	secondSize=4+4*memberCount+4+2*symCount+names;
+	pos=8+60+firstSize;
+	pos+=pos&1;
+	pos+=60+secondSize;
+	pos+=pos&1;
+	if(longSize)
+	{
+		pos+=60+longSize;
+		pos+=pos&1;
+	}
+	offsets=checkMalloc((memberCount+1)*sizeof(UINT));
+	for(i=0;i<memberCount;++i)
+	{
+		offsets[i]=pos;
+		pos+=60+members[i].length;
+		pos+=pos&1;
+	}
+
+	d=createDataBlock(NULL,0,pos,1);
+	buf=d->data;
+	memset(buf,'\n',pos);
+	memcpy(buf,"!<arch>\n",8);
+	p=buf+8;
+
+	/* first linker member, symbols in member order, big-endian */
+	setArchiveHeader(p,"/",firstSize);
+	p+=60;
+	setBE32(p,symCount);
+	p+=4;
+	for(i=0;i<symCount;++i,p+=4)
+	{
+		setBE32(p,offsets[syms[i].member]);
+	}
+	for(i=0;i<symCount;++i)
+	{
+		strcpy(p,syms[i].name);
+		p+=strlen(syms[i].name)+1;
+	}
+	p+=(p-buf)&1;
+
+	/* second linker member, sorted for binary search, little-endian */
+	qsort(syms,symCount,sizeof(ARCHSYM),archSymCompare);
+	setArchiveHeader(p,"/",secondSize);
+	p+=60;
+	Set32(p,memberCount);
+	p+=4;
+	for(i=0;i<memberCount;++i,p+=4)
+	{
+		Set32(p,offsets[i]);
+	}
+	Set32(p,symCount);
+	p+=4;
+	for(i=0;i<symCount;++i,p+=2)
+	{
+		Set16(p,syms[i].member+1);
+	}
+	for(i=0;i<symCount;++i)
+	{
+		strcpy(p,syms[i].name);
+		p+=strlen(syms[i].name)+1;
+	}
+	p+=(p-buf)&1;
+
+	if(longSize)
+	{
+		setArchiveHeader(p,"//",longSize);
+		p+=60;
+		for(i=0;i<memberCount;++i)
+		{
+			mname=getMemberName(members[i].name);
+			if(strlen(mname)<=15) continue;
+			strcpy(p,mname);
+			p+=strlen(mname)+1;
+		}
+		p+=(p-buf)&1;
+	}
+
+	for(i=0;i<memberCount;++i)
+	{
+		mname=getMemberName(members[i].name);
+		if(strlen(mname)>15)
+			sprintf(hdrName,"/%lu",nameOfs[i]);
+		else
+			sprintf(hdrName,"%s/",mname);
+		setArchiveHeader(buf+offsets[i],hdrName,members[i].length);
+		memcpy(buf+offsets[i]+60,members[i].data,members[i].length);
+	}
+
+	diagnostic(DIAG_VERBOSE,"COFF archive: %li members, %li symbols\n",memberCount,symCount);
+
+	checkFree(offsets);
+	checkFree(nameOfs);
+	checkFree(syms);
+	freeMembers();
+	setLibraryImage(d);
+	return TRUE;
+}
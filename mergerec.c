@@ -1,6 +1,33 @@
 #include "mergerec.h"
 #include "alink.h"
 
+/* each distinct name looked up, with its target once all rules have been applied */
+typedef struct mergename
+{
+	PCHAR name;
+	PCHAR target; /* NULL if not renamed */
+	UINT hash;
+	struct mergename *next;
+} MERGENAME,*PMERGENAME,**PPMERGENAME;
+
+/* exact rules, by source name */
+typedef struct mergerule
+{
+	PCHAR sourceName;
+	UINT index;   /* first rule in mergeList with this source */
+	UINT hash;
+	struct mergerule *next;
+} MERGERULE,*PMERGERULE,**PPMERGERULE;
+
+static PPMERGENAME nameBuckets=NULL;
+static UINT nameBucketMask=0;
+static UINT nameCount=0;
+static PPMERGERULE ruleBuckets=NULL;
+static UINT ruleBucketMask=0;
+static UINT *wildList=NULL; /* indices of wildcard rules, in order */
+static UINT wildCount=0;
+static UINT compiledCount=0; /* rules compiled so far */
+
 PMERGEREC createMergeRec(PCHAR sourceName,PCHAR targetName)
 {
 	PMERGEREC rec=(PMERGEREC)checkMalloc(sizeof(MERGEREC));
@@ -10,17 +37,213 @@ PMERGEREC createMergeRec(PCHAR sourceName,PCHAR targetName)
 	return rec;
 }
 
-PCHAR lookupTargetName(PCHAR sourceName)
+static BOOL isWildcard(PCHAR s)
+{
+	return strchr(s,'*') || strchr(s,'?');
+}
+
+/* match name against pattern with * and ? wildcards */
+static BOOL wildMatch(PCHAR pat,PCHAR s)
+{
+	PCHAR star=NULL,retry=NULL;
+
+	while(*s)
+	{
+		if(*pat=='*')
+		{
+			star=++pat;
+			retry=s;
+			continue;
+		}
+		if((*pat=='?') || (*pat==*s))
+		{
+			++pat;
+			++s;
+			continue;
+		}
+		if(!star) return FALSE;
+		/* let the last * swallow one more character */
+		pat=star;
+		s=++retry;
+	}
+	while(*pat=='*') ++pat;
+	return !*pat;
+}
+
+static void freeNames(void)
 {
-	unsigned i=0;
+	UINT i;
+	PMERGENAME n,next;
+
+	for(i=0;nameBuckets && (i<=nameBucketMask);++i)
+	{
+		for(n=nameBuckets[i];n;n=next)
+		{
+			next=n->next;
+			checkFree(n->name);
+			checkFree(n);
+		}
+	}
+	checkFree(nameBuckets);
+	nameBuckets=NULL;
+	nameBucketMask=0;
+	nameCount=0;
+}
+
+static void freeRules(void)
+{
+	UINT i;
+	PMERGERULE r,next;
+
+	for(i=0;ruleBuckets && (i<=ruleBucketMask);++i)
+	{
+		for(r=ruleBuckets[i];r;r=next)
+		{
+			next=r->next;
+			checkFree(r);
+		}
+	}
+	checkFree(ruleBuckets);
+	checkFree(wildList);
+	ruleBuckets=NULL;
+	ruleBucketMask=0;
+	wildList=NULL;
+	wildCount=0;
+}
+
+/* hash the exact rules and list the wildcard ones */
+/* names resolved against an older rule set are forgotten */
+static void compileRules(void)
+{
+	UINT i,h;
+	PMERGERULE r;
+
+	freeRules();
+	freeNames();
+	for(ruleBucketMask=15;ruleBucketMask<mergeCount;ruleBucketMask=ruleBucketMask*2+1);
+	ruleBuckets=checkMalloc((ruleBucketMask+1)*sizeof(PMERGERULE));
+	for(i=0;i<=ruleBucketMask;++i) ruleBuckets[i]=NULL;
+
 	for(i=0;i<mergeCount;++i)
 	{
-		if(!strcmp(mergeList[i]->sourceName,sourceName))
+		if(isWildcard(mergeList[i]->sourceName))
 		{
-			return mergeList[i]->targetName;
+			wildList=checkRealloc(wildList,(wildCount+1)*sizeof(UINT));
+			wildList[wildCount++]=i;
+			continue;
 		}
+		h=hashString(HASH_INIT,mergeList[i]->sourceName);
+		for(r=ruleBuckets[h&ruleBucketMask];r;r=r->next)
+		{
+			if((r->hash==h) && !strcmp(r->sourceName,mergeList[i]->sourceName)) break;
+		}
+		if(r) continue; /* first rule for a name wins */
+		r=checkMalloc(sizeof(MERGERULE));
+		r->sourceName=mergeList[i]->sourceName;
+		r->index=i;
+		r->hash=h;
+		r->next=ruleBuckets[h&ruleBucketMask];
+		ruleBuckets[h&ruleBucketMask]=r;
 	}
+	compiledCount=mergeCount;
+}
+
+/* first rule in command line order which applies to name, or -1 */
+static INT findRule(PCHAR name)
+{
+	UINT h,i;
+	INT best=-1;
+	PMERGERULE r;
 
-	return sourceName;
+	h=hashString(HASH_INIT,name);
+	for(r=ruleBuckets[h&ruleBucketMask];r;r=r->next)
+	{
+		if((r->hash==h) && !strcmp(r->sourceName,name))
+		{
+			best=r->index;
+			break;
+		}
+	}
+	for(i=0;i<wildCount;++i)
+	{
+		if((best>=0) && (wildList[i]>(UINT)best)) break;
+		if(wildMatch(mergeList[wildList[i]]->sourceName,name)) return wildList[i];
+	}
+	return best;
 }
 
+/* follow the chain of rules from name, giving up on cycles after one step per rule */
+static PCHAR resolveName(PCHAR name)
+{
+	PCHAR target=NULL;
+	UINT steps;
+	INT r;
+
+	for(steps=0;steps<mergeCount;++steps)
+	{
+		r=findRule(target?target:name);
+		if(r<0) break;
+		if(!strcmp(mergeList[r]->targetName,target?target:name)) break;
+		target=mergeList[r]->targetName;
+	}
+	if(target && !strcmp(target,name)) return NULL; /* renamed back to itself */
+	return target;
+}
+
+static void growNames(void)
+{
+	PPMERGENAME old;
+	UINT oldMask,i;
+	PMERGENAME n,next;
+
+	old=nameBuckets;
+	oldMask=nameBucketMask;
+	nameBucketMask=old?nameBucketMask*2+1:63;
+	nameBuckets=checkMalloc((nameBucketMask+1)*sizeof(PMERGENAME));
+	for(i=0;i<=nameBucketMask;++i) nameBuckets[i]=NULL;
+	for(i=0;old && (i<=oldMask);++i)
+	{
+		for(n=old[i];n;n=next)
+		{
+			next=n->next;
+			n->next=nameBuckets[n->hash&nameBucketMask];
+			nameBuckets[n->hash&nameBucketMask]=n;
+		}
+	}
+	checkFree(old);
+}
+
+PCHAR lookupTargetName(PCHAR sourceName)
+{
+	UINT h;
+	PMERGENAME n;
+
+	if(!mergeCount) return sourceName;
+	if(compiledCount!=mergeCount) compileRules();
+
+	h=hashString(HASH_INIT,sourceName);
+	if(nameBuckets)
+	{
+		for(n=nameBuckets[h&nameBucketMask];n;n=n->next)
+		{
+			if((n->hash==h) && !strcmp(n->name,sourceName))
+			{
+				return n->target?n->target:sourceName;
+			}
+		}
+	}
+
+	if(nameCount>=nameBucketMask) growNames();
+	n=checkMalloc(sizeof(MERGENAME));
+	n->name=checkStrdup(sourceName);
+	n->target=resolveName(sourceName);
+	n->hash=h;
+	n->next=nameBuckets[h&nameBucketMask];
+	nameBuckets[h&nameBucketMask]=n;
+	nameCount++;
+	if(n->target)
+	{
+		diagnostic(DIAG_VERBOSE,"Segment %s merged into %s\n",sourceName,n->target);
+	}
+	return n->target?n->target:sourceName;
+}
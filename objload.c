@@ -7,6 +7,9 @@ static int t_thredindex[4];
 static int f_thredindex[4];
 
 static PLIBLOCK lidata=NULL;
+static PDATABLOCK lidataBlock=NULL; /* block built from lidata */
+static PDATABLOCK ledataBlock=NULL; /* block grown by contiguous LEDATA records */
+static UINT ledataSpace=0; /* bytes allocated for ledataBlock */
 static UCHAR buf[65536];
 static INT rectype;
 static INT li_le=0;
@@ -44,49 +47,38 @@ static INT GetIndex(PUCHAR buf,UINT *index)
 	}
 }
 
-static void DestroyLIDATA(PLIBLOCK p)
-{
-	UINT i;
-	if(p->blocks)
-	{
-		for(i=0;i<p->blocks;i++)
-		{
-			DestroyLIDATA(((PPLIBLOCK)(p->data))[i]);
-		}
-	}
-	free(p->data);
-	free(p);
-}
-
 static PLIBLOCK BuildLiData(UINT *bufofs)
 {
 	PLIBLOCK p;
 	UINT i,j;
 
-	p=checkMalloc(sizeof(DATABLOCK));
+	p=checkMalloc(sizeof(LIBLOCK));
 	i=*bufofs;
 	p->dataofs=i-lidata->dataofs;
 	p->count=buf[i]+256*buf[i+1];
 	i+=2;
-	if(rectype==LIDATA32)
+	if((rectype==LIDATA32) || (rectype==COMDAT32))
 	{
 		p->count+=(buf[i]+256*buf[i+1])<<16;
 		i+=2;
 	}
 	p->blocks=buf[i]+256*buf[i+1];
 	i+=2;
+	p->length=0;
 	if(p->blocks)
 	{
 		p->data=checkMalloc(p->blocks*sizeof(PLIBLOCK));
 		for(j=0;j<p->blocks;j++)
 		{
 			((PPLIBLOCK)p->data)[j]=BuildLiData(&i);
+			p->length+=((PPLIBLOCK)p->data)[j]->length*((PPLIBLOCK)p->data)[j]->count;
 		}
 	}
 	else
 	{
 		p->data=checkMalloc(buf[i]+1);
 		((char*)p->data)[0]=buf[i];
+		p->length=buf[i];
 		i++;
 		for(j=0;j<((PUCHAR)p->data)[0];j++,i++)
 		{
@@ -97,52 +89,86 @@ static PLIBLOCK BuildLiData(UINT *bufofs)
 	return p;
 }
 
-static PDATABLOCK EmitLiData(PLIBLOCK p)
+/* done growing ledataBlock, so give back the space it was not using */
+static void EndLEDATA(void)
 {
-	UINT i,j;
-	PDATABLOCK d,d2;
+	if(ledataBlock && ledataBlock->length && (ledataSpace>ledataBlock->length))
+	{
+		ledataBlock->data=checkRealloc(ledataBlock->data,ledataBlock->length);
+	}
+	ledataBlock=NULL;
+	ledataSpace=0;
+}
+
+/* repeat tree for the iterated data from buf[*bufofs] to the end of the record */
+static void BuildLiRoot(UINT *bufofs)
+{
+	PLIBLOCK p;
+
+	lidata=checkMalloc(sizeof(LIBLOCK));
+	lidata->data=NULL;
+	lidata->blocks=0;
+	lidata->dataofs=*bufofs;
+	lidata->length=0;
+	lidata->count=1;
+	while(*bufofs<reclength)
+	{
+		p=BuildLiData(bufofs);
+		lidata->data=checkRealloc(lidata->data,(lidata->blocks+1)*sizeof(PLIBLOCK));
+		((PPLIBLOCK)lidata->data)[lidata->blocks++]=p;
+		lidata->length+=p->length*p->count;
+	}
+}
 
-	if(!p->count) return NULL;
+/* done with lidata, unless a data block has taken it over */
+static void ReleaseLIDATA(void)
+{
+	if(lidata && !(lidataBlock && (lidataBlock->iterated==lidata)))
+	{
+		freeLiBlock(lidata);
+	}
+	lidata=NULL;
+	lidataBlock=NULL;
+}
+
+/* iterated data is all zeroes */
+static BOOL liDataIsZero(PLIBLOCK p)
+{
+	UINT i;
 
+	if(!p->count) return TRUE;
 	if(p->blocks)
 	{
-		d=NULL;
-		for(j=0;j<p->blocks;j++)
+		for(i=0;i<p->blocks;i++)
 		{
-			d2=EmitLiData(((PPLIBLOCK)p->data)[j]);
-			if(!d)
-			{
-				d=d2;
-			}
-			else if(d2)
-			{
-				d->data=checkRealloc(d->data,d->length+d2->length);
-				memcpy(d->data+d->length,d2->data,d2->length);
-				d->length+=d2->length;
-				freeDataBlock(d2);
-			}
+			if(!liDataIsZero(((PPLIBLOCK)p->data)[i])) return FALSE;
 		}
+		return TRUE;
 	}
-	else
+	return isZeroData(((PUCHAR)p->data)+1,p->length);
+}
+
+/* data block for lidata, left as a repeat tree to be expanded when written */
+static PDATABLOCK liDataBlock(UINT ofs)
+{
+	if(!lidata->blocks) return NULL;
+	if(liDataIsZero(lidata))
 	{
-		d=createDataBlock(((PUCHAR)p->data)+1,0,((PUCHAR)p->data)[0],1);
+		lidataBlock=createZeroDataBlock(ofs,lidata->length,1);
 	}
-	if(p->count>1)
+	else
 	{
-		d->data=checkRealloc(d->data,d->length*p->count);
-		for(i=1;i<p->count;i++)
-		{
-			memcpy(d->data+i*d->length,d->data,d->length);
-		}
-		d->length*=p->count;
+		lidataBlock=createIteratedDataBlock(lidata,ofs,1);
 	}
-	return d;
+	return lidataBlock;
 }
 
+/* add r once for each repeat of the leaf it falls in */
 static BOOL RelocLIDATA(PLIBLOCK p,PSEG s,UINT *ofs,PRELOC r)
 {
-	UINT i,j;
+	UINT i,j,hdr;
 
+	hdr=(li_le==PREV_LI32)?7:5; /* count, block count and length byte */
 	for(i=0;i<p->count;i++)
 	{
 		if(p->blocks)
@@ -155,20 +181,19 @@ static BOOL RelocLIDATA(PLIBLOCK p,PSEG s,UINT *ofs,PRELOC r)
 		}
 		else
 		{
-			j=r->ofs-p->dataofs;
-			if(j>=0)
+			if((r->ofs>=p->dataofs) && (r->ofs<(p->dataofs+hdr)))
+			{
+				addError("Bad LIDATA offset");
+				return FALSE;
+			}
+			if((r->ofs>=(p->dataofs+hdr)) && (r->ofs<(p->dataofs+hdr+p->length)))
 			{
-				if((j<5) || ((li_le==PREV_LI32) && (j<7)))
-				{
-					addError("Bad LIDATA offset");
-					return FALSE;
-				}
 				s->relocs=(PRELOC)checkRealloc(s->relocs,(s->relocCount+1)*sizeof(RELOC));
 				memcpy(s->relocs+s->relocCount,r,sizeof(RELOC));
-				s->relocs[s->relocCount].ofs=*ofs+j;
+				s->relocs[s->relocCount].ofs=*ofs+r->ofs-p->dataofs-hdr;
 				s->relocCount++;
-				*ofs+=((PUCHAR)p->data)[0];
 			}
+			*ofs+=p->length;
 		}
 	}
 	return TRUE;
@@ -423,7 +448,10 @@ BOOL loadOMFModule(PFILE objfile,PMODULE mod)
 	UINT currentSource=0;
 
 	li_le=0;
-	lidata=0;
+	lidata=NULL;
+	lidataBlock=NULL;
+	ledataBlock=NULL;
+	ledataSpace=0;
 	debugType=DBG_UNKNOWN;
 
 	while(!done)
@@ -469,11 +497,7 @@ BOOL loadOMFModule(PFILE objfile,PMODULE mod)
 			break;
 		case COMENT:
 			li_le=0;
-			if(lidata)
-			{
-				DestroyLIDATA(lidata);
-				lidata=0;
-			}
+			ReleaseLIDATA();
 			if(reclength>=2)
 			{
 				switch(buf[1])
@@ -898,16 +922,23 @@ BOOL loadOMFModule(PFILE objfile,PMODULE mod)
 				prevofs+=(buf[j]+(buf[j+1]<<8))<<16;
 				j+=2;
 			}
-			d=createDataBlock(buf+j,prevofs,reclength-j,1);
-			addFixedData(seglist[i],d);
+			/* a record carrying on from the last one just grows its block */
+			if(!ledataBlock || ((ledataBlock->offset+ledataBlock->length)!=prevofs)
+			   || !extendFixedData(seglist[i],ledataBlock,buf+j,reclength-j,&ledataSpace))
+			{
+				EndLEDATA();
+				d=createDataBlock(buf+j,prevofs,reclength-j,1);
+				if(addFixedData(seglist[i],d))
+				{
+					ledataBlock=d;
+					ledataSpace=d->length;
+				}
+			}
 			li_le=PREV_LE;
 			break;
 		case LIDATA:
 		case LIDATA32:
-			if(lidata)
-			{
-				DestroyLIDATA(lidata);
-			}
+			ReleaseLIDATA();
 			j=0;
 			i=GetIndex(buf,&j)-1;
 			if(i<0)
@@ -927,24 +958,15 @@ BOOL loadOMFModule(PFILE objfile,PMODULE mod)
 				prevofs+=(buf[j]+(buf[j+1]<<8))<<16;
 				j+=2;
 			}
-			lidata=checkMalloc(sizeof(LIBLOCK));
-			lidata->data=checkMalloc(sizeof(PLIBLOCK)*(1024/sizeof(LIBLOCK)+1));
-			lidata->blocks=0;
-			lidata->dataofs=j;
-			for(k=0;j<reclength;k++)
-			{
-				((PPLIBLOCK)lidata->data)[k]=BuildLiData(&j);
-			}
-			lidata->blocks=k;
-			lidata->count=1;
+			BuildLiRoot(&j);
 
-			if(!(d=EmitLiData(lidata)))
+			if(!(d=liDataBlock(prevofs)))
 			{
 				addError("NULL LIDATA");
 				return FALSE;
 			}
-			d->offset=prevofs;
 			addFixedData(seglist[i],d);
+			prevseg=seglist[i];
 			li_le=(rectype==LIDATA)?PREV_LI:PREV_LI32;
 			break;
 		case LPUBDEF:
@@ -1154,6 +1176,11 @@ BOOL loadOMFModule(PFILE objfile,PMODULE mod)
 						if(!RelocLIDATA(lidata,seg,&i,r))
 							return FALSE;
 						free(r);
+						if(!lidataBlock->iterated)
+						{
+							fillDataBlock(lidataBlock); /* fixups need real zeroes */
+							invalidateInitLength(seg);
+						}
 					}
 				}
 				else
@@ -1516,23 +1543,31 @@ BOOL loadOMFModule(PFILE objfile,PMODULE mod)
 				else
 				{
 					comdat->segList[0]=prevseg=createSection(name,class,NULL,mod,0,16);
+					/* far and 32-bit allocation types imply the segment attributes */
+					prevseg->use32=((attr&0xf)>=3);
+					prevseg->initdata=TRUE;
+					prevseg->read=TRUE;
+					if(!strcmp(class,"CODE"))
+					{
+						prevseg->code=TRUE;
+						prevseg->execute=TRUE;
+					}
+					else
+					{
+						prevseg->write=TRUE;
+					}
 				}
 			}
 			if(flag &COMDAT_LI)
 			{
 				/* iterated data, like LIDATA */
-				lidata=checkMalloc(sizeof(LIBLOCK));
-				lidata->data=checkMalloc(sizeof(PLIBLOCK)*(1024/sizeof(LIBLOCK)+1));
-				lidata->blocks=0;
-				lidata->dataofs=j;
-				for(i=0;j<reclength;i++)
+				ReleaseLIDATA();
+				BuildLiRoot(&j);
+				if(!(d=liDataBlock(prevofs)))
 				{
-					((PPLIBLOCK)lidata->data)[i]=BuildLiData(&j);
+					addError("NULL LIDATA");
+					return FALSE;
 				}
-				lidata->blocks=i;
-				lidata->count=1;
-				d=EmitLiData(lidata);
-				d->offset=prevofs;
 				li_le=(rectype==COMDAT)?PREV_LI:PREV_LI32;
 			}
 			else
@@ -1578,10 +1613,8 @@ BOOL loadOMFModule(PFILE objfile,PMODULE mod)
 		}
 		modpos+=4+reclength;
 	}
-	if(lidata)
-	{
-		DestroyLIDATA(lidata);
-	}
+	ReleaseLIDATA();
+	EndLEDATA();
 
 	if(expcount)
 	{
@@ -155,16 +155,7 @@
 
 #define COMDAT_LI   0x02
 #define COMDAT_CONT 0x01
-
-typedef struct liblock LIBLOCK,*PLIBLOCK, **PPLIBLOCK;
-
-struct liblock
-{
-	UINT count;
-	UINT blocks;
-	UINT dataofs;
-	void *data;
-};
+#define COMDAT_LOCAL 0x04
 
 typedef struct comdatentry COMDATENTRY,*PCOMDATENTRY;
 
@@ -174,5 +165,4 @@ struct comdatentry
 	PCOMDATREC comdat;
 };
 
-
 #endif
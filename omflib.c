@@ -40,52 +40,45 @@ BOOL OMFLibDetect(PFILE f,PCHAR name)
 	return TRUE;
 }
 
-BOOL OMFLibLoad(PFILE f,PMODULE mod)
+PLIBINDEX OMFLibReadIndex(PFILE f,PCHAR file)
 {
-	UINT blocksize,dicstart,numdicpages,flags;
+	UINT blocksize,dicstart,numdicpages;
 	INT i,j,k,n;
-	PPSYMBOL symlist;
-	UINT numsyms;
+	PLIBINDEX idx;
 	PCHAR name;
 	UINT modpage;
 	if(fread(buf,1,3,f)!=3)
 	{
-		return FALSE;
+		return NULL;
 	}
 	if(buf[0]!=LIBHDR)
 	{
-		return FALSE;
+		return NULL;
 	}
 	blocksize=buf[1]+256*buf[2];
 	if(fread(buf,1,blocksize,f)!=blocksize)
 	{
-		return FALSE;
+		return NULL;
 	}
 	blocksize+=3;
 
 	dicstart=buf[0]+(buf[1]<<8)+(buf[2]<<16)+(buf[3]<<24);
 	numdicpages=buf[4]+256*buf[5];
-	flags=buf[6];
 
-	if(!(flags&LIBF_CASESENSITIVE) && case_sensitive)
-	{
-		addError("Case-insensitive library cannot be used in case-sensitive link");
-		return FALSE;
-	}
+	idx=createLibIndex(file,LIBINDEX_OMF);
+	idx->flags=buf[6];
 
-	if(!numdicpages) return TRUE;
+	if(!numdicpages) return idx;
 	/* seek to dictionary */
 	fseek(f,dicstart,SEEK_SET);
 
-	numsyms=0;
-	symlist=checkMalloc(numdicpages*37*sizeof(PSYMBOL));
-
 	for(i=0;i<numdicpages;i++)
 	{
 		if(fread(buf,1,512,f)!=512)
 		{
-			addError("Error reading from file %s",mod->file);
-			return FALSE;
+			addError("Error reading from file %s",file);
+			freeLibIndex(idx);
+			return NULL;
 		}
 		for(j=0;j<37;j++)
 		{
@@ -106,20 +99,36 @@ BOOL OMFLibLoad(PFILE f,PMODULE mod)
 				}
 				else
 				{
-					symlist[numsyms]=createSymbol(name,PUB_LIBSYM,mod,modpage*blocksize,OMFLibModLoad);
-					++numsyms;
+					addLibIndexSymbol(idx,name,modpage*blocksize);
 				}
 			}
 		}
 	}
 
-	for(i=0;i<numsyms;++i)
+	return idx;
+}
+
+BOOL OMFLibLoad(PFILE f,PMODULE mod)
+{
+	PLIBINDEX idx;
+	BOOL cached;
+	BOOL ok;
+
+	if(!(idx=getLibIndex(f,mod->file,LIBINDEX_OMF,OMFLibReadIndex,&cached)))
 	{
-		addGlobalSymbol(symlist[i]);
+		return FALSE;
 	}
-	checkFree(symlist);
 
-	return TRUE;
+	if(!(idx->flags&LIBF_CASESENSITIVE) && case_sensitive)
+	{
+		addError("Case-insensitive library cannot be used in case-sensitive link");
+		if(!cached) freeLibIndex(idx);
+		return FALSE;
+	}
+
+	ok=useLibIndex(idx,mod,OMFLibModLoad);
+	if(!cached) releaseLibIndex(idx);
+	return ok;
 }
 
 static BOOL OMFLibModLoad(PFILE f,PMODULE libmod)
@@ -62,7 +62,9 @@ BOOL BINFinalise(PCHAR name)
 	spaceList=checkMalloc(sizeof(PSEG));
 	spaceList[0]=a;
 
+	beginPhase("performFixups");
 	performFixups(a);
+	endPhase();
 
 	return TRUE;
 }
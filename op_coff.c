@@ -0,0 +1,645 @@
+#include "alink.h"
+#include "coff.h"
+
+/* relocatable output: the combined segments are written back out as a */
+/* single MS COFF object, with fixups against the new sections and any */
+/* externs still unresolved left for a later link to fill in. COMDATs */
+/* and commons stay as they are, for the final link to choose from */
+
+#define COMDAT_SELECT_ASSOCIATIVE 5
+
+/* COFF selection for each COMDAT combine type */
+static const UCHAR comdatSelection[]={1,6,3,2,4};
+
+typedef struct coffsect
+{
+	PSEG seg;
+	PUCHAR data; /* NULL if no initialised data */
+	UINT length;
+	UINT relocCount;
+	PUCHAR relocs;
+	UINT nameOfs;
+	PSYMBOL comdat; /* COMDAT symbol of the section, if any */
+	UINT selection; /* COMDAT selection, 0 for ordinary sections */
+	UINT assoc; /* section number an associative section goes with */
+} COFFSECT,*PCOFFSECT;
+
+static PCOFFSECT sectList;
+static UINT sectCount;
+
+/* symbols written after the section symbols, kept sorted by name */
+static PPCHAR symNames;
+static PSYMBOL *symDefs;
+static UINT *symNameOfs;
+static UINT symCount;
+
+static PUCHAR stringTable;
+static UINT stringLength;
+
+BOOL COFFObjInitialise(PSWITCHPARAM sp)
+{
+	partialLink=TRUE;
+	return TRUE;
+}
+
+static UINT addString(PCHAR s)
+{
+	UINT ofs;
+
+	ofs=stringLength;
+	stringTable=checkRealloc(stringTable,stringLength+strlen(s)+1);
+	strcpy(stringTable+stringLength,s);
+	stringLength+=strlen(s)+1;
+	return ofs+4;
+}
+
+/* section holding s, and offset of s within it */
+static INT findSection(PSEG s,UINT *ofs)
+{
+	UINT i;
+
+	*ofs=0;
+	while(s->parent)
+	{
+		*ofs+=s->base;
+		s=s->parent;
+	}
+	for(i=0;i<sectCount;++i)
+	{
+		if(sectList[i].seg==s) return i;
+	}
+	return -1;
+}
+
+static int symNameCompare(const void *x1,const void *x2)
+{
+	return strcmp(*(PPCHAR)x1,*(PPCHAR)x2);
+}
+
+static INT findSymbolIndex(PCHAR name)
+{
+	PPCHAR p;
+
+	p=bsearch(&name,symNames,symCount,sizeof(PCHAR),symNameCompare);
+	if(!p) return -1;
+	return (p-symNames)+2*sectCount;
+}
+
+static void addSymbolName(PCHAR name,PSYMBOL def)
+{
+	symNames=checkRealloc(symNames,(symCount+1)*sizeof(PCHAR));
+	symDefs=checkRealloc(symDefs,(symCount+1)*sizeof(PSYMBOL));
+	symNames[symCount]=name;
+	symDefs[symCount]=def;
+	symCount++;
+}
+
+/* symbol definition in the output, following aliases */
+static PSYMBOL getDefinition(PSYMBOL p)
+{
+	UINT i;
+
+	for(i=0;p && (p->type==PUB_ALIAS) && (i<16);++i)
+	{
+		p=findSymbol(p->aliasName);
+	}
+	if(!p) return NULL;
+	switch(p->type)
+	{
+	case PUB_COMDEF:
+		/* sized, but not allocated */
+		return p;
+	case PUB_PUBLIC:
+	case PUB_COMDAT:
+		if(p->seg) return p;
+		break;
+	}
+	return NULL;
+}
+
+/* publics defined here, and externs left unresolved */
+static BOOL buildSymbolList(void)
+{
+	UINT i,j;
+
+	symNames=NULL;
+	symDefs=NULL;
+	symCount=0;
+	for(i=0;i<globalSymbolCount;++i)
+	{
+		if(!getDefinition(globalSymbols[i])) continue;
+		addSymbolName(globalSymbols[i]->name,NULL);
+	}
+	for(i=0;i<globalExternCount;++i)
+	{
+		if(getDefinition(globalExterns[i]->pubdef)) continue;
+		addSymbolName(globalExterns[i]->name,NULL);
+	}
+	qsort(symNames,symCount,sizeof(PCHAR),symNameCompare);
+
+	/* names may be referenced by several modules */
+	for(i=0,j=0;i<symCount;++i)
+	{
+		if(j && !strcmp(symNames[j-1],symNames[i])) continue;
+		symNames[j++]=symNames[i];
+	}
+	symCount=j;
+	for(i=0;i<symCount;++i)
+	{
+		symDefs[i]=getDefinition(findSymbol(symNames[i]));
+		if(symDefs[i] && symDefs[i]->seg && !symDefs[i]->seg->absolute && (findSection(symDefs[i]->seg,&j)<0))
+		{
+			addError("Symbol %s is not in an output section",symNames[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* copy initialised data of s into buf at ofs */
+static void copySegData(PSEG s,PUCHAR buf,UINT ofs)
+{
+	UINT i;
+	PDATABLOCK d;
+
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag==DATA)
+		{
+			d=s->contentList[i].data;
+			if(d->length && !isZeroBlock(d)) copyDataBlock(d,buf+ofs+d->offset);
+		}
+		else if(!s->contentList[i].seg->absolute)
+		{
+			copySegData(s->contentList[i].seg,buf,ofs+s->contentList[i].seg->base);
+		}
+	}
+}
+
+/* relocation entries written for c, counting the overflow entry if needed */
+static UINT relocEntries(PCOFFSECT c)
+{
+	return (c->relocCount>=0xffff)?(c->relocCount+1):c->relocCount;
+}
+
+static void addReloc(PCOFFSECT c,UINT ofs,UINT symnum,UINT type)
+{
+	PUCHAR r;
+
+	c->relocs=checkRealloc(c->relocs,(c->relocCount+1)*COFF_RELOC_SIZE);
+	r=c->relocs+c->relocCount*COFF_RELOC_SIZE;
+	Set32(r,ofs);
+	Set32(r+4,symnum);
+	Set16(r+8,(USHORT)type);
+	c->relocCount++;
+}
+
+/* first section of the COMDAT that section i belongs to, or i itself */
+static UINT sectionGroup(UINT i)
+{
+	if(sectList[i].selection==COMDAT_SELECT_ASSOCIATIVE) return sectList[i].assoc-1;
+	return i;
+}
+
+/* rewrite the fixups of s, at ofs within section c, against the output symbols */
+static BOOL convertRelocs(PCOFFSECT c,PSEG s,UINT ofs)
+{
+	UINT i,j;
+	PRELOC r;
+	PSEG t;
+	PSYMBOL pub;
+	INT sect,symnum;
+	UINT addend,tofs,fofs,type;
+	PUCHAR p;
+
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag!=SEGMENT) continue;
+		if(s->contentList[i].seg->absolute) continue;
+		if(!convertRelocs(c,s->contentList[i].seg,ofs+s->contentList[i].seg->base)) return FALSE;
+	}
+
+	for(i=0;i<s->relocCount;++i)
+	{
+		r=s->relocs+i;
+		if(!c->data || (ofs+r->ofs+4>c->length))
+		{
+			addError("Fixup location %08lX is outside any data in segment %s",r->ofs,s->name);
+			return FALSE;
+		}
+		p=c->data+ofs+r->ofs;
+
+		/* target is a section symbol plus offset if in the output, else a named symbol */
+		t=NULL;
+		pub=NULL;
+		tofs=0;
+		if(r->tseg)
+		{
+			t=r->tseg;
+		}
+		else if(r->text)
+		{
+			pub=getDefinition(r->text->pubdef);
+			if(pub && pub->seg)
+			{
+				t=pub->seg;
+				tofs=pub->ofs;
+			}
+		}
+		if(t && t->absolute)
+		{
+			if(!pub || (findSymbolIndex(r->text->name)<0))
+			{
+				addError("Fixup to absolute segment %s in relocatable output",t->name);
+				return FALSE;
+			}
+			t=NULL;
+			tofs=0;
+		}
+		if(t)
+		{
+			sect=findSection(t,&j);
+			if(sect<0)
+			{
+				addError("Fixup target %s is not in an output section",t->name);
+				return FALSE;
+			}
+			tofs+=j;
+			symnum=2*sect;
+			/* another COMDAT may be kept instead, so only its name is certain */
+			if(sectList[sect].selection && (sectionGroup(sect)!=sectionGroup((UINT)(c-sectList))))
+			{
+				if(!sectList[sect].comdat)
+				{
+					addError("Fixup to associative COMDAT section %s from segment %s",t->name,s->name);
+					return FALSE;
+				}
+				symnum=findSymbolIndex(sectList[sect].comdat->name);
+				sect=-1;
+			}
+		}
+		else if(r->text)
+		{
+			symnum=findSymbolIndex(r->text->name);
+			if(symnum<0)
+			{
+				addError("Fixup target %s missing from symbol table",r->text->name);
+				return FALSE;
+			}
+			sect=-1;
+		}
+		else
+		{
+			addError("Fixup target unresolved");
+			return FALSE;
+		}
+
+		if(r->rtype==REL_SEG)
+		{
+			addReloc(c,ofs+r->ofs,symnum,COFF_FIX_SECTION);
+			continue;
+		}
+		if(r->rtype!=REL_OFS32)
+		{
+			addError("Unsupported fixup type in relocatable output, segment %s",s->name);
+			return FALSE;
+		}
+		addend=tofs+r->disp;
+		switch(r->base)
+		{
+		case REL_DEFAULT:
+		case REL_ABS:
+			type=COFF_FIX_DIR32;
+			break;
+		case REL_RVA:
+			type=COFF_FIX_RVA32;
+			break;
+		case REL_SELF:
+			/* COFF REL32 is relative to the end of the field */
+			type=COFF_FIX_REL32;
+			addend+=4;
+			break;
+		case REL_FRAME:
+			/* only section-relative fixups survive, frame must be the target section */
+			if(!r->fseg || (sect<0) || r->fseg->absolute
+			   || (findSection(r->fseg,&fofs)!=sect))
+			{
+				addError("Unsupported frame fixup in relocatable output, segment %s",s->name);
+				return FALSE;
+			}
+			type=COFF_FIX_SECREL;
+			addend-=fofs;
+			break;
+		default:
+			addError("Unsupported fixup base in relocatable output, segment %s",s->name);
+			return FALSE;
+		}
+		Set32(p,p[0]+(p[1]<<8)+(p[2]<<16)+((UINT)p[3]<<24)+addend);
+		addReloc(c,ofs+r->ofs,symnum,type);
+	}
+	return TRUE;
+}
+
+static UINT getSectionFlags(PSEG s)
+{
+	UINT k,a;
+
+	k=0;
+	if(s->code)
+		k |= WINF_CODE;
+	if(s->initdata)
+		k |= WINF_INITDATA;
+	if(s->uninitdata)
+		k |= WINF_UNINITDATA;
+	if(!k)
+		k=getInitLength(s)?WINF_INITDATA:WINF_UNINITDATA;
+	if(s->discardable)
+		k |= WINF_DISCARDABLE;
+	if(s->shared)
+		k |= WINF_SHARED;
+	if(s->read)
+		k |= WINF_READABLE;
+	if(s->write)
+		k |= WINF_WRITEABLE;
+	if(s->execute)
+		k |= WINF_EXECUTE;
+	/* alignment is stored as log2+1, up to 8192 bytes */
+	for(a=1;(a<14) && ((1UL<<(a-1))<s->align);++a);
+	k |= a<<20;
+	return k;
+}
+
+static BOOL addSection(PSEG s)
+{
+	PCOFFSECT c;
+
+	if(!s->use32)
+	{
+		addError("16-bit segment %s not supported for relocatable output",s->name);
+		return FALSE;
+	}
+	sectList=checkRealloc(sectList,(sectCount+1)*sizeof(COFFSECT));
+	c=sectList+sectCount;
+	c->seg=s;
+	c->relocCount=0;
+	c->relocs=NULL;
+	c->data=NULL;
+	c->length=getInitLength(s);
+	if(c->length)
+	{
+		/* raw data covers the whole section, zero after the initialised part */
+		c->length=s->length;
+		c->data=checkMalloc(c->length);
+		memset(c->data,0,c->length);
+		copySegData(s,c->data,0);
+	}
+	c->nameOfs=0;
+	if(s->name && (strlen(s->name)>8))
+	{
+		c->nameOfs=addString(s->name);
+	}
+	c->comdat=NULL;
+	c->selection=0;
+	c->assoc=0;
+	sectCount++;
+	return TRUE;
+}
+
+/* chosen instance of COMDAT p, as a section plus any associated with it */
+static BOOL addComdatSections(PSYMBOL p)
+{
+	UINT i,first;
+	PCOMDATREC c;
+
+	for(i=0;i<p->comdatCount;++i)
+	{
+		if(p->comdatList[i]->segList[0]==p->seg) break;
+	}
+	if(i==p->comdatCount)
+	{
+		addError("No instance chosen for COMDAT %s",p->name);
+		return FALSE;
+	}
+	c=p->comdatList[i];
+	first=sectCount;
+	for(i=0;i<c->segCount;++i)
+	{
+		if(!addSection(c->segList[i])) return FALSE;
+		if(i)
+		{
+			sectList[sectCount-1].selection=COMDAT_SELECT_ASSOCIATIVE;
+			sectList[sectCount-1].assoc=first+1;
+		}
+		else
+		{
+			sectList[sectCount-1].comdat=p;
+			sectList[sectCount-1].selection=comdatSelection[c->combine];
+		}
+	}
+	return TRUE;
+}
+
+BOOL COFFObjFinalise(PCHAR name)
+{
+	UINT i,j;
+	PSEG a,s;
+	PCOFFSECT c;
+	PSYMBOL pub;
+	PDATABLOCK d;
+	PUCHAR buf,p;
+	UINT pos,symPos,len;
+
+	if(globalExportCount)
+	{
+		addError("Exports not supported for relocatable output");
+		return FALSE;
+	}
+	if(globalResourceCount)
+	{
+		addError("Resources not supported for relocatable output");
+		return FALSE;
+	}
+	if(gotstart)
+	{
+		diagnostic(DIAG_BASIC,"Warning: entry point not recorded in relocatable output\n");
+	}
+
+	sectList=NULL;
+	sectCount=0;
+	stringTable=NULL;
+	stringLength=0;
+	for(i=0;i<globalSegCount;++i)
+	{
+		s=globalSegs[i];
+		if(!s || s->absolute) continue;
+		if(!s->length && !s->contentCount) continue;
+		if(!addSection(s)) return FALSE;
+	}
+	for(i=0;i<globalSymbolCount;++i)
+	{
+		pub=globalSymbols[i];
+		if((pub->type!=PUB_COMDAT) || !pub->seg) continue;
+		if(!addComdatSections(pub)) return FALSE;
+	}
+	if(sectCount>0x7fff)
+	{
+		addError("Too many sections for relocatable output");
+		return FALSE;
+	}
+
+	if(!buildSymbolList()) return FALSE;
+
+	for(i=0;i<sectCount;++i)
+	{
+		if(!convertRelocs(sectList+i,sectList[i].seg,0)) return FALSE;
+	}
+
+	symNameOfs=checkMalloc((symCount+1)*sizeof(UINT));
+	for(i=0;i<symCount;++i)
+	{
+		symNameOfs[i]=(strlen(symNames[i])>8)?addString(symNames[i]):0;
+	}
+
+	/* header, section table, then raw data and relocs for each section */
+	pos=COFF_BASE_HEADER_SIZE+sectCount*COFF_OBJECTENTRY_SIZE;
+	for(i=0;i<sectCount;++i)
+	{
+		if(sectList[i].data) pos+=sectList[i].length;
+		pos+=relocEntries(sectList+i)*COFF_RELOC_SIZE;
+	}
+	symPos=pos;
+	len=symPos+(2*sectCount+symCount)*COFF_SYMBOL_SIZE+4+stringLength;
+
+	d=createDataBlock(NULL,0,len,1);
+	buf=d->data;
+	memset(buf,0,len);
+
+	Set16(buf+COFF_MACHINEID,COFF_INTEL386);
+	Set16(buf+COFF_NUMOBJECTS,(USHORT)sectCount);
+	Set32(buf+COFF_SYMBOLPTR,symPos);
+	Set32(buf+COFF_NUMSYMBOLS,2*sectCount+symCount);
+	Set16(buf+COFF_FLAGS,COFF_FILE_32BIT);
+
+	pos=COFF_BASE_HEADER_SIZE+sectCount*COFF_OBJECTENTRY_SIZE;
+	for(i=0;i<sectCount;++i)
+	{
+		c=sectList+i;
+		p=buf+COFF_BASE_HEADER_SIZE+i*COFF_OBJECTENTRY_SIZE;
+		if(c->nameOfs)
+		{
+			sprintf((char*)p+COFF_OBJECT_NAME,"/%lu",c->nameOfs);
+		}
+		else if(c->seg->name)
+		{
+			memcpy(p+COFF_OBJECT_NAME,c->seg->name,strlen(c->seg->name));
+		}
+		Set32(p+COFF_OBJECT_FLAGS,getSectionFlags(c->seg)|(c->selection?WINF_COMDAT:0)
+		      |((c->relocCount>=0xffff)?WINF_EXT_RELOC:0));
+		if(c->data)
+		{
+			Set32(p+COFF_OBJECT_RAWSIZE,c->length);
+			Set32(p+COFF_OBJECT_RAWPTR,pos);
+			memcpy(buf+pos,c->data,c->length);
+			pos+=c->length;
+		}
+		else
+		{
+			Set32(p+COFF_OBJECT_RAWSIZE,c->seg->length);
+		}
+		if(c->relocCount)
+		{
+			Set32(p+COFF_OBJECT_RELPTR,pos);
+			if(c->relocCount>=0xffff)
+			{
+				/* real count goes in the first entry, which counts itself */
+				Set16(p+COFF_OBJECT_NUMREL,0xffff);
+				Set32(buf+pos,c->relocCount+1);
+				pos+=COFF_RELOC_SIZE;
+			}
+			else
+			{
+				Set16(p+COFF_OBJECT_NUMREL,(USHORT)c->relocCount);
+			}
+			memcpy(buf+pos,c->relocs,c->relocCount*COFF_RELOC_SIZE);
+			pos+=c->relocCount*COFF_RELOC_SIZE;
+		}
+	}
+
+	/* section symbols with their aux records, then publics and externs */
+	p=buf+symPos;
+	for(i=0;i<sectCount;++i)
+	{
+		c=sectList+i;
+		if(c->nameOfs)
+		{
+			Set32(p+4,c->nameOfs);
+		}
+		else if(c->seg->name)
+		{
+			memcpy(p+COFF_SYMBOL_NAME,c->seg->name,strlen(c->seg->name));
+		}
+		Set16(p+COFF_SYMBOL_SECTION,(USHORT)(i+1));
+		p[COFF_SYMBOL_STORAGE]=COFF_SYM_STATIC;
+		p[COFF_SYMBOL_NUMAUX]=1;
+		p+=COFF_SYMBOL_SIZE;
+		Set32(p,c->data?c->length:c->seg->length);
+		Set16(p+4,(USHORT)((c->relocCount>=0xffff)?0xffff:c->relocCount));
+		Set16(p+12,(USHORT)c->assoc);
+		p[14]=(UCHAR)c->selection;
+		p+=COFF_SYMBOL_SIZE;
+	}
+	for(i=0;i<symCount;++i)
+	{
+		if(symNameOfs[i])
+		{
+			Set32(p+4,symNameOfs[i]);
+		}
+		else
+		{
+			memcpy(p+COFF_SYMBOL_NAME,symNames[i],strlen(symNames[i]));
+		}
+		pub=symDefs[i];
+		if(pub && !pub->seg)
+		{
+			/* common, with its size as the value */
+			Set32(p+COFF_SYMBOL_VALUE,pub->length);
+		}
+		else if(pub && pub->seg->absolute)
+		{
+			Set32(p+COFF_SYMBOL_VALUE,pub->seg->base+pub->ofs);
+			Set16(p+COFF_SYMBOL_SECTION,0xffff);
+		}
+		else if(pub)
+		{
+			j=findSection(pub->seg,&pos);
+			Set32(p+COFF_SYMBOL_VALUE,pos+pub->ofs);
+			Set16(p+COFF_SYMBOL_SECTION,(USHORT)(j+1));
+		}
+		p[COFF_SYMBOL_STORAGE]=COFF_SYM_EXTERNAL;
+		p+=COFF_SYMBOL_SIZE;
+	}
+	Set32(p,stringLength+4);
+	if(stringLength) memcpy(p+4,stringTable,stringLength);
+
+	for(i=0;i<sectCount;++i)
+	{
+		checkFree(sectList[i].data);
+		checkFree(sectList[i].relocs);
+	}
+	checkFree(sectList);
+	checkFree(symNames);
+	checkFree(symDefs);
+	checkFree(symNameOfs);
+	checkFree(stringTable);
+
+	a=createSection("Global",NULL,NULL,NULL,0,1);
+	a->internal=TRUE;
+	a->addressspace=TRUE;
+	a->use32=TRUE;
+	addData(a,d);
+	spaceCount=1;
+	spaceList=checkMalloc(sizeof(PSEG));
+	spaceList[0]=a;
+
+	return TRUE;
+}
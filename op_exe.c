@@ -381,7 +381,9 @@ BOOL EXEFinalise(PCHAR name)
 	spaceList[0]=buildEXEHeader();
 	spaceList[1]->filepos=(spaceList[0]->length+0xf)&0xfffffff0;
 
+	beginPhase("performFixups");
 	performFixups(spaceList[0]);
 	performFixups(spaceList[1]);
+	endPhase();
 	return TRUE;
 }
@@ -1,5 +1,6 @@
 #include "alink.h"
 #include "pe.h"
+#include "mergerec.h"
 
 CSWITCHENTRY PESwitches[]={
 	{"dll",0,"Generate a DLL instead of an EXE"},
@@ -18,6 +19,8 @@ CSWITCHENTRY PESwitches[]={
 	{"stub",1,"Set MSDOS stub file to use"},
 	{"reloc",0,"Put relocation info in output file"},
 	{"debug",0,"Include debug info in output file"},
+	{"merge",2,"Merge first section into second"},
+	{"reproducible",0,"Derive timestamps from output contents, or SOURCE_DATE_EPOCH"},
 	{NULL,0,NULL}
 };
 
@@ -58,8 +61,8 @@ static PLINEREF debugLines=NULL;
 static UINT debugLineCount=0;
 
 static BOOL isDll=FALSE;
-static BOOL relocsRequired=FALSE;
-static BOOL debugRequired=FALSE;
+BOOL relocsRequired=FALSE;
+BOOL debugRequired=FALSE;
 static UINT imageBase=0x400000;
 static UINT stackSize=0x100000;
 static UINT stackCommitSize=0x1000;
@@ -81,6 +84,17 @@ static USHORT thisCpu=PE_INTEL386;
 static PSEG importSeg,exportSeg,relocSeg,resourceSeg,debugSeg,debugDir;
 static UINT impSegNum,expSegNum,relSegNum,resSegNum,debSegNum;
 
+static PPMERGEREC sectionMergeList=NULL;
+static UINT sectionMergeCount=0;
+
+/* timestamp fields, filled in once the contents are known if reproducible */
+static BOOL reproducible=FALSE;
+static BOOL gotLinkTime=FALSE;
+static UINT linkTime;
+static PPDATABLOCK stampBlocks=NULL;
+static UINT *stampOffsets=NULL;
+static UINT stampCount=0;
+
 static BOOL parseVersion(PCHAR str,UINT *major,UINT *minor)
 {
 	UINT numchars;
@@ -298,6 +312,16 @@ BOOL PEInitialise(PSWITCHPARAM sp)
 		{
 			getStub(sp->params[0],&stub,&stubSize);
 		}
+		else if(!strcmp(sp->name,"merge"))
+		{
+			sectionMergeList=checkRealloc(sectionMergeList,(sectionMergeCount+1)*sizeof(PMERGEREC));
+			sectionMergeList[sectionMergeCount]=createMergeRec(sp->params[0],sp->params[1]);
+			sectionMergeCount++;
+		}
+		else if(!strcmp(sp->name,"reproducible"))
+		{
+			reproducible=TRUE;
+		}
 	}
 
 	if(stackSize<stackCommitSize)
@@ -391,10 +415,117 @@ BOOL PEInitialise(PSWITCHPARAM sp)
 
 
 	defaultUse32=TRUE;
+	zeroFillIsUninit=TRUE;
+
+	return TRUE;
+}
+
+/* TRUE if timestamps will be derived from the contents of the image */
+BOOL PEHashedTimeStamps(void)
+{
+	PCHAR epoch;
+
+	if(!reproducible) return FALSE;
+	epoch=getenv("SOURCE_DATE_EPOCH");
+	return !epoch || !*epoch;
+}
+
+/* all timestamps in the image get the same value */
+static void setTimeStamp(PDATABLOCK d,UINT ofs)
+{
+	time_t now;
+	PCHAR epoch,end;
 
+	if(!gotLinkTime)
+	{
+		gotLinkTime=TRUE;
+		epoch=reproducible?getenv("SOURCE_DATE_EPOCH"):NULL;
+		if(epoch && *epoch)
+		{
+			linkTime=strtoul(epoch,&end,10);
+			if(*end)
+			{
+				addError("Invalid SOURCE_DATE_EPOCH %s",epoch);
+			}
+			/* fixed time, nothing to fill in later */
+			reproducible=FALSE;
+		}
+		else
+		{
+			time(&now);
+			linkTime=now;
+		}
+	}
+	if(reproducible)
+	{
+		stampBlocks=checkRealloc(stampBlocks,(stampCount+1)*sizeof(PDATABLOCK));
+		stampOffsets=checkRealloc(stampOffsets,(stampCount+1)*sizeof(UINT));
+		stampBlocks[stampCount]=d;
+		stampOffsets[stampCount]=ofs;
+		stampCount++;
+		Set32(&d->data[ofs],0);
+		return;
+	}
+	Set32(&d->data[ofs],linkTime);
+}
+
+static BOOL hashChunk(PUCHAR p,UINT len,void *ctx)
+{
+	*(UINT *)ctx=hashBytes(*(UINT *)ctx,p,len);
 	return TRUE;
 }
 
+/* hash count zero bytes, as padding in the file */
+static UINT hashZeroes(UINT h,UINT count)
+{
+	static UCHAR zeroes[4096];
+	UINT n;
+
+	while(count)
+	{
+		n=(count>sizeof(zeroes))?sizeof(zeroes):count;
+		h=hashBytes(h,zeroes,n);
+		count-=n;
+	}
+	return h;
+}
+
+/* hash of the bytes written to the output file, in file order with timestamps zero */
+/* only the contents count, not how they are split into blocks */
+static UINT hashSegData(PSEG s,UINT h,UINT *pos)
+{
+	UINT i;
+	PDATABLOCK d;
+
+	for(i=0;i<s->contentCount;i++)
+	{
+		switch(s->contentList[i].flag)
+		{
+		case DATA:
+			d=s->contentList[i].data;
+			/* zero-filled blocks are only in the file as padding before later data */
+			if(!d->length || isZeroBlock(d)) break;
+			if(s->filepos+d->offset>*pos)
+			{
+				h=hashZeroes(h,s->filepos+d->offset-*pos);
+				*pos=s->filepos+d->offset;
+			}
+			scanDataBlock(d,hashChunk,&h);
+			*pos+=d->length;
+			break;
+		case SEGMENT:
+			if(!s->contentList[i].seg->absolute)
+			{
+				if(!s->contentList[i].seg->fpset)
+					s->contentList[i].seg->filepos=s->filepos+s->contentList[i].seg->base;
+				h=hashSegData(s->contentList[i].seg,h,pos);
+			}
+			break;
+		}
+	}
+	return h;
+}
+
 static PSEG createPEHeader(void)
 {
 	PSEG h,lastSeg,codestart=NULL,codeend=NULL,datastart=NULL,dataend=NULL;
@@ -402,7 +533,6 @@ static PSEG createPEHeader(void)
 	UINT headbufSize;
 	PDATABLOCK headBlock,objectBlock;
 	UINT i,j,k;
-	time_t now;
 
 	h=createSection("PEHeader",NULL,NULL,NULL,0,1);
 	h->internal=TRUE;
@@ -419,8 +549,7 @@ static PSEG createPEHeader(void)
 
 	Set16(&headbuf[PE_MACHINEID],thisCpu);
 
-	time(&now);
-	Set32(&headbuf[PE_DATESTAMP],now);
+	setTimeStamp(headBlock,PE_DATESTAMP);
 
 	Set16(&headbuf[PE_HDRSIZE],PE_OPTIONAL_HEADER_SIZE);
 
@@ -984,7 +1113,6 @@ static BOOL buildPEResources(void)
 	PDATABLOCK typeHeader=NULL,idHeader=NULL,langHeader=NULL;
 	PDATABLOCK typeEntry,idEntry,langEntry,dataEntry,nameEntry,realData;
 	UINT typenameCount=0,typeidCount=0,nameCount=0,idCount=0,langCount=0;
-	time_t now;
 
 	if(!globalResourceCount) return TRUE;
 
@@ -1000,9 +1128,6 @@ static BOOL buildPEResources(void)
 	/* sort resources into order */
 	qsort(globalResources,globalResourceCount,sizeof(RESOURCE),resourceCompare);
 
-	/* get time */
-	time(&now);
-
 	typeSeg=createSection("Type Directory",NULL,NULL,NULL,0,4);
 	typeSeg->internal=TRUE;
 	typeSeg->use32=TRUE;
@@ -1042,7 +1167,7 @@ static BOOL buildPEResources(void)
 	typeHeader=createDataBlock(NULL,0,PE_RES_DIRHDR_SIZE,4);
 	addData(typeSeg,typeHeader);
 
-	Set32(&typeHeader->data[PE_RES_DIRHDR_TIME],now);
+	setTimeStamp(typeHeader,PE_RES_DIRHDR_TIME);
 
 	for(i=0;i<globalResourceCount;++i)
 	{
@@ -1070,7 +1195,7 @@ static BOOL buildPEResources(void)
 			addData(idSeg,idHeader);
 			nameCount=idCount=0;
 
-			Set32(&idHeader->data[PE_RES_DIRHDR_TIME],now);
+			setTimeStamp(idHeader,PE_RES_DIRHDR_TIME);
 
 			/* new entry in type directory */
 			typeEntry=createDataBlock(NULL,0,PE_RES_DIRENTRY_SIZE,4);
@@ -1130,7 +1255,7 @@ static BOOL buildPEResources(void)
 			addData(langSeg,langHeader);
 			langCount=0;
 
-			Set32(&langHeader->data[PE_RES_DIRHDR_TIME],now);
+			setTimeStamp(langHeader,PE_RES_DIRHDR_TIME);
 
 			/* new entry in id directory */
 			idEntry=createDataBlock(NULL,0,PE_RES_DIRENTRY_SIZE,4);
@@ -1249,7 +1374,6 @@ static BOOL buildPEExports(PCHAR name)
 	PDATABLOCK addrEntry,nameEntry,ordEntry,realName,forwarderEntry,hdr;
 	BOOL isName,isForwarder;
 	PCHAR forwarderString;
-	time_t now;
 
 	/* nothing to do if no exports */
 	if(!globalExportCount) return TRUE;
@@ -1434,9 +1558,7 @@ static BOOL buildPEExports(PCHAR name)
 		}
 	}
 
-	time(&now);
-
-	Set32(&hdr->data[PE_EXPORT_TIME],now);
+	setTimeStamp(hdr,PE_EXPORT_TIME);
 	Set32(&hdr->data[PE_EXPORT_NUMEXPORTS],numExports);
 	Set32(&hdr->data[PE_EXPORT_NUMNAMES],numNames);
 	Set32(&hdr->data[PE_EXPORT_ORDINALBASE],minOrd);
@@ -2224,7 +2346,6 @@ static BOOL buildPEDebug(PCHAR name)
 {
 	PSEG debugData;
 	PDATABLOCK dirEntry;
-	time_t now;
 
 	/* debug section starts with a directory listing the types of debug info available */
 	debugDir=createSection("Debug Directory",NULL,NULL,NULL,0,1);
@@ -2233,7 +2354,9 @@ static BOOL buildPEDebug(PCHAR name)
 	addSeg(debugSeg,debugDir);
 
 	/* we want to create CodeView debug info */
+	beginPhase("buildCodeViewInfo");
 	debugData=buildCodeViewInfo(name);
+	endPhase();
 	if(debugData)
 	{
 		/* add it to debug info seg */
@@ -2242,8 +2365,7 @@ static BOOL buildPEDebug(PCHAR name)
 		/* we need a directory entry for it */
 		dirEntry=createDataBlock(NULL,0,PE_DEBUGDIR_SIZE,1);
 		addData(debugDir,dirEntry);
-		time(&now);
-		Set32(&dirEntry->data[4],now);
+		setTimeStamp(dirEntry,4);
 
 		dirEntry->data[12]=PE_DEBUG_CODEVIEW;
 
@@ -2274,11 +2396,100 @@ static BOOL buildPEDebug(PCHAR name)
 	return TRUE;
 }
 
-static UINT calcSegChecksum(PSEG s,UINT *pos)
+static BOOL mergePESections(void)
+{
+	UINT i,j;
+	PSEG src,dst;
+	PCHAR srcName,dstName;
+
+	for(i=0;i<sectionMergeCount;++i)
+	{
+		srcName=sectionMergeList[i]->sourceName;
+		dstName=sectionMergeList[i]->targetName;
+		if(!strcmp(srcName,dstName)) continue;
+
+		dst=NULL;
+		for(j=0;j<globalSegCount;++j)
+		{
+			if(!globalSegs[j] || globalSegs[j]->absolute) continue;
+			if(globalSegs[j]->name && !strcmp(globalSegs[j]->name,dstName))
+			{
+				dst=globalSegs[j];
+				break;
+			}
+		}
+		if(dst && (dst==debugSeg))
+		{
+			addError("Cannot merge section %s into debug section",srcName);
+			return FALSE;
+		}
+
+		for(j=0;j<globalSegCount;++j)
+		{
+			src=globalSegs[j];
+			if(!src || (src==dst) || src->absolute) continue;
+			if(!src->name || strcmp(src->name,srcName)) continue;
+			if(src==debugSeg)
+			{
+				addError("Cannot merge debug section %s",srcName);
+				return FALSE;
+			}
+			if(!dst)
+			{
+				/* no such target section, so just rename the source */
+				diagnostic(DIAG_VERBOSE,"Renaming section %s to %s\n",srcName,dstName);
+				checkFree(src->name);
+				src->name=checkStrdup(dstName);
+				dst=src;
+				continue;
+			}
+			/* don't give the target section rights it didn't have */
+			if((src->write && !dst->write) || (src->execute && !dst->execute))
+			{
+				addError("Cannot merge section %s into %s, incompatible access rights",srcName,dstName);
+				return FALSE;
+			}
+			diagnostic(DIAG_VERBOSE,"Merging section %s into %s\n",srcName,dstName);
+			addSeg(dst,src);
+			globalSegs[j]=NULL;
+		}
+	}
+	return TRUE;
+}
+
+/* running checksum of file contents, and its position in the file */
+typedef struct checksumstate
+{
+	UINT sum;
+	UINT pos;
+} CHECKSUMSTATE,*PCHECKSUMSTATE;
+
+static BOOL checksumChunk(PUCHAR p,UINT len,void *ctx)
+{
+	PCHECKSUMSTATE c=ctx;
+	UINT j;
+
+	for(j=0;j<len;++j,++c->pos)
+	{
+		if(c->pos&1)
+		{
+			c->sum+=p[j]<<8;
+		}
+		else
+		{
+			c->sum+=p[j];
+		}
+		c->sum=(c->sum&0xffff)+(c->sum>>16);
+	}
+	return TRUE;
+}
+
+UINT calcSegChecksum(PSEG s,UINT *pos)
 {
 	UINT i,j;
 	PDATABLOCK d;
 	UINT sum=0;
+	CHECKSUMSTATE c;
 
 	if(!s) return 0;
 	if(!pos) return 0;
@@ -2296,26 +2507,19 @@ static UINT calcSegChecksum(PSEG s,UINT *pos)
 		{
 		case DATA:
 			d=s->contentList[i].data;
-			/* no output for zero-length data blocks */
-			if(!d->length) break;
+			/* no output for zero-length or zero-filled data blocks */
+			if(!d->length || isZeroBlock(d)) break;
 			j=s->filepos+d->offset-(*pos); /* get number of zeroes to pad with */
 			while(j)
 			{
 				(*pos)++;
 				j--;
 			}
-			for(j=0;j<d->length;++j,++(*pos))
-			{
-				if((*pos)&1)
-				{
-					sum+=d->data[j]<<8;
-				}
-				else
-				{
-					sum+=d->data[j];
-				}
-				sum=(sum&0xffff)+(sum>>16);
-			}
+			c.sum=sum;
+			c.pos=*pos;
+			scanDataBlock(d,checksumChunk,&c);
+			sum=c.sum;
+			*pos=c.pos;
 
 			break;
 		case SEGMENT:
@@ -2354,12 +2558,20 @@ BOOL PEFinalise(PCHAR name)
 	addData(h,stubBlock);
 	if(stub!=defaultStub) checkFree(stub);
 
+	beginPhase("buildPEImports");
 	buildPEImports();
+	endPhase();
+	beginPhase("buildPEResources");
 	buildPEResources();
+	endPhase();
+	beginPhase("buildPEExports");
 	buildPEExports(name);
+	endPhase();
 	if(relocsRequired)
 	{
+		beginPhase("buildPERelocs");
 		buildPERelocs();
+		endPhase();
 	}
 	if(importSeg && !importSeg->length && !importSeg->parent)
 	{
@@ -2386,6 +2598,11 @@ BOOL PEFinalise(PCHAR name)
 		globalSegs[resSegNum]=NULL;
 	}
 
+	if(!mergePESections())
+	{
+		return FALSE;
+	}
+
 	if(debugRequired)
 	{
 		buildPEDebug(name);
@@ -2397,7 +2614,9 @@ BOOL PEFinalise(PCHAR name)
 		globalSegs[debSegNum]=NULL;
 	}
 
+	beginPhase("createPEHeader");
 	addSeg(h,header=createPEHeader());
+	endPhase();
 
 	Set32(&stubBlock->data[PE_SIGNATURE_OFFSET],header->base);
 
@@ -2423,7 +2642,24 @@ BOOL PEFinalise(PCHAR name)
 		globalSegs[i]=NULL;
 	}
 
+	beginPhase("performFixups");
 	performFixups(a);
+	endPhase();
+
+	if(stampCount)
+	{
+		fp=0;
+		linkTime=hashSegData(a,HASH_INIT,&fp);
+		for(i=0;i<stampCount;++i)
+		{
+			Set32(&stampBlocks[i]->data[stampOffsets[i]],linkTime);
+		}
+		checkFree(stampBlocks);
+		checkFree(stampOffsets);
+		stampBlocks=NULL;
+		stampOffsets=NULL;
+		stampCount=0;
+	}
 
 	fp=0;
 	i=calcSegChecksum(a,&fp);
@@ -26,6 +26,7 @@ void performFixups(PSEG s)
 	for(i=0;i<s->relocCount;++i)
 	{
 		r=s->relocs+i;
+		fixupsApplied++;
 		for(j=0;j<s->contentCount;++j)
 		{
 			if(s->contentList[j].flag!=DATA) continue;
@@ -39,6 +40,7 @@ void performFixups(PSEG s)
 		}
 		d=s->contentList[j].data;
 		offset=r->ofs-d->offset;
+		fillDataBlock(d);
 
 		t=NULL;
 		disp=0;
@@ -5,7 +5,11 @@ PDATABLOCK createDataBlock(PUCHAR p,UINT offset,UINT length,UINT align)
 	PDATABLOCK d;
 
 	d=(PDATABLOCK)checkMalloc(sizeof(DATABLOCK));
+	dataBlocksCreated++;
 	d->data=checkMalloc(length);
+	d->iterated=NULL;
+	d->deferFile=NULL;
+	d->deferPos=0;
 	if(p)
 	{
 		memcpy(d->data,p,length);
@@ -21,10 +25,293 @@ PDATABLOCK createDataBlock(PUCHAR p,UINT offset,UINT length,UINT align)
 	return d;
 }
 
+/* block of zeroes, with no memory behind it until it is needed */
+PDATABLOCK createZeroDataBlock(UINT offset,UINT length,UINT align)
+{
+	PDATABLOCK d;
+
+	d=(PDATABLOCK)checkMalloc(sizeof(DATABLOCK));
+	dataBlocksCreated++;
+	d->data=NULL;
+	d->iterated=NULL;
+	d->deferFile=NULL;
+	d->deferPos=0;
+	d->offset=offset;
+	d->length=length;
+	d->align=align;
+
+	return d;
+}
+
+/* block of iterated data, which takes over the repeat tree */
+PDATABLOCK createIteratedDataBlock(PLIBLOCK p,UINT offset,UINT align)
+{
+	PDATABLOCK d;
+
+	d=createZeroDataBlock(offset,p->length*p->count,align);
+	d->iterated=p;
+
+	return d;
+}
+
+/* block whose data is left in file at pos, to be read if it is kept */
+PDATABLOCK createDeferredDataBlock(PCHAR file,UINT pos,UINT length,UINT align)
+{
+	PDATABLOCK d;
+
+	d=createZeroDataBlock(0,length,align);
+	d->deferFile=file;
+	d->deferPos=pos;
+
+	return d;
+}
+
+BOOL isZeroBlock(PDATABLOCK d)
+{
+	return !d->data && !d->iterated && !d->deferFile;
+}
+
+static PFILE deferredFile=NULL;
+static PCHAR deferredName=NULL;
+
+/* read the data of a deferred block into buf, keeping the last file open */
+static void readDeferredData(PDATABLOCK d,PUCHAR buf)
+{
+	if(!deferredFile || strcmp(deferredName,d->deferFile))
+	{
+		if(deferredFile) fclose(deferredFile);
+		deferredName=d->deferFile;
+		deferredFile=fopen(deferredName,"rb");
+	}
+	if(!deferredFile || fseek(deferredFile,d->deferPos,SEEK_SET)
+	   || (fread(buf,1,d->length,deferredFile)!=d->length))
+	{
+		addError("Unable to read data from %s",d->deferFile);
+		memset(buf,0,d->length);
+	}
+}
+
+void freeLiBlock(PLIBLOCK p)
+{
+	UINT i;
+
+	if(!p) return;
+	for(i=0;i<p->blocks;i++)
+	{
+		freeLiBlock(((PPLIBLOCK)p->data)[i]);
+	}
+	checkFree(p->data);
+	checkFree(p);
+}
+
+/* expand iterated data into memory, advancing *out */
+static void copyLiBlock(PLIBLOCK p,PUCHAR *out)
+{
+	UINT i,j;
+	PUCHAR start=*out;
+
+	if(!p->count || !p->length) return;
+	if(p->blocks)
+	{
+		for(j=0;j<p->blocks;j++)
+		{
+			copyLiBlock(((PPLIBLOCK)p->data)[j],out);
+		}
+	}
+	else
+	{
+		memcpy(*out,((PUCHAR)p->data)+1,p->length);
+		(*out)+=p->length;
+	}
+	for(i=1;i<p->count;i++)
+	{
+		memcpy(*out,start,p->length);
+		(*out)+=p->length;
+	}
+}
+
+/* emit short repeats from a buffer holding as many of them as fit */
+static BOOL emitLiRepeats(PLIBLOCK p,PDATAFUNC emit,void *ctx)
+{
+	UCHAR rep[4096];
+	PUCHAR out=rep;
+	UINT per,i,n;
+	LIBLOCK one;
+
+	one=*p;
+	per=sizeof(rep)/p->length;
+	if(per>p->count) per=p->count;
+	one.count=per;
+	copyLiBlock(&one,&out);
+	for(i=0;i<p->count;i+=n)
+	{
+		n=(p->count-i>per)?per:(p->count-i);
+		if(!emit(rep,n*p->length,ctx)) return FALSE;
+	}
+	return TRUE;
+}
+
+/* pass the expansion of iterated data to emit, piece by piece */
+static BOOL emitLiBlock(PLIBLOCK p,PDATAFUNC emit,void *ctx)
+{
+	UINT i,j;
+
+	if(!p->count || !p->length) return TRUE;
+	if(p->length<=2048) return emitLiRepeats(p,emit,ctx);
+	for(i=0;i<p->count;i++)
+	{
+		for(j=0;j<p->blocks;j++)
+		{
+			if(!emitLiBlock(((PPLIBLOCK)p->data)[j],emit,ctx)) return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* give a zero-filled or iterated block real contents, so it can be modified */
+PUCHAR fillDataBlock(PDATABLOCK d)
+{
+	PUCHAR p;
+
+	if(!d->data)
+	{
+		p=checkMalloc(d->length);
+		copyDataBlock(d,p);
+		d->data=p;
+		freeLiBlock(d->iterated);
+		d->iterated=NULL;
+		d->deferFile=NULL;
+	}
+	return d->data;
+}
+
+/* contents of d, however they are held */
+void copyDataBlock(PDATABLOCK d,PUCHAR buf)
+{
+	if(d->data)
+	{
+		memcpy(buf,d->data,d->length);
+	}
+	else if(d->iterated)
+	{
+		copyLiBlock(d->iterated,&buf);
+	}
+	else if(d->deferFile)
+	{
+		readDeferredData(d,buf);
+	}
+	else
+	{
+		memset(buf,0,d->length);
+	}
+}
+
+static UCHAR zeroes[4096];
+
+/* pass the contents of d to emit piece by piece, without expanding them in memory */
+BOOL scanDataBlock(PDATABLOCK d,PDATAFUNC emit,void *ctx)
+{
+	UINT i,n;
+
+	if(d->deferFile) fillDataBlock(d);
+	if(d->data) return emit(d->data,d->length,ctx);
+	if(d->iterated) return emitLiBlock(d->iterated,emit,ctx);
+	for(i=0;i<d->length;i+=n)
+	{
+		n=(d->length-i>sizeof(zeroes))?sizeof(zeroes):(d->length-i);
+		if(!emit(zeroes,n,ctx)) return FALSE;
+	}
+	return TRUE;
+}
+
+typedef struct deferredload
+{
+	PDATABLOCK d;
+	PSEG s;
+} DEFERREDLOAD,*PDEFERREDLOAD;
+
+static PDEFERREDLOAD deferredList;
+static UINT deferredCount;
+
+static void listDeferredData(PSEG s)
+{
+	UINT i;
+
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag==SEGMENT)
+		{
+			listDeferredData(s->contentList[i].seg);
+		}
+		else if(s->contentList[i].data->deferFile)
+		{
+			deferredList=checkRealloc(deferredList,(deferredCount+1)*sizeof(DEFERREDLOAD));
+			deferredList[deferredCount].d=s->contentList[i].data;
+			deferredList[deferredCount].s=s;
+			deferredCount++;
+		}
+	}
+}
+
+static int deferredCompare(const void *x1,const void *x2)
+{
+	PDATABLOCK d1=((PDEFERREDLOAD)x1)->d;
+	PDATABLOCK d2=((PDEFERREDLOAD)x2)->d;
+	int i;
+
+	i=strcmp(d1->deferFile,d2->deferFile);
+	if(i) return i;
+	if(d1->deferPos<d2->deferPos) return -1;
+	if(d1->deferPos>d2->deferPos) return 1;
+	return 0;
+}
+
+/* read the data of every deferred block still in use, a file at a time */
+void loadDeferredData(void)
+{
+	UINT i;
+	PDATABLOCK d;
+	PUCHAR p;
+
+	deferredList=NULL;
+	deferredCount=0;
+	for(i=0;i<globalSegCount;++i)
+	{
+		if(globalSegs[i]) listDeferredData(globalSegs[i]);
+	}
+	if(deferredCount)
+	{
+		qsort(deferredList,deferredCount,sizeof(DEFERREDLOAD),deferredCompare);
+	}
+	for(i=0;i<deferredCount;++i)
+	{
+		d=deferredList[i].d;
+		p=checkMalloc(d->length);
+		readDeferredData(d,p);
+		d->deferFile=NULL;
+		/* keep zeroes only as a length, unless fixups will go there */
+		if(!deferredList[i].s->relocCount && isZeroData(p,d->length))
+		{
+			checkFree(p);
+			p=NULL;
+		}
+		d->data=p;
+	}
+	checkFree(deferredList);
+	deferredList=NULL;
+	deferredCount=0;
+	if(deferredFile)
+	{
+		fclose(deferredFile);
+		deferredFile=NULL;
+	}
+}
+
 void freeDataBlock(PDATABLOCK d)
 {
 	if(!d) return;
 	checkFree(d->data);
+	freeLiBlock(d->iterated);
 	checkFree(d);
 }
 
@@ -33,6 +320,7 @@ PSEG createSection(PCHAR name,PCHAR class,PCHAR sortKey,PMODULE mod,UINT length,
 	PSEG s;
 
 	s=(PSEG)checkMalloc(sizeof(SEG));
+	segmentsCreated++;
 	s->name=checkStrdup(name);
 	s->class=checkStrdup(class);
 	s->sortKey=checkStrdup(sortKey);
@@ -64,6 +352,7 @@ PSEG createSection(PCHAR name,PCHAR class,PCHAR sortKey,PMODULE mod,UINT length,
 	s->nopage=FALSE;
 	s->addressspace=s->group=FALSE;
 	s->internal=FALSE;
+	s->initKnown=FALSE;
 
 	s->contentCount=0;
 	s->contentList=NULL;
@@ -86,6 +375,7 @@ PSEG createDuplicateSection(PSEG old)
 	if(!old) return NULL;
 
 	s=(PSEG)checkMalloc(sizeof(SEG));
+	segmentsCreated++;
 	s->name=checkStrdup(old->name);
 	s->class=checkStrdup(old->class);
 	s->sortKey=checkStrdup(old->sortKey);
@@ -115,6 +405,7 @@ PSEG createDuplicateSection(PSEG old)
 	s->nocache=old->nocache;
 	s->nopage=old->nopage;
 	s->internal=old->internal;
+	s->initKnown=FALSE;
 
 	s->parent=NULL;
 
@@ -162,6 +453,7 @@ static void realignSeg(PSEG s)
 	UINT x,i,oldlength;
 	PCONTENT c;
 
+	invalidateInitLength(s);
 	while(s)
 	{
 		oldlength=s->length;
@@ -229,6 +521,7 @@ PSEG removeContent(PSEG s,UINT i)
 	/* move down data */
 	s->contentCount--;
 	memmove(s->contentList+i,s->contentList+i+1,(s->contentCount-i)*sizeof(CONTENT));
+	invalidateInitLength(s);
 
 	/* re align seg content, and parent segs, now we've removed this entry */
 	realignSeg(s);
@@ -238,81 +531,94 @@ PSEG removeContent(PSEG s,UINT i)
 }
 
 
-PSEG addSeg(PSEG s,PSEG c)
+/* add several child segments in order, with a single realignment of the parents */
+PSEG addSegs(PSEG s,PPSEG list,UINT count)
 {
-	UINT i;
-	PSEG p;
+	UINT i,j;
+	PSEG p,c;
+	BOOL grown=FALSE;
 
 	if(!s)
 	{
 		addError("Attempt to add to NULL segment");
 		return NULL;
 	}
-	if(!c)
+	for(j=0;j<count;++j)
 	{
-		addError("Attempt to add a NULL entry to segment %s",s->name);
-		return NULL;
-	}
-	if(c->addressspace)
-	{
-		addError("Attempt to add an address space to another segment");
-		return NULL;
+		if(!list[j])
+		{
+			addError("Attempt to add a NULL entry to segment %s",s->name);
+			return NULL;
+		}
+		if(list[j]->addressspace)
+		{
+			addError("Attempt to add an address space to another segment");
+			return NULL;
+		}
 	}
+	if(!count) return s;
 
-	/* add child segment to content list for parent */
-	s->contentList=(PCONTENT)checkRealloc(s->contentList, (s->contentCount+1)*sizeof(CONTENT));
-	s->contentList[s->contentCount].flag=SEGMENT;
-	s->contentList[s->contentCount].seg=c;
-	s->contentCount++;
+	/* add child segments to content list for parent */
+	s->contentList=(PCONTENT)checkRealloc(s->contentList, (s->contentCount+count)*sizeof(CONTENT));
+	invalidateInitLength(s);
 
-	/* flag parent-child relationship */
-	c->parent=s;
+	for(j=0;j<count;++j)
+	{
+		c=list[j];
+		s->contentList[s->contentCount].flag=SEGMENT;
+		s->contentList[s->contentCount].seg=c;
+		s->contentCount++;
 
-	if(c->absolute) return s; /* don't adjust lengths for absolute segs */
+		/* flag parent-child relationship */
+		c->parent=s;
 
-	if((s->use32 != c->use32) && (s->contentCount-1))
-	{
-		diagnostic(DIAG_BASIC,"Warning: combining USE32 %s %s with USE16 %s %s\n",
-		           (s->use32?s->group:c->group)?"group":"segment",
-		           s->use32?s->name:c->name,
-		           (s->use32?c->group:s->group)?"group":"segment",
-		           s->use32?c->name:s->name);
-	}
+		if(c->absolute) continue; /* don't adjust lengths for absolute segs */
 
-	p=c;
-	while(p->parent)
-	{
-		/* positive flags => set if any combined seg has them */
-		p->parent->code|=p->code;
-		p->parent->initdata|=p->initdata;
-		p->parent->uninitdata|=p->uninitdata;
-		p->parent->execute|=p->execute;
-		p->parent->read|=p->read;
-		p->parent->write|=p->write;
-		p->parent->use32|=p->use32;
-		p->parent->nopage|=p->nopage;
-		p->parent->nocache|=p->nocache;
+		if((s->use32 != c->use32) && (s->contentCount-1))
+		{
+			diagnostic(DIAG_BASIC,"Warning: combining USE32 %s %s with USE16 %s %s\n",
+			           (s->use32?s->group:c->group)?"group":"segment",
+			           s->use32?s->name:c->name,
+			           (s->use32?c->group:s->group)?"group":"segment",
+			           s->use32?c->name:s->name);
+		}
 
-		/* mutual agreement flags => lost if any combined seg doesn't have them */
-		p->parent->moveable&=p->moveable;
-		p->parent->discardable&=p->discardable;
-		p->parent->shared&=p->shared;
-		p=p->parent;
-	}
+		p=c;
+		while(p->parent)
+		{
+			/* positive flags => set if any combined seg has them */
+			p->parent->code|=p->code;
+			p->parent->initdata|=p->initdata;
+			p->parent->uninitdata|=p->uninitdata;
+			p->parent->execute|=p->execute;
+			p->parent->read|=p->read;
+			p->parent->write|=p->write;
+			p->parent->use32|=p->use32;
+			p->parent->nopage|=p->nopage;
+			p->parent->nocache|=p->nocache;
+
+			/* mutual agreement flags => lost if any combined seg doesn't have them */
+			p->parent->moveable&=p->moveable;
+			p->parent->discardable&=p->discardable;
+			p->parent->shared&=p->shared;
+			p=p->parent;
+		}
 
-	/* set base of child, and adjust length of parent */
-	i=s->length;
-	i+=c->align-1;
-	i&=UINT_MAX-(c->align-1);
-	c->base=i;
+		/* set base of child, and adjust length of parent */
+		i=s->length;
+		i+=c->align-1;
+		i&=UINT_MAX-(c->align-1);
+		c->base=i;
 
-	i-=s->length; /* get extra length */
-	s->length+=i+c->length;
+		i-=s->length; /* get extra length */
+		s->length+=i+c->length;
 
-	if(c->align>s->align) s->align=c->align; /* update alignment */
+		if(c->align>s->align) s->align=c->align; /* update alignment */
+		grown=TRUE;
+	}
 
 	/* propogate length increase up parent tree */
-	if(s->parent)
+	if(grown && s->parent)
 	{
 		realignSeg(s->parent);
 	}
@@ -320,6 +626,11 @@ PSEG addSeg(PSEG s,PSEG c)
 	return s;
 }
 
+PSEG addSeg(PSEG s,PSEG c)
+{
+	return addSegs(s,&c,1);
+}
+
 PSEG addCommonSeg(PSEG s,PSEG c)
 {
 	UINT j;
@@ -343,6 +654,8 @@ PSEG addCommonSeg(PSEG s,PSEG c)
 	c->contentCount=0;
 	c->length=0;
 	c->base=0;
+	c->initKnown=FALSE;
+	invalidateInitLength(s);
 	/* add child seg at start of parent */
 	s->contentList=checkRealloc(s->contentList,(s->contentCount+1)*sizeof(CONTENT));
 	if(s->contentCount)
@@ -386,6 +699,7 @@ PSEG addData(PSEG s,PDATABLOCK c)
 	s->contentList[s->contentCount].flag=DATA;
 	s->contentList[s->contentCount].data=c;
 	s->contentCount++;
+	invalidateInitLength(s);
 
 	/* set base of child, and adjust length of parent */
 	i=s->length;
@@ -468,6 +782,7 @@ PSEG addFixedData(PSEG s,PDATABLOCK c)
 
 	s->contentList[i].flag=DATA;
 	s->contentList[i].data=c;
+	invalidateInitLength(s);
 
 	if(c->align>s->align) s->align=c->align; /* update alignment */
 
@@ -480,11 +795,56 @@ PSEG addFixedData(PSEG s,PDATABLOCK c)
 	return s;
 }
 
+/* grow d, the last data block of s, by length bytes from p */
+/* space is the size allocated for d->data, and is doubled as needed */
+PSEG extendFixedData(PSEG s,PDATABLOCK d,PUCHAR p,UINT length,UINT *space)
+{
+	UINT need;
+
+	if(!s || !d || !d->data) return NULL;
+	if(!s->contentCount || (s->contentList[s->contentCount-1].flag!=DATA)
+	   || (s->contentList[s->contentCount-1].data!=d))
+	{
+		return NULL;
+	}
+
+	need=d->length+length;
+	if(need>*space)
+	{
+		*space=((*space*2)>need)?(*space*2):need;
+		d->data=checkRealloc(d->data,*space);
+	}
+	memcpy(d->data+d->length,p,length);
+	d->length=need;
+	if((d->offset+d->length)>s->length)
+	{
+		s->length=d->offset+d->length;
+	}
+	invalidateInitLength(s);
+
+	if(s->parent)
+	{
+		realignSeg(s->parent);
+	}
+
+	return s;
+}
+
+/* forget the initialised length of a segment and the segments containing it */
+void invalidateInitLength(PSEG s)
+{
+	for(;s;s=s->parent)
+	{
+		s->initKnown=FALSE;
+	}
+}
+
 UINT getInitLength(PSEG s)
 {
 	UINT i;
 	UINT ofs=0,ofs2;
 
+	if(s->initKnown) return s->initLength;
 	for(i=0;i<s->contentCount;++i)
 	{
 		if(s->contentList[i].flag==SEGMENT)
@@ -497,14 +857,45 @@ UINT getInitLength(PSEG s)
 		else
 		{
 			ofs2=s->contentList[i].data->length;
+			if(isZeroBlock(s->contentList[i].data) && zeroFillIsUninit)
+				ofs2=0; /* left to the loader to clear */
 			if(ofs2)
 				ofs2+=s->contentList[i].data->offset;
 		}
 		if(ofs2>ofs) ofs=ofs2;
 	}
+	s->initLength=ofs;
+	s->initKnown=TRUE;
 	return ofs;
 }
 
+static BOOL writeZeroes(FILE *f,UINT count)
+{
+	UINT n;
+
+	while(count)
+	{
+		n=(count>sizeof(zeroes))?sizeof(zeroes):count;
+		if(fwrite(zeroes,1,n,f)!=n)
+		{
+			addError("Error writing to file");
+			return FALSE;
+		}
+		count-=n;
+	}
+	return TRUE;
+}
+
+static BOOL writeChunk(PUCHAR p,UINT len,void *ctx)
+{
+	if(fwrite(p,1,len,(FILE *)ctx)!=len)
+	{
+		addError("Error writing to file");
+		return FALSE;
+	}
+	return TRUE;
+}
+
 BOOL writeSeg(FILE *f,PSEG s)
 {
 	UINT i,j;
@@ -529,21 +920,12 @@ BOOL writeSeg(FILE *f,PSEG s)
 			d=s->contentList[i].data;
 			/* no output for zero-length data blocks */
 			if(!d->length) break;
+			/* nor for zero-filled ones, if the loader clears them */
+			if(isZeroBlock(d) && zeroFillIsUninit) break;
 			j=s->filepos+d->offset-ftell(f); /* get number of zeroes to pad with */
-			while(j)
-			{
-				if(fputc(0,f)==EOF)
-				{
-					addError("Error writing to file");
-					return FALSE;
-				}
-				j--;
-			}
-			if(fwrite(d->data,1,d->length,f)!=d->length)
-			{
-				addError("Error writing to file");
-				return FALSE;
-			}
+			if(!writeZeroes(f,j)) return FALSE;
+			/* iterated data is expanded straight into the file */
+			if(!scanDataBlock(d,writeChunk,f)) return FALSE;
 
 			break;
 		case SEGMENT:
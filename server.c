@@ -0,0 +1,406 @@
+#include "alink.h"
+
+/* link server, runs each link in a forked child so every link starts */
+/* from clean globals, while library indexes stay cached in the parent */
+
+#if defined(GOT_FORK) && defined(GOT_SYS_UN_H)
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+
+/* frames sent back to the client, a type byte then 4 byte length */
+#define FRAME_OUTPUT 'O'
+#define FRAME_EXIT 'X'
+
+#define MAX_REQUEST 0x100000
+
+static int reportFd=-1;
+static int listenFd=-1; /* closed in each child */
+
+static BOOL writeAll(int fd,PUCHAR buf,UINT len)
+{
+	INT n;
+
+	while(len)
+	{
+		n=write(fd,buf,len);
+		if(n<0)
+		{
+			if(errno==EINTR) continue;
+			return FALSE;
+		}
+		buf+=n;
+		len-=n;
+	}
+	return TRUE;
+}
+
+static BOOL readAll(int fd,PUCHAR buf,UINT len)
+{
+	INT n;
+
+	while(len)
+	{
+		n=read(fd,buf,len);
+		if(n<0)
+		{
+			if(errno==EINTR) continue;
+			return FALSE;
+		}
+		if(!n) return FALSE;
+		buf+=n;
+		len-=n;
+	}
+	return TRUE;
+}
+
+static BOOL writeFrame(int fd,UCHAR type,PUCHAR buf,UINT len)
+{
+	UCHAR hdr[5];
+
+	hdr[0]=type;
+	Set32(hdr+1,len);
+	if(!writeAll(fd,hdr,5)) return FALSE;
+	return writeAll(fd,buf,len);
+}
+
+static int openSocket(PCHAR sockname,struct sockaddr_un *addr)
+{
+	int s;
+
+	if(strlen(sockname)>=sizeof(addr->sun_path))
+	{
+		addError("Socket name %s too long",sockname);
+		return -1;
+	}
+	memset(addr,0,sizeof(struct sockaddr_un));
+	addr->sun_family=AF_UNIX;
+	strcpy(addr->sun_path,sockname);
+	s=socket(AF_UNIX,SOCK_STREAM,0);
+	if(s<0)
+	{
+		addError("Unable to create socket: %s",strerror(errno));
+	}
+	return s;
+}
+
+/* library opened by the link in this child, tell the server to cache it */
+void serverNoteLibrary(PCHAR file)
+{
+	PCHAR path;
+
+	if(reportFd<0) return;
+	path=getFullPath(file);
+	writeAll(reportFd,path,strlen(path));
+	writeAll(reportFd,"\n",1);
+	checkFree(path);
+}
+
+/* run one link request, output is passed back to the client as it arrives */
+static void serveRequest(int client,PUCHAR req,UINT reqLen)
+{
+	PPCHAR argv=NULL;
+	int argc=0;
+	UINT i;
+	int outPipe[2],libPipe[2];
+	pid_t pid;
+	int status,maxfd,n;
+	fd_set fds;
+	UCHAR buf[4096];
+	PCHAR libs=NULL;
+	UINT libsLength=0;
+	UCHAR exitCode;
+	PCHAR p,q;
+
+	/* request is working directory followed by arguments, all NUL terminated */
+	for(i=0;i<reqLen;i+=strlen(req+i)+1)
+	{
+		argv=checkRealloc(argv,(argc+2)*sizeof(PCHAR));
+		argv[argc++]=req+i;
+	}
+	if(argc<1 || req[reqLen-1])
+	{
+		checkFree(argv);
+		return;
+	}
+	argv[argc]=NULL;
+
+	if(pipe(outPipe)) return;
+	if(pipe(libPipe))
+	{
+		close(outPipe[0]);
+		close(outPipe[1]);
+		return;
+	}
+	fflush(NULL);
+	pid=fork();
+	if(!pid)
+	{
+		close(client);
+		close(listenFd);
+		close(outPipe[0]);
+		close(libPipe[0]);
+		dup2(outPipe[1],1);
+		dup2(outPipe[1],2);
+		close(outPipe[1]);
+		reportFd=libPipe[1];
+		if(chdir(argv[0]))
+		{
+			fprintf(stderr,"Unable to change directory to %s\n",argv[0]);
+			exit(1);
+		}
+		/* argv[0] becomes the program name for the link */
+		exit(linkMain(argc,argv));
+	}
+	close(outPipe[1]);
+	close(libPipe[1]);
+	if(pid<0)
+	{
+		close(outPipe[0]);
+		close(libPipe[0]);
+		checkFree(argv);
+		return;
+	}
+
+	while(outPipe[0]>=0 || libPipe[0]>=0)
+	{
+		FD_ZERO(&fds);
+		maxfd=-1;
+		if(outPipe[0]>=0)
+		{
+			FD_SET(outPipe[0],&fds);
+			maxfd=outPipe[0];
+		}
+		if(libPipe[0]>=0)
+		{
+			FD_SET(libPipe[0],&fds);
+			if(libPipe[0]>maxfd) maxfd=libPipe[0];
+		}
+		if(select(maxfd+1,&fds,NULL,NULL,NULL)<0)
+		{
+			if(errno==EINTR) continue;
+			break;
+		}
+		if(outPipe[0]>=0 && FD_ISSET(outPipe[0],&fds))
+		{
+			n=read(outPipe[0],buf,sizeof(buf));
+			if(n>0)
+			{
+				writeFrame(client,FRAME_OUTPUT,buf,n);
+			}
+			else if(!n || errno!=EINTR)
+			{
+				close(outPipe[0]);
+				outPipe[0]=-1;
+			}
+		}
+		if(libPipe[0]>=0 && FD_ISSET(libPipe[0],&fds))
+		{
+			n=read(libPipe[0],buf,sizeof(buf));
+			if(n>0)
+			{
+				libs=checkRealloc(libs,libsLength+n+1);
+				memcpy(libs+libsLength,buf,n);
+				libsLength+=n;
+				libs[libsLength]=0;
+			}
+			else if(!n || errno!=EINTR)
+			{
+				close(libPipe[0]);
+				libPipe[0]=-1;
+			}
+		}
+	}
+	if(outPipe[0]>=0) close(outPipe[0]);
+	if(libPipe[0]>=0) close(libPipe[0]);
+
+	while(waitpid(pid,&status,0)<0 && errno==EINTR);
+	exitCode=(WIFEXITED(status))?WEXITSTATUS(status):1;
+	writeFrame(client,FRAME_EXIT,&exitCode,1);
+	close(client);
+
+	/* bring the cache up to date with the libraries the link used */
+	for(p=libs;p && *p;p=q)
+	{
+		q=strchr(p,'\n');
+		if(!q) break;
+		*q++=0;
+		cacheLibrary(p);
+	}
+	checkFree(libs);
+	checkFree(argv);
+}
+
+int runServer(PCHAR sockname)
+{
+	int s,client;
+	struct sockaddr_un addr;
+	UCHAR hdr[4];
+	PUCHAR req;
+	UINT len,i;
+	struct stat st;
+
+	s=openSocket(sockname,&addr);
+	if(s<0) return 1;
+	/* only replace a stale socket, never some other file */
+	if(!lstat(sockname,&st))
+	{
+		if(!S_ISSOCK(st.st_mode))
+		{
+			addError("Unable to listen on %s: not a socket",sockname);
+			close(s);
+			return 1;
+		}
+		unlink(sockname);
+	}
+	if(bind(s,(struct sockaddr *)&addr,sizeof(addr)) || listen(s,16))
+	{
+		addError("Unable to listen on %s: %s",sockname,strerror(errno));
+		close(s);
+		return 1;
+	}
+	listenFd=s;
+	signal(SIGPIPE,SIG_IGN);
+	libCacheEnabled=TRUE;
+	diagnostic(DIAG_VITAL,"Link server listening on %s\n",sockname);
+
+	while(TRUE)
+	{
+		client=accept(s,NULL,NULL);
+		if(client<0)
+		{
+			if(errno==EINTR) continue;
+			addError("Unable to accept connection: %s",strerror(errno));
+			break;
+		}
+		if(!readAll(client,hdr,4))
+		{
+			close(client);
+			continue;
+		}
+		len=hdr[0]+(hdr[1]<<8)+(hdr[2]<<16)+(hdr[3]<<24);
+		if(!len || len>MAX_REQUEST)
+		{
+			close(client);
+			continue;
+		}
+		req=checkMalloc(len);
+		if(readAll(client,req,len))
+		{
+			serveRequest(client,req,len);
+		}
+		else
+		{
+			close(client);
+		}
+		checkFree(req);
+
+		/* errors while refreshing the cache only affect that library */
+		for(i=0;i<errorCount;++i)
+		{
+			fprintf(stderr,"Warning: %s\n",errorList[i]);
+			checkFree(errorList[i]);
+		}
+		errorCount=0;
+	}
+	close(s);
+	unlink(sockname);
+	return 1;
+}
+
+/* send link to server, linking here instead if no server is running */
+int runClient(PCHAR sockname,int argc,char *argv[])
+{
+	int s,i;
+	struct sockaddr_un addr;
+	char cwd[1024];
+	PUCHAR req;
+	UINT len,l;
+	UCHAR hdr[5];
+	UCHAR buf[4096];
+
+	if(!getcwd(cwd,sizeof(cwd)))
+	{
+		return linkMain(argc,argv);
+	}
+	s=openSocket(sockname,&addr);
+	if(s<0 || connect(s,(struct sockaddr *)&addr,sizeof(addr)))
+	{
+		if(s>=0) close(s);
+		errorCount=0;
+		diagnostic(DIAG_BASIC,"No link server on %s, linking locally\n",sockname);
+		return linkMain(argc,argv);
+	}
+	signal(SIGPIPE,SIG_IGN);
+
+	len=strlen(cwd)+1;
+	for(i=1;i<argc;++i)
+	{
+		len+=strlen(argv[i])+1;
+	}
+	req=checkMalloc(len+4);
+	Set32(req,len);
+	l=4;
+	strcpy(req+l,cwd);
+	l+=strlen(cwd)+1;
+	for(i=1;i<argc;++i)
+	{
+		strcpy(req+l,argv[i]);
+		l+=strlen(argv[i])+1;
+	}
+	if(!writeAll(s,req,len+4))
+	{
+		checkFree(req);
+		close(s);
+		addError("Unable to send link request to server");
+		return 1;
+	}
+	checkFree(req);
+
+	while(readAll(s,hdr,5))
+	{
+		len=hdr[1]+(hdr[2]<<8)+(hdr[3]<<16)+(hdr[4]<<24);
+		if(hdr[0]==FRAME_EXIT)
+		{
+			if(len!=1 || !readAll(s,buf,1)) break;
+			close(s);
+			return buf[0];
+		}
+		while(len)
+		{
+			l=(len>sizeof(buf))?sizeof(buf):len;
+			if(!readAll(s,buf,l)) break;
+			fwrite(buf,1,l,stdout);
+			len-=l;
+		}
+		fflush(stdout);
+	}
+	close(s);
+	addError("Link server closed connection");
+	return 1;
+}
+
+#else
+
+void serverNoteLibrary(PCHAR file)
+{
+}
+
+int runServer(PCHAR sockname)
+{
+	addError("Link server not supported on this platform");
+	return 1;
+}
+
+int runClient(PCHAR sockname,int argc,char *argv[])
+{
+	return linkMain(argc,argv);
+}
+
+#endif
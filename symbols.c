@@ -1,8 +1,19 @@
 #include "alink.h"
 
+static BOOL sumChunk(PUCHAR p,UINT len,void *ctx)
+{
+	UINT k;
+
+	for(k=0;k<len;++k)
+	{
+		*(UINT *)ctx+=p[k];
+	}
+	return TRUE;
+}
+
 static UINT checksumSection(PSEG s)
 {
-	UINT i=0,j,k;
+	UINT i=0,j;
 
 	for(j=0;j<s->contentCount;++j)
 	{
@@ -12,10 +23,8 @@ static UINT checksumSection(PSEG s)
 			return 0;
 		}
 		i+=s->contentList[j].data->offset;
-		for(k=0;k<s->contentList[j].data->length;++k)
-		{
-			i+=s->contentList[j].data->data[k];
-		}
+		if(isZeroBlock(s->contentList[j].data)) continue; /* zeroes add nothing */
+		scanDataBlock(s->contentList[j].data,sumChunk,&i);
 	}
 
 	return i;
@@ -23,8 +32,9 @@ static UINT checksumSection(PSEG s)
 
 static BOOL loadLibraryModules(void)
 {
-	UINT i,j;
+	UINT i,j,filepos;
 	PFILE f;
+	PMODULE lib;
 
 	static UINT loadedLibCount=0;
 	static PLIBMOD loadedLib=NULL;
@@ -49,17 +59,27 @@ static BOOL loadLibraryModules(void)
 		loadedLib[loadedLibCount].filepos=globalSymbols[i]->filepos;
 		loadedLibCount++;
 
+		traceBegin("libmod","%s@%08lX (%s)",globalSymbols[i]->mod->file,globalSymbols[i]->filepos,globalSymbols[i]->name);
 		f=fopen(globalSymbols[i]->mod->file,"rb");
 
 		/* now load the module, as specified */
-		fseek(f,globalSymbols[i]->filepos,SEEK_SET);
-		if(!globalSymbols[i]->modload(f,globalSymbols[i]->mod))
+		lib=globalSymbols[i]->mod;
+		filepos=globalSymbols[i]->filepos;
+		fseek(f,filepos,SEEK_SET);
+		if(!globalSymbols[i]->modload(f,lib))
 		{
-			addError("Error loading library module from file %s",globalSymbols[i]->mod->file);
+			traceEnd();
+			addError("Error loading library module from file %s",lib->file);
 			return FALSE;
 		}
+		if(fingerprint)
+		{
+			fingerprintNoteMember(lib,filepos,ftell(f));
+		}
+		addDependency(lib->file);
 
 		fclose(f);
+		traceEnd();
 	}
 	return TRUE;
 }
@@ -80,6 +100,8 @@ void resolveExterns(void)
 		}
 		loadLibraryModules();
 	}
+	/* left for the final link to resolve */
+	if(partialLink) return;
 	for(i=0;i<globalExternCount;++i)
 	{
 		if(globalExterns[i]->pubdef) continue;
@@ -426,6 +448,8 @@ static BOOL emitCommonSymbol(PSYMBOL sym)
 
 	if(sym->type==PUB_COMDEF)
 	{
+		/* relocatable output leaves commons for the final link to allocate */
+		if(partialLink) return TRUE;
 		if(sym->isfar)
 		{
 			if(!farcomdefSeg || ((farcomdefSeg->length+sym->length)>0x10000))
@@ -614,11 +638,15 @@ static BOOL emitCommonSymbol(PSYMBOL sym)
 			return FALSE;
 		}
 
-		globalSegs=checkRealloc(globalSegs,(globalSegCount+c->segCount)*sizeof(PSEG));
-		for(k=0;k<c->segCount;++k)
+		/* relocatable output writes the instance as COMDAT sections of its own */
+		if(!partialLink)
 		{
-			globalSegs[globalSegCount]=c->segList[k];
-			globalSegCount++;
+			globalSegs=checkRealloc(globalSegs,(globalSegCount+c->segCount)*sizeof(PSEG));
+			for(k=0;k<c->segCount;++k)
+			{
+				globalSegs[globalSegCount]=c->segList[k];
+				globalSegCount++;
+			}
 		}
 
 		/* define location of symbols */
@@ -0,0 +1,275 @@
+#include "alink.h"
+
+#ifdef GOT_GETTIMEOFDAY
+#include <sys/time.h>
+#endif
+#ifdef GOT_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+#define MAX_PHASE_DEPTH 16
+
+struct phase
+{
+	PCHAR name;
+	UINT depth;
+	double wall;
+	double cpu;
+};
+
+typedef struct phase PHASE,*PPHASE;
+
+BOOL timeReport=FALSE;
+PCHAR timeReportFile=NULL;
+
+UINT segmentsCreated=0;
+UINT dataBlocksCreated=0;
+UINT fixupsApplied=0;
+
+static PPHASE phaseList=NULL;
+static UINT phaseCount=0;
+static UINT phaseStack[MAX_PHASE_DEPTH];
+static UINT phaseDepth=0;
+static double startWall=0;
+
+static PFILE traceFile=NULL;
+static UINT traceCount=0;
+
+static double wallTime(void)
+{
+#ifdef GOT_GETTIMEOFDAY
+	struct timeval tv;
+
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec+tv.tv_usec/1000000.0;
+#else
+	return (double)time(NULL);
+#endif
+}
+
+static double cpuTime(void)
+{
+	return ((double)clock())/CLOCKS_PER_SEC;
+}
+
+/* peak resident set size in kilobytes, or zero if not known */
+static UINT peakRSS(void)
+{
+#ifdef GOT_GETRUSAGE
+	struct rusage ru;
+
+	if(getrusage(RUSAGE_SELF,&ru)) return 0;
+#ifdef __APPLE__
+	return ru.ru_maxrss/1024; /* reported in bytes */
+#else
+	return ru.ru_maxrss;
+#endif
+#else
+	return 0;
+#endif
+}
+
+void startTiming(void)
+{
+	startWall=wallTime();
+}
+
+/* write a string as a JSON string literal */
+static void traceString(PCHAR s)
+{
+	fputc('"',traceFile);
+	for(;*s;++s)
+	{
+		if((*s=='"') || (*s=='\\'))
+		{
+			fputc('\\',traceFile);
+			fputc(*s,traceFile);
+		}
+		else if((UCHAR)*s<0x20)
+		{
+			fprintf(traceFile,"\\u%04x",(UCHAR)*s);
+		}
+		else
+		{
+			fputc(*s,traceFile);
+		}
+	}
+	fputc('"',traceFile);
+}
+
+static void traceEvent(PCHAR category,PCHAR name,char type)
+{
+	fprintf(traceFile,"%s\n{",traceCount?",":"");
+	if(name)
+	{
+		fprintf(traceFile,"\"name\":");
+		traceString(name);
+		fprintf(traceFile,",\"cat\":\"%s\",",category);
+	}
+	fprintf(traceFile,"\"ph\":\"%c\",\"ts\":%.0f,\"pid\":1,\"tid\":1}",
+	        type,(wallTime()-startWall)*1000000.0);
+	traceCount++;
+}
+
+BOOL openTrace(PCHAR name)
+{
+	if(traceFile) return TRUE;
+	traceFile=fopen(name,"wt");
+	if(!traceFile)
+	{
+		addError("Unable to open trace file %s",name);
+		return FALSE;
+	}
+	fprintf(traceFile,"{\"traceEvents\":[");
+	traceCount=0;
+	return TRUE;
+}
+
+void closeTrace(void)
+{
+	if(!traceFile) return;
+	fprintf(traceFile,"\n]}\n");
+	fclose(traceFile);
+	traceFile=NULL;
+}
+
+void traceBegin(PCHAR category,PCHAR fmt,...)
+{
+	va_list ap;
+	char buf[1024];
+
+	if(!traceFile) return;
+	va_start(ap,fmt);
+	vsnprintf(buf,sizeof(buf),fmt,ap);
+	va_end(ap);
+	traceEvent(category,buf,'B');
+}
+
+void traceEnd(void)
+{
+	if(!traceFile) return;
+	traceEvent(NULL,NULL,'E');
+}
+
+void beginPhase(PCHAR name)
+{
+	traceBegin("phase","%s",name);
+	if(!timeReport) return;
+	if(phaseDepth>=MAX_PHASE_DEPTH)
+	{
+		/* still count the nesting, so endPhase calls match up */
+		phaseDepth++;
+		return;
+	}
+	phaseList=checkRealloc(phaseList,(phaseCount+1)*sizeof(PHASE));
+	phaseList[phaseCount].name=name;
+	phaseList[phaseCount].depth=phaseDepth;
+	/* store start times, replaced by durations in endPhase */
+	phaseList[phaseCount].wall=wallTime();
+	phaseList[phaseCount].cpu=cpuTime();
+	phaseStack[phaseDepth]=phaseCount;
+	phaseDepth++;
+	phaseCount++;
+}
+
+void endPhase(void)
+{
+	PPHASE p;
+
+	traceEnd();
+	if(!phaseDepth) return;
+	phaseDepth--;
+	if(phaseDepth>=MAX_PHASE_DEPTH) return;
+	p=phaseList+phaseStack[phaseDepth];
+	p->wall=wallTime()-p->wall;
+	p->cpu=cpuTime()-p->cpu;
+}
+
+static void countSegment(PSEG s,UINT *segs,UINT *blocks,UINT *relocs)
+{
+	UINT i;
+
+	if(!s) return;
+	(*segs)++;
+	(*relocs)+=s->relocCount;
+	for(i=0;i<s->contentCount;++i)
+	{
+		if(s->contentList[i].flag==SEGMENT)
+			countSegment(s->contentList[i].seg,segs,blocks,relocs);
+		else
+			(*blocks)++;
+	}
+}
+
+void reportTiming(void)
+{
+	UINT i,j;
+	UINT segs=0,blocks=0,relocs=0;
+	double wall,cpu;
+	PFILE f;
+
+	/* close any phases left open by an early exit */
+	while(phaseDepth) endPhase();
+	closeTrace();
+
+	if(!timeReport) return;
+
+	wall=wallTime()-startWall;
+	cpu=cpuTime();
+
+	for(i=0;i<spaceCount;++i)
+	{
+		countSegment(spaceList[i],&segs,&blocks,&relocs);
+	}
+
+	if(timeReportFile)
+	{
+		f=fopen(timeReportFile,"wt");
+		if(!f)
+		{
+			addError("Unable to open time report file %s",timeReportFile);
+			return;
+		}
+		fprintf(f,"{\n  \"phases\": [");
+		for(i=0;i<phaseCount;++i)
+		{
+			fprintf(f,"%s\n    {\"name\": \"%s\", \"depth\": %lu, \"wall\": %.6f, \"cpu\": %.6f}",
+			        i?",":"",phaseList[i].name,phaseList[i].depth,phaseList[i].wall,phaseList[i].cpu);
+		}
+		fprintf(f,"\n  ],\n");
+		fprintf(f,"  \"total\": {\"wall\": %.6f, \"cpu\": %.6f},\n",wall,cpu);
+		fprintf(f,"  \"peak_rss_kb\": %lu,\n",peakRSS());
+		fprintf(f,"  \"counts\": {\"files\": %lu, \"modules\": %lu, \"symbols\": %lu, \"local_symbols\": %lu, "
+		        "\"segments_created\": %lu, \"datablocks_created\": %lu, \"fixups_applied\": %lu, "
+		        "\"output_segments\": %lu, \"output_datablocks\": %lu, \"output_relocs\": %lu}\n",
+		        fileCount,moduleCount,globalSymbolCount,localSymbolCount,
+		        segmentsCreated,dataBlocksCreated,fixupsApplied,segs,blocks,relocs);
+		fprintf(f,"}\n");
+		fclose(f);
+		return;
+	}
+
+	diagnostic(DIAG_VITAL,"\nTime report:\n");
+	diagnostic(DIAG_VITAL,"  %-32s %10s %10s\n","Phase","Wall(s)","CPU(s)");
+	for(i=0;i<phaseCount;++i)
+	{
+		diagnostic(DIAG_VITAL,"  ");
+		for(j=0;j<phaseList[i].depth;++j)
+		{
+			diagnostic(DIAG_VITAL,"  ");
+		}
+		diagnostic(DIAG_VITAL,"%-*s %10.3f %10.3f\n",(int)(32-2*phaseList[i].depth),phaseList[i].name,
+		           phaseList[i].wall,phaseList[i].cpu);
+	}
+	diagnostic(DIAG_VITAL,"  %-32s %10.3f %10.3f\n","Total",wall,cpu);
+	i=peakRSS();
+	if(i)
+	{
+		diagnostic(DIAG_VITAL,"Peak RSS: %lu KB\n",i);
+	}
+	diagnostic(DIAG_VITAL,"Files: %lu, modules: %lu, symbols: %lu global, %lu local\n",
+	           fileCount,moduleCount,globalSymbolCount,localSymbolCount);
+	diagnostic(DIAG_VITAL,"Segments created: %lu, data blocks created: %lu, fixups applied: %lu\n",
+	           segmentsCreated,dataBlocksCreated,fixupsApplied);
+	diagnostic(DIAG_VITAL,"Output segments: %lu, data blocks: %lu, relocations: %lu\n",segs,blocks,relocs);
+}
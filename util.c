@@ -1,5 +1,15 @@
 #include "alink.h"
 
+#include <sys/stat.h>
+
+#ifdef GOT_GETCWD
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+#endif
+
 int getBitCount(UINT a)
 {
 	int count=0;
@@ -41,6 +51,17 @@ void Set32(PUCHAR buf,UINT v)
 	buf[3]=(v>>24)&0xff;
 }
 
+BOOL isZeroData(PUCHAR buf,UINT len)
+{
+	UINT i;
+
+	for(i=0;i<len;++i)
+	{
+		if(buf[i]) return FALSE;
+	}
+	return TRUE;
+}
+
 unsigned short wtoupper(unsigned short a)
 {
 	if(a>=256) return a;
@@ -75,9 +96,55 @@ int sortCompare(const void *x1,const void *x2)
 	return strcmp(((PSYMBOL) x1)->name,((PSYMBOL)x2)->name);
 }
 
-void *checkMalloc(size_t x)
+#define ALLOC_SITE_HASH 1024
+#define ALLOC_SITE_REPORT 20
+
+struct allocsite
+{
+	PCHAR file;
+	int line;
+	UINT calls;
+	UINT bytes;
+	UINT grows;
+	UINT moves;
+	UINT frees;
+};
+
+typedef struct allocsite ALLOCSITE,*PALLOCSITE,**PPALLOCSITE;
+
+BOOL allocStats=FALSE;
+
+static ALLOCSITE allocSites[ALLOC_SITE_HASH];
+static ALLOCSITE allocOverflow={"(other)",0};
+static UINT allocSiteCount=0;
+
+/* find statistics entry for a call site, __FILE__ is the same pointer for every site in a file */
+static PALLOCSITE getAllocSite(PCHAR file,int line)
+{
+	UINT i,j;
+
+	i=(((UINT)(size_t)file>>3)*31+line)%ALLOC_SITE_HASH;
+	for(j=0;j<ALLOC_SITE_HASH;++j,i=(i+1)%ALLOC_SITE_HASH)
+	{
+		if(!allocSites[i].file)
+		{
+			allocSites[i].file=file;
+			allocSites[i].line=line;
+			allocSiteCount++;
+			return allocSites+i;
+		}
+		if((allocSites[i].file==file) && (allocSites[i].line==line))
+		{
+			return allocSites+i;
+		}
+	}
+	return &allocOverflow;
+}
+
+void *checkMallocAt(size_t x,PCHAR file,int line)
 {
 	void *p;
+	PALLOCSITE s;
 
 	p=malloc(x);
 	if(!p)
@@ -85,23 +152,44 @@ void *checkMalloc(size_t x)
 		fprintf(stderr,"Error, Insufficient memory in call to malloc\n");
 		exit(1);
 	}
+	if(allocStats)
+	{
+		s=getAllocSite(file,line);
+		s->calls++;
+		s->bytes+=x;
+	}
 	return p;
 }
 
-void *checkRealloc(void *p,size_t x)
+void *checkReallocAt(void *p,size_t x,PCHAR file,int line)
 {
+	void *old=p;
+	PALLOCSITE s;
+
 	p=realloc(p,x);
 	if(!p)
 	{
 		fprintf(stderr,"Error, Insufficient memory in call to realloc\n");
 		exit(1);
 	}
+	if(allocStats)
+	{
+		s=getAllocSite(file,line);
+		s->calls++;
+		s->bytes+=x;
+		if(old)
+		{
+			s->grows++;
+			if(old!=p) s->moves++;
+		}
+	}
 	return p;
 }
 
-char *checkStrdup(const char *s)
+char *checkStrdupAt(const char *s,PCHAR file,int line)
 {
 	char *p;
+	PALLOCSITE site;
 
 	if(!s) return NULL;
 
@@ -111,17 +199,74 @@ char *checkStrdup(const char *s)
 		fprintf(stderr,"Error, Insufficient memory in call to strdup\n");
 		exit(1);
 	}
+	if(allocStats)
+	{
+		site=getAllocSite(file,line);
+		site->calls++;
+		site->bytes+=strlen(s)+1;
+	}
 	return p;
 }
 
-void checkFree(void *p)
+void checkFreeAt(void *p,PCHAR file,int line)
 {
 	if(!p) return;
 	free(p);
+	if(allocStats)
+	{
+		getAllocSite(file,line)->frees++;
+	}
 }
 
+static int allocSiteCompare(PPALLOCSITE s1,PPALLOCSITE s2)
+{
+	if((*s1)->calls!=(*s2)->calls) return ((*s1)->calls>(*s2)->calls)?-1:+1;
+	if((*s1)->bytes!=(*s2)->bytes) return ((*s1)->bytes>(*s2)->bytes)?-1:+1;
+	return 0;
+}
 
+void reportAllocStats(void)
+{
+	UINT i,j;
+	UINT calls=0,bytes=0,grows=0,moves=0,frees=0;
+	PPALLOCSITE list;
+	PCHAR name;
+	char site[64];
 
+	if(!allocStats) return;
+
+	list=malloc((allocSiteCount+1)*sizeof(PALLOCSITE));
+	if(!list) return;
+	for(i=0,j=0;i<ALLOC_SITE_HASH;++i)
+	{
+		if(allocSites[i].file) list[j++]=allocSites+i;
+	}
+	if(allocOverflow.calls || allocOverflow.frees) list[j++]=&allocOverflow;
+	for(i=0;i<j;++i)
+	{
+		calls+=list[i]->calls;
+		bytes+=list[i]->bytes;
+		grows+=list[i]->grows;
+		moves+=list[i]->moves;
+		frees+=list[i]->frees;
+	}
+	qsort(list,j,sizeof(PALLOCSITE),(PCOMPAREFUNC)allocSiteCompare);
+
+	diagnostic(DIAG_VITAL,"\nAllocation statistics (%lu call sites):\n",j);
+	diagnostic(DIAG_VITAL,"  %-24s %10s %12s %10s %10s %10s\n","Site","Calls","Bytes","Grows","Moves","Frees");
+	for(i=0;(i<j) && (i<ALLOC_SITE_REPORT);++i)
+	{
+		/* strip any path from __FILE__ */
+		name=list[i]->file;
+		if(strrchr(name,'/')) name=strrchr(name,'/')+1;
+		if(strrchr(name,'\\')) name=strrchr(name,'\\')+1;
+		snprintf(site,sizeof(site),"%s:%i",name,list[i]->line);
+		diagnostic(DIAG_VITAL,"  %-24s %10lu %12lu %10lu %10lu %10lu\n",site,
+		           list[i]->calls,list[i]->bytes,list[i]->grows,list[i]->moves,list[i]->frees);
+	}
+	diagnostic(DIAG_VITAL,"  %-24s %10lu %12lu %10lu %10lu %10lu\n","Total",calls,bytes,grows,moves,frees);
+	free(list);
+}
 
 BOOL getStub(PCHAR stubName,PUCHAR *pstubData,UINT *pstubSize)
 {
@@ -142,6 +287,7 @@ BOOL getStub(PCHAR stubName,PUCHAR *pstubData,UINT *pstubSize)
 			addError("Unable to open stub file %s",stubName);
 			return FALSE;
 		}
+		addDependency(stubName);
 		/* try and read EXE header */
 		if(fread(headbuf,1,EXE_HEADERSIZE,f)!=EXE_HEADERSIZE)
 		{
@@ -232,6 +378,50 @@ BOOL getStub(PCHAR stubName,PUCHAR *pstubData,UINT *pstubSize)
 	return TRUE;
 }
 
+/* absolute form of a file name, so the same file can be recognised from any directory */
+PCHAR getFullPath(PCHAR file)
+{
+	PCHAR path;
+#ifdef GOT_GETCWD
+	char cwd[1024];
+#endif
+
+	if(strchr(PATHCHARS,file[0]) || (file[0] && (file[1]==':')))
+	{
+		return checkStrdup(file);
+	}
+#ifdef GOT_GETCWD
+	if(getcwd(cwd,sizeof(cwd)))
+	{
+		path=checkMalloc(strlen(cwd)+strlen(file)+2);
+		sprintf(path,"%s%c%s",cwd,PATHCHARS[1],file);
+		return path;
+	}
+#endif
+	path=checkStrdup(file);
+	return path;
+}
+
+BOOL getFileStamp(PCHAR name,PFILESTAMP stamp)
+{
+	struct stat st;
+
+	if(stat(name,&st)) return FALSE;
+	stamp->size=st.st_size;
+	stamp->mtime=st.st_mtime;
+#ifdef GOT_ST_MTIM
+	stamp->mtimeNsec=st.st_mtim.tv_nsec;
+#else
+	stamp->mtimeNsec=0;
+#endif
+	return TRUE;
+}
+
+BOOL sameFileStamp(PFILESTAMP a,PFILESTAMP b)
+{
+	return (a->size==b->size) && (a->mtime==b->mtime) && (a->mtimeNsec==b->mtimeNsec);
+}
+
 /* define strupr if not otherwise defined */
 #ifndef GOT_STRUPR
 